@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
+#include <gsl/span>
 #include <sam.h>
 #include "clocks.h"
+#include "sercom_transfer.h"
 #include "utils.h"
 
 namespace mcu {
@@ -42,6 +45,20 @@ public:
 		sercom->SPI.CTRLA.bit.ENABLE = true;
 	}
 
+	/**
+	 * Changes the baud rate. No transfer may be in progress
+	 * @param baud Baud rate (bits per second)
+	 * @param clkGen The ClockGenerator passed to the constructor
+	 */
+	void setBaud(unsigned baud, const ClockGenerator& clkGen) const
+	{
+		sercom->SPI.CTRLA.bit.ENABLE = false;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+		sercom->SPI.BAUD.reg = clkGen.frequency / (2 * baud) - 1;
+		sercom->SPI.CTRLA.bit.ENABLE = true;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+	}
+
 	/**
 	 * Synchronously sends and receives a byte
 	 * @param data Data to send
@@ -54,8 +71,127 @@ public:
 		return sercom->SPI.DATA.reg;
 	}
 
-private:
+	/**
+	 * Sends \p tx and receives the same number of bytes into \p rx.
+	 * The next byte is preloaded on DRE while the previous one is shifting, so SCK runs without gaps.
+	 * @param rx At least as large as \p tx, or empty to discard the received bytes
+	 */
+	void transfer(gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx) const
+	{
+		detail::pipelinedTransfer(sercom->SPI, tx, rx);
+	}
+
+	/// Sends \p tx with the receiver disabled
+	void write(gsl::span<const uint8_t> tx) const
+	{
+		sercom->SPI.CTRLB.bit.RXEN = false;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+		detail::pipelinedWrite(sercom->SPI, tx, SERCOM_SPI_INTFLAG_TXC);
+		sercom->SPI.CTRLB.bit.RXEN = true;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+		// Drop anything that was received before RXEN took effect
+		detail::discardReceived(sercom->SPI, SERCOM_SPI_STATUS_BUFOVF);
+	}
+
+	/// Receives into \p rx while sending \p dummy
+	void read(gsl::span<uint8_t> rx, uint8_t dummy = 0xff) const
+	{
+		detail::pipelinedRead(sercom->SPI, rx, dummy);
+	}
+
+protected:
 	Sercom* const sercom;
 };
 
+/**
+ * Synchronous SPI Master with the whole configuration known at compile time.
+ * BAUD is computed and range checked at compile time and the registers are accessed through a constant address.
+ * Same interface as SPI.
+ * @tparam SercomIndex Index of the Sercom to use. 0 for SERCOM0
+ * @tparam ClockFrequency Frequency of the ClockGenerator passed to the constructor
+ * @tparam Baud Baud rate (bits per second). Rounded down to the next possible rate
+ * @tparam Mode SPI Mode 0, 1, 2 or 3
+ * @tparam LsbFirst If true LSB is transmitted first
+ * @tparam PinLayout a combination of SERCOM_SPI_CTRLA_DOPO and SERCOM_SPI_CTRLA_DIPO to set the pinLayout
+ */
+template <
+	unsigned SercomIndex, unsigned ClockFrequency, unsigned Baud, unsigned Mode = 0, bool LsbFirst = false,
+	uint32_t PinLayout = SERCOM_SPI_CTRLA_DOPO(0) | SERCOM_SPI_CTRLA_DIPO(2)
+>
+class StaticSPI {
+	static_assert(SercomIndex < SERCOM_INST_NUM, "Sercom does not exist");
+	static_assert(Mode <= 3, "SPI Mode must be 0, 1, 2 or 3");
+	static_assert((PinLayout & ~(SERCOM_SPI_CTRLA_DOPO_Msk | SERCOM_SPI_CTRLA_DIPO_Msk)) == 0, "Pin layout may only contain DOPO and DIPO");
+	static_assert(Baud != 0 && 2ULL * Baud <= ClockFrequency, "Clock must be at least 2 * baud");
+	// Rounded up, so SCK never exceeds the requested rate
+	static_assert((ClockFrequency + 2ULL * Baud - 1) / (2ULL * Baud) - 1 <= 0xff, "Baud rate too low for this clock");
+
+public:
+	static constexpr uint8_t baudRegister = (ClockFrequency + 2ULL * Baud - 1) / (2ULL * Baud) - 1;
+	/// The real SCK frequency
+	static constexpr unsigned frequency = ClockFrequency / (2 * (baudRegister + 1));
+
+	/**
+	 * @param clkGen ClockGenerator for generating the Baud clock. Must run at ClockFrequency
+	 */
+	explicit StaticSPI(const ClockGenerator& clkGen)
+	{
+		assert(clkGen.frequency == ClockFrequency);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + SercomIndex);
+		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + SercomIndex);
+
+		regs().CTRLA.reg = SERCOM_SPI_CTRLA_MODE_SPI_MASTER
+			| PinLayout
+			| SERCOM_SPI_CTRLA_FORM_SPI
+			| (Mode << SERCOM_SPI_CTRLA_CPHA_Pos)
+			| (static_cast<uint32_t>(LsbFirst) << SERCOM_SPI_CTRLA_DORD_Pos);
+		regs().CTRLB.reg = SERCOM_SPI_CTRLB_RXEN | SERCOM_SPI_CTRLB_CHSIZE(0);
+		regs().BAUD.reg = baudRegister;
+		while (regs().STATUS.bit.SYNCBUSY);
+		regs().CTRLA.bit.ENABLE = true;
+	}
+
+	/**
+	 * Synchronously sends and receives a byte
+	 * @param data Data to send
+	 * @return Received data
+	 */
+	uint8_t transfer(uint8_t data) const
+	{
+		regs().DATA.reg = data;
+		while (!regs().INTFLAG.bit.RXC);
+		return regs().DATA.reg;
+	}
+
+	/// @see SPI::transfer
+	void transfer(gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx) const
+	{
+		detail::pipelinedTransfer(regs(), tx, rx);
+	}
+
+	/// @see SPI::write
+	void write(gsl::span<const uint8_t> tx) const
+	{
+		regs().CTRLB.bit.RXEN = false;
+		while (regs().STATUS.bit.SYNCBUSY);
+		detail::pipelinedWrite(regs(), tx, SERCOM_SPI_INTFLAG_TXC);
+		regs().CTRLB.bit.RXEN = true;
+		while (regs().STATUS.bit.SYNCBUSY);
+		detail::discardReceived(regs(), SERCOM_SPI_STATUS_BUFOVF);
+	}
+
+	/// @see SPI::read
+	void read(gsl::span<uint8_t> rx, uint8_t dummy = 0xff) const
+	{
+		detail::pipelinedRead(regs(), rx, dummy);
+	}
+
+private:
+	static SercomSpi& regs()
+	{
+		const uintptr_t sercomSize = reinterpret_cast<uintptr_t>(SERCOM1) - reinterpret_cast<uintptr_t>(SERCOM0);
+		return reinterpret_cast<Sercom*>(reinterpret_cast<uintptr_t>(SERCOM0) + SercomIndex * sercomSize)->SPI;
+	}
+};
+
 } // namespace mcu
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <gsl/span>
+#include <sam.h>
+#include "ring_buffer.h"
+
+/**
+ * Logs a message through a BinaryLogger without formatting it on the device.
+ * The format string is placed in the non-loaded .logstr section and only its offset is transmitted,
+ * tools/log_decoder.py rebuilds the text from the ELF file.
+ * Supported conversions: d i u o x X c p with optional l/ll, f e g a and s.
+ *
+ * Usage: MCU_LOG(logger, "adc=%u temp=%f", value, temperature);
+ */
+#define MCU_LOG(logger, format, ...) \
+	do { \
+		[[gnu::section(".logstr")]] static constexpr char mcuLogFormat[] = format; \
+		(logger).log([]() constexpr { return mcuLogFormat; }, ##__VA_ARGS__); \
+	} while (0)
+
+namespace mcu {
+
+namespace logging {
+
+/// Encoding of a single argument in a log record
+enum class ArgumentKind : uint8_t {
+	Word,       ///< 4 bytes little endian
+	DoubleWord, ///< 8 bytes little endian
+	Float,      ///< IEEE 754 double, 8 bytes little endian
+	String,     ///< Length byte followed by up to MaxStringLength characters
+	Invalid
+};
+
+constexpr size_t MaxStringLength = 32;
+
+template <typename T>
+constexpr ArgumentKind argumentKind()
+{
+	if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>)
+		return ArgumentKind::String;
+	else if constexpr (std::is_floating_point_v<T>)
+		return ArgumentKind::Float;
+	else if constexpr ((std::is_integral_v<T> || std::is_enum_v<T>) && sizeof(T) <= 4)
+		return ArgumentKind::Word;
+	else if constexpr ((std::is_integral_v<T> || std::is_enum_v<T>) && sizeof(T) == 8)
+		return ArgumentKind::DoubleWord;
+	else if constexpr (std::is_pointer_v<T>)
+		return ArgumentKind::Word;
+	else
+		return ArgumentKind::Invalid;
+}
+
+template <typename T>
+constexpr size_t maxEncodedSize()
+{
+	switch (argumentKind<T>()) {
+		case ArgumentKind::Word: return 4;
+		case ArgumentKind::String: return 1 + MaxStringLength;
+		default: return 8;
+	}
+}
+
+/// Parses the conversion specification after a '%' and advances \p format behind it
+constexpr ArgumentKind parseConversion(const char*& format)
+{
+	while (*format == '-' || *format == '+' || *format == ' ' || *format == '#' || *format == '0')
+		format++;
+	while ((*format >= '0' && *format <= '9') || *format == '.')
+		format++;
+
+	unsigned longs = 0;
+	while (*format == 'h' || *format == 'l' || *format == 'j' || *format == 'z' || *format == 't' || *format == 'L') {
+		longs += *format == 'l' ? 1 : *format == 'j' ? 2 : 0;
+		format++;
+	}
+
+	switch (*format++) {
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': case 'p':
+			return longs >= 2 ? ArgumentKind::DoubleWord : ArgumentKind::Word;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			return ArgumentKind::Float;
+		case 's':
+			return ArgumentKind::String;
+		default:
+			format--;
+			return ArgumentKind::Invalid;
+	}
+}
+
+/// @return true if the conversions in \p format match the argument types \p Args
+template <typename... Args>
+constexpr bool argumentsMatch(const char* format)
+{
+	constexpr ArgumentKind kinds[] = {argumentKind<Args>()..., ArgumentKind::Invalid};
+	size_t index = 0;
+	while (*format != '\0') {
+		if (*format++ != '%')
+			continue;
+		if (*format == '%') {
+			format++;
+			continue;
+		}
+		const ArgumentKind kind = parseConversion(format);
+		if (kind == ArgumentKind::Invalid || index >= sizeof...(Args) || kinds[index] != kind)
+			return false;
+		index++;
+	}
+	return index == sizeof...(Args);
+}
+
+} // namespace logging
+
+/**
+ * @brief Tokenized logger with deferred formatting
+ *
+ * Each record is stored as [length][format id (2 bytes)][arguments] in a RAM ring buffer
+ * and later moved to a transport with flush(). Use the MCU_LOG macro to create records.
+ * log() may be called from interrupts, flush() only from one context.
+ *
+ * @tparam BufferSize Size of the record buffer in bytes. Must be a power of two
+ */
+template <size_t BufferSize>
+class BinaryLogger {
+public:
+	/// Called by MCU_LOG. \p format returns a pointer to the format string in the .logstr section
+	template <typename Format, typename... Args>
+	void log(Format format, const Args&... args) noexcept
+	{
+		static_assert(logging::argumentsMatch<std::decay_t<Args>...>(format()), "Arguments do not match the format string");
+		constexpr size_t maxSize = 3 + (logging::maxEncodedSize<std::decay_t<Args>>() + ... + 0);
+		static_assert(maxSize <= 256, "Too many arguments for one record");
+
+		std::array<std::byte, maxSize> record;
+		// .logstr is not loaded and starts at address 0, so the address is the offset in the section
+		const uint16_t id = static_cast<uint16_t>(reinterpret_cast<uintptr_t>(format()));
+		record[1] = static_cast<std::byte>(id);
+		record[2] = static_cast<std::byte>(id >> 8);
+		size_t length = 3;
+		(encode(record.data(), length, args), ...);
+		record[0] = static_cast<std::byte>(length - 1);
+
+		const uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		if (buffer.capacity() - buffer.size() >= length)
+			buffer.write(gsl::span<const std::byte>(record.data(), length));
+		else
+			dropped = dropped + 1;
+		__set_PRIMASK(primask);
+	}
+
+	/**
+	 * Moves as many buffered bytes as possible to \p transport without blocking
+	 * @param transport E.g. a BufferedUART. Needs size_t write(gsl::span<const std::byte>)
+	 */
+	template <typename Transport>
+	void flush(Transport& transport) noexcept
+	{
+		gsl::span<const std::byte> data = buffer.readable();
+		while (!data.empty()) {
+			const size_t written = transport.write(data);
+			buffer.consume(written);
+			if (written != static_cast<size_t>(data.size()))
+				break;
+			data = buffer.readable();
+		}
+	}
+
+	/// @return Number of records lost because the buffer was full
+	uint32_t droppedRecords() const noexcept { return dropped; }
+
+private:
+	template <typename T>
+	static void encode(std::byte* record, size_t& length, const T& value) noexcept
+	{
+		using Type = std::decay_t<T>;
+		constexpr logging::ArgumentKind kind = logging::argumentKind<Type>();
+		if constexpr (kind == logging::ArgumentKind::String) {
+			size_t size = 0;
+			while (size < logging::MaxStringLength && value[size] != '\0')
+				size++;
+			record[length++] = static_cast<std::byte>(size);
+			std::memcpy(record + length, value, size);
+			length += size;
+		} else if constexpr (kind == logging::ArgumentKind::Float) {
+			const double converted = value;
+			std::memcpy(record + length, &converted, 8);
+			length += 8;
+		} else if constexpr (kind == logging::ArgumentKind::DoubleWord) {
+			const uint64_t converted = static_cast<uint64_t>(value);
+			std::memcpy(record + length, &converted, 8);
+			length += 8;
+		} else if constexpr (std::is_pointer_v<Type>) {
+			const uint32_t converted = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(value));
+			std::memcpy(record + length, &converted, 4);
+			length += 4;
+		} else {
+			// Sign extension keeps negative values of small types intact
+			using Promoted = std::conditional_t<std::is_signed_v<Type>, int32_t, uint32_t>;
+			const Promoted converted = static_cast<Promoted>(value);
+			std::memcpy(record + length, &converted, 4);
+			length += 4;
+		}
+	}
+
+	RingBuffer<std::byte, BufferSize> buffer;
+	volatile uint32_t dropped = 0;
+};
+
+} // namespace mcu
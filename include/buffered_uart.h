@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <gsl/span>
+#include <sam.h>
+#include "power.h"
+#include "ring_buffer.h"
+#include "uart.h"
+#include "utils.h"
+
+namespace mcu {
+
+/// Receive errors counted by BufferedUART instead of silently dropping bytes. The default statistics
+struct UartErrorCounters {
+	/// Bytes discarded because of a framing error (FERR)
+	volatile uint32_t framingErrors = 0;
+	/// Bytes discarded because of a parity error (PERR)
+	volatile uint32_t parityErrors = 0;
+	/// Hardware buffer overflows (BUFOVF). At least one byte was lost each time
+	volatile uint32_t overflows = 0;
+	/// Bytes discarded because the receive buffer was full
+	volatile uint32_t dropped = 0;
+
+	/// No start-of-frame interrupt in sleepUntilReceive(), the received byte wakes the device
+	static constexpr bool MeasuresWakeup = false;
+
+	void countReceived() {}
+	void countTransmitted() {}
+	void countFramingError() { framingErrors = framingErrors + 1; }
+	void countParityError() { parityErrors = parityErrors + 1; }
+	void countOverflow() { overflows = overflows + 1; }
+	void countDropped() { dropped = dropped + 1; }
+	void recordRxDepth(size_t) {}
+	uint32_t interruptEntry() { return 0; }
+	void interruptExit(uint32_t) {}
+};
+
+/**
+ * Error counters plus throughput, interrupt load and the wakeup latency of sleepUntilReceive().
+ * SysTick must be running, the wakeup latency additionally requires util::countSysTick() in SysTick_Handler
+ */
+struct UartStatistics : UartErrorCounters {
+	/// sleepUntilReceive() enables the start-of-frame interrupt to timestamp the wakeup
+	static constexpr bool MeasuresWakeup = true;
+
+	volatile uint32_t rxBytes = 0;
+	volatile uint32_t txBytes = 0;
+	/// Highest fill level of the receive buffer
+	volatile uint32_t maxRxDepth = 0;
+	/// Cycles spent in BufferedUART::interrupt, measured with SysTick
+	volatile uint32_t isrCycles = 0;
+	/// Number of wakeups from sleepUntilReceive() caused by a start bit
+	volatile uint32_t wakeups = 0;
+	/// SysTick cycles from the start-of-frame interrupt to the first received byte of the last wakeup
+	volatile uint32_t lastWakeupLatency = 0;
+	volatile uint32_t maxWakeupLatency = 0;
+	uint32_t wakeupTimestamp = 0;
+	bool wakeupPending = false;
+
+	void countReceived() { rxBytes = rxBytes + 1; }
+	void countTransmitted() { txBytes = txBytes + 1; }
+	void recordRxDepth(size_t depth)
+	{
+		if (depth > maxRxDepth)
+			maxRxDepth = depth;
+	}
+	uint32_t interruptEntry() { return util::sysTickNow(); }
+	void interruptExit(uint32_t entry) { isrCycles = isrCycles + util::sysTickElapsed(entry, util::sysTickNow()); }
+	void startOfFrame()
+	{
+		wakeupTimestamp = util::sysTickTimestamp();
+		wakeupPending = true;
+	}
+	void recordWakeup()
+	{
+		if (!wakeupPending)
+			return;
+		wakeupPending = false;
+		const uint32_t latency = util::sysTickTimestamp() - wakeupTimestamp;
+		wakeups = wakeups + 1;
+		lastWakeupLatency = latency;
+		if (latency > maxWakeupLatency)
+			maxWakeupLatency = latency;
+	}
+};
+
+/// Disables all statistics, the interrupt handlers contain no counting code and no start-of-frame handling
+struct NoUartStatistics {
+	static constexpr bool MeasuresWakeup = false;
+
+	void countReceived() {}
+	void countTransmitted() {}
+	void countFramingError() {}
+	void countParityError() {}
+	void countOverflow() {}
+	void countDropped() {}
+	void recordRxDepth(size_t) {}
+	uint32_t interruptEntry() { return 0; }
+	void interruptExit(uint32_t) {}
+};
+
+/**
+ * @brief UART with interrupt driven transmit and receive buffers
+ *
+ * write() copies the data into a ring buffer and returns immediately,
+ * the buffer is drained from the DRE interrupt.
+ * If \p RxSize is not 0, received bytes are pushed into a lock-free ring buffer
+ * and can be accessed without copying through peek() and consume().
+ * Call BufferedUART::interrupt in the SERCOMx interrupt Handler.
+ *
+ * @tparam TxSize Size of the transmit buffer in bytes. Must be a power of two
+ * @tparam RxSize Size of the receive buffer in bytes. Must be a power of two or 0 to use a receive callback
+ * @tparam Statistics UartErrorCounters, UartStatistics or NoUartStatistics
+ */
+template <size_t TxSize, size_t RxSize = 0, typename Statistics = UartErrorCounters>
+class BufferedUART : public UART {
+public:
+	BufferedUART(Sercom* port, const ClockGenerator& clkGen, unsigned baudRate, uint32_t pinLayout) noexcept
+		:UART(port, clkGen, baudRate, pinLayout)
+	{
+		auto irq = static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + util::getSercomIndex(port));
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+	}
+
+	/// @see UART::UART(Sercom*, const ClockGenerator&, Config)
+	template <typename Config>
+	BufferedUART(Sercom* port, const ClockGenerator& clkGen, Config config) noexcept
+		:UART(port, clkGen, config)
+	{
+		auto irq = static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + util::getSercomIndex(port));
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+	}
+
+	/// @see UART::UART(SercomUsart&)
+	explicit BufferedUART(SercomUsart& usart) noexcept
+		:UART(usart)
+	{}
+
+	/**
+	 * Queues \p data for transmission without blocking
+	 * @return Number of bytes accepted. Less than data.size() if the buffer is full
+	 */
+	size_t write(gsl::span<const std::byte> data) noexcept
+	{
+		size_t accepted = txBuffer.write(data);
+		if (accepted != 0) {
+			txStarted = true;
+			sercom.INTENSET.reg = SERCOM_USART_INTENSET_DRE;
+		}
+		return accepted;
+	}
+
+	/// Queues all of \p data, blocking while the transmit buffer is full
+	void writeAll(gsl::span<const std::byte> data) noexcept
+	{
+		while (!data.empty())
+			data = data.subspan(write(data));
+	}
+
+	/// @return Free space in the transmit buffer
+	size_t writable() const noexcept { return txBuffer.capacity() - txBuffer.size(); }
+
+	/// @return true if the buffer is empty and the last byte left the shift register (TXC)
+	bool isFlushed() const noexcept
+	{
+		return txBuffer.empty() && (!txStarted || sercom.INTFLAG.bit.TXC);
+	}
+
+	/// Blocks until isFlushed()
+	void flush() const noexcept
+	{
+		while (!isFlushed());
+	}
+
+	/// @return Number of bytes in the receive buffer
+	size_t available() const noexcept
+	{
+		static_assert(RxSize != 0, "Receive buffer disabled");
+		return rxBuffer.size();
+	}
+
+	/**
+	 * Zero-copy access to received data. Call consume() when done.
+	 * @return The largest contiguous block of received bytes. May be less than available() when the buffer wraps around
+	 */
+	gsl::span<const std::byte> peek() const noexcept
+	{
+		static_assert(RxSize != 0, "Receive buffer disabled");
+		return rxBuffer.readable();
+	}
+
+	/// Removes \p count bytes previously returned by peek()
+	void consume(size_t count) noexcept
+	{
+		static_assert(RxSize != 0, "Receive buffer disabled");
+		rxBuffer.consume(count);
+	}
+
+	/**
+	 * Copies received bytes into \p dst without blocking
+	 * @return Number of bytes read
+	 */
+	size_t read(gsl::span<std::byte> dst) noexcept
+	{
+		static_assert(RxSize != 0, "Receive buffer disabled");
+		return rxBuffer.read(dst);
+	}
+
+	const Statistics& statistics() const noexcept { return stats; }
+
+	/**
+	 * Keeps the receiver running in STANDBY sleep mode and enables start-of-frame detection,
+	 * so a start bit wakes the device without losing the first byte.
+	 * The ClockGenerator of this UART must run in standby or use an on demand source,
+	 * see ClockGenerator and Internal8MegOscillator.
+	 */
+	void enableStandbyReception() noexcept
+	{
+		static_assert(RxSize != 0, "Standby reception requires a receive buffer");
+		// RUNSTDBY and SFDE are enable protected
+		sercom.CTRLA.bit.ENABLE = 0;
+		while (sercom.STATUS.bit.SYNCBUSY);
+		sercom.CTRLA.reg |= SERCOM_USART_CTRLA_RUNSTDBY;
+		sercom.CTRLB.reg |= SERCOM_USART_CTRLB_SFDE;
+		while (sercom.STATUS.bit.SYNCBUSY);
+		sercom.CTRLA.bit.ENABLE = 1;
+	}
+
+	/**
+	 * Enters STANDBY sleep mode if the receive buffer is empty and returns on the next interrupt,
+	 * typically the receive complete interrupt of the next byte.
+	 * Requires enableStandbyReception(). With UartStatistics the start-of-frame interrupt wakes the device instead
+	 * and the time until the byte is received is recorded.
+	 */
+	void sleepUntilReceive() noexcept
+	{
+		static_assert(RxSize != 0, "Standby reception requires a receive buffer");
+		if constexpr (Statistics::MeasuresWakeup) {
+			sercom.INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+			sercom.INTENSET.reg = SERCOM_USART_INTENSET_RXS;
+		}
+		// A pending interrupt still ends WFI while interrupts are masked, so nothing can slip in between the check and the sleep
+		__disable_irq();
+		if (rxBuffer.empty())
+			power::standby();
+		__enable_irq();
+	}
+
+	/// Call in the Sercom Interrupt handler if a receive buffer is used
+	void interrupt() noexcept
+	{
+		static_assert(RxSize != 0, "Receive buffer disabled, use interrupt(receiveCallback)");
+		const uint32_t entry = stats.interruptEntry();
+		receiveInterrupt();
+		transmitInterrupt();
+		stats.interruptExit(entry);
+	}
+
+	/**
+	 * Call in the Sercom Interrupt handler. Bytes with framing or parity errors are counted and not passed on
+	 * @param receiveCallback Callable that gets called on each received byte. Signature: void receiveCallback(std::byte data)
+	 */
+	template <typename Fun>
+	void interrupt(Fun receiveCallback)
+	{
+		const uint32_t entry = stats.interruptEntry();
+		std::byte data;
+		if (sercom.INTFLAG.bit.RXC && readReceived(data)) {
+			stats.countReceived();
+			receiveCallback(data);
+		}
+		transmitInterrupt();
+		stats.interruptExit(entry);
+	}
+
+protected:
+	void receiveInterrupt() noexcept
+	{
+		if constexpr (Statistics::MeasuresWakeup) {
+			if ((sercom.INTENSET.reg & SERCOM_USART_INTENSET_RXS) && sercom.INTFLAG.bit.RXS) {
+				// Only needed for the wakeup, every further start bit would cost an interrupt
+				sercom.INTENCLR.reg = SERCOM_USART_INTENCLR_RXS;
+				sercom.INTFLAG.reg = SERCOM_USART_INTFLAG_RXS;
+				stats.startOfFrame();
+			}
+		}
+		if (!sercom.INTFLAG.bit.RXC)
+			return;
+		if constexpr (Statistics::MeasuresWakeup)
+			stats.recordWakeup();
+
+		std::byte data;
+		if (!readReceived(data))
+			return;
+		stats.countReceived();
+		if (rxBuffer.push(data))
+			stats.recordRxDepth(rxBuffer.size());
+		else
+			stats.countDropped();
+	}
+
+	/**
+	 * Reads the received byte together with its error flags and clears them
+	 * @return false if the byte has a framing or parity error and must be discarded
+	 */
+	bool readReceived(std::byte& data) noexcept
+	{
+		const uint16_t status = sercom.STATUS.reg;
+		data = static_cast<std::byte>(sercom.DATA.reg);
+		if (status & (SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_BUFOVF)) {
+			sercom.STATUS.reg = status & (SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_BUFOVF);
+			if (status & SERCOM_USART_STATUS_BUFOVF)
+				stats.countOverflow();
+			if (status & SERCOM_USART_STATUS_FERR) {
+				stats.countFramingError();
+				return false;
+			}
+			if (status & SERCOM_USART_STATUS_PERR) {
+				stats.countParityError();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void transmitInterrupt() noexcept
+	{
+		if (!(sercom.INTENSET.reg & SERCOM_USART_INTENSET_DRE) || !sercom.INTFLAG.bit.DRE)
+			return;
+
+		std::byte data;
+		if (txBuffer.pop(data)) {
+			sercom.DATA.reg = std::to_integer<uint8_t>(data);
+			stats.countTransmitted();
+		} else {
+			sercom.INTENCLR.reg = SERCOM_USART_INTENCLR_DRE;
+			// write() may have queued data between the pop and disabling the interrupt
+			if (!txBuffer.empty())
+				sercom.INTENSET.reg = SERCOM_USART_INTENSET_DRE;
+		}
+	}
+
+	struct NoBuffer {};
+
+	RingBuffer<std::byte, TxSize> txBuffer;
+	std::conditional_t<RxSize != 0, RingBuffer<std::byte, RxSize>, NoBuffer> rxBuffer;
+	Statistics stats;
+	bool txStarted = false;
+};
+
+} // namespace mcu
@@ -20,14 +20,16 @@ public:
 	 * @param source Clock to use as input for this generator
 	 * @param div Division factor for the clock
 	 * @param divToPow2 if true than the real division factor is 2 ^ (\p div + 1)
+	 * @param runInStandby if true the generator keeps running in STANDBY sleep mode
 	 */
-	ClockGenerator(uint8_t id, const ClockSource& source, uint16_t div = 1, bool divToPow2 = false)
+	ClockGenerator(uint8_t id, const ClockSource& source, uint16_t div = 1, bool divToPow2 = false, bool runInStandby = false)
 		: id{id}, frequency{source.frequency() / (divToPow2 ? 1 << (div + 1) : div)}
 	{
 		GCLK->GENDIV.reg = GCLK_GENDIV_ID(id) | GCLK_GENDIV_DIV(div);
 		GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(id)
 			| GCLK_GENCTRL_SRC(source.id())
 			| (divToPow2 << GCLK_GENCTRL_DIVSEL_Pos)
+			| (runInStandby << GCLK_GENCTRL_RUNSTDBY_Pos)
 			| GCLK_GENCTRL_GENEN;
 		while (GCLK->STATUS.bit.SYNCBUSY);
 	}
@@ -62,12 +64,15 @@ class Internal8MegOscillator final : public ClockSource {
 public:
 	/**
 	 * @param prescaler Prescaler value 0 - 3. Frequency is divided by 2 ^ \p prescaler
+	 * @param onDemandInStandby if true the oscillator is started in STANDBY sleep mode when a peripheral requests it,
+	 *                          e.g. a UART detecting a start bit
 	 */
-	explicit Internal8MegOscillator(uint8_t prescaler = 0)
+	explicit Internal8MegOscillator(uint8_t prescaler = 0, bool onDemandInStandby = false)
 		: prescaler{prescaler}
 	{
 		const uint32_t calib = SYSCTRL->OSC8M.reg & (SYSCTRL_OSC8M_CALIB_Msk | SYSCTRL_OSC8M_FRANGE_Msk);
-		SYSCTRL->OSC8M.reg = calib | SYSCTRL_OSC8M_PRESC(prescaler) | SYSCTRL_OSC8M_ENABLE;
+		SYSCTRL->OSC8M.reg = calib | SYSCTRL_OSC8M_PRESC(prescaler) | SYSCTRL_OSC8M_ENABLE
+			| (onDemandInStandby ? SYSCTRL_OSC8M_RUNSTDBY | SYSCTRL_OSC8M_ONDEMAND : 0);
 		while (!SYSCTRL->PCLKSR.bit.OSC8MRDY);
 	}
 
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <gsl/span>
+
+/**
+ * Formats into \p sink with a format string that is checked at compile time.
+ * Placeholders: {} decimal, {:x} lower case hex, {:X} upper case hex, {:08x}/{:5} with padding.
+ * Use mcu::fixed() for fixed-point values. {{ and }} print literal braces.
+ *
+ * Usage: MCU_FORMAT(uart, "t={} raw={:04x}\n", mcu::fixed(temp, 2), raw);
+ */
+#define MCU_FORMAT(sink, format, ...) \
+	::mcu::formatTo((sink), []() constexpr { return format; }, ##__VA_ARGS__)
+
+namespace mcu {
+
+/// Fixed-point value: \p value is printed with \p decimals digits after the decimal point
+struct Fixed {
+	int32_t value;
+	uint8_t decimals;
+};
+
+/// fixed(1234, 2) prints 12.34
+constexpr Fixed fixed(int32_t value, uint8_t decimals) { return Fixed{value, decimals}; }
+
+/**
+ * Sink writing into a RAM buffer. Output that does not fit is discarded
+ */
+class BufferSink {
+public:
+	explicit BufferSink(gsl::span<char> buffer) noexcept : buffer{buffer} {}
+
+	void put(char c) noexcept
+	{
+		if (length < static_cast<size_t>(buffer.size()))
+			buffer[length++] = c;
+	}
+
+	gsl::span<const char> text() const noexcept { return buffer.first(length); }
+	size_t size() const noexcept { return length; }
+	void clear() noexcept { length = 0; }
+
+private:
+	gsl::span<char> buffer;
+	size_t length = 0;
+};
+
+namespace format {
+
+template <unsigned N> struct Priority : Priority<N - 1> {};
+template <> struct Priority<0> {};
+
+template <typename Sink>
+auto put(Sink& sink, char c, Priority<3>) -> decltype(sink.put(c), void()) { sink.put(c); }
+
+/// BufferedUART: keeps the order with other buffered writes
+template <typename Sink>
+auto put(Sink& sink, char c, Priority<2>) -> decltype(sink.writeAll(gsl::span<const std::byte>()), void())
+{
+	const std::byte data = static_cast<std::byte>(c);
+	sink.writeAll(gsl::span<const std::byte>(&data, 1));
+}
+
+/// UART
+template <typename Sink>
+auto put(Sink& sink, char c, Priority<1>) -> decltype(sink.transmit(std::byte{}), void()) { sink.transmit(static_cast<std::byte>(c)); }
+
+/// SPI
+template <typename Sink>
+auto put(Sink& sink, char c, Priority<0>) -> decltype(sink.transfer(uint8_t{}), void()) { sink.transfer(static_cast<uint8_t>(c)); }
+
+template <typename Sink>
+void put(Sink& sink, char c) { put(sink, c, Priority<3>{}); }
+
+struct Spec {
+	char type = 'd';
+	char fill = ' ';
+	uint8_t width = 0;
+	bool valid = true;
+};
+
+/// Parses the placeholder starting behind '{' and advances \p format behind the closing '}'
+constexpr Spec parseSpec(const char*& format)
+{
+	Spec spec;
+	if (*format == ':') {
+		format++;
+		if (*format == '0') {
+			spec.fill = '0';
+			format++;
+		}
+		while (*format >= '0' && *format <= '9')
+			spec.width = spec.width * 10 + (*format++ - '0');
+		if (*format == 'x' || *format == 'X' || *format == 'd')
+			spec.type = *format++;
+	}
+	if (*format != '}')
+		spec.valid = false;
+	else
+		format++;
+	return spec;
+}
+
+/// @return Number of placeholders or -1 if \p format is malformed
+constexpr int countPlaceholders(const char* format)
+{
+	int count = 0;
+	while (*format != '\0') {
+		const char c = *format++;
+		if (c == '{') {
+			if (*format == '{') {
+				format++;
+				continue;
+			}
+			if (!parseSpec(format).valid)
+				return -1;
+			count++;
+		} else if (c == '}') {
+			if (*format != '}')
+				return -1;
+			format++;
+		}
+	}
+	return count;
+}
+
+/// Literal text or a placeholder of a parsed format string
+struct Segment {
+	/// Position of the literal text in the format string
+	uint16_t offset = 0;
+	uint16_t length = 0;
+	/// Index of the argument, -1 for literal text
+	int8_t argument = -1;
+	Spec spec;
+};
+
+/// Splits the literal run or placeholder at \p it off a valid \p format. An escaped brace ends a run
+constexpr Segment nextSegment(const char* format, const char*& it, int8_t& argument)
+{
+	Segment segment;
+	segment.offset = static_cast<uint16_t>(it - format);
+	if (*it == '{' && it[1] != '{') {
+		it++;
+		segment.spec = parseSpec(it);
+		segment.argument = argument++;
+		return segment;
+	}
+	while (*it != '\0' && !(*it == '{' && it[1] != '{')) {
+		const char c = *it++;
+		segment.length++;
+		// Only the first of the doubled braces is printed
+		if (c == '{' || c == '}') {
+			it++;
+			break;
+		}
+	}
+	return segment;
+}
+
+constexpr size_t countSegments(const char* format)
+{
+	size_t count = 0;
+	int8_t argument = 0;
+	for (const char* it = format; *it != '\0'; count++)
+		nextSegment(format, it, argument);
+	return count;
+}
+
+/// Parses a valid \p format into its segments, done at compile time by formatTo()
+template <size_t Count>
+constexpr std::array<Segment, Count> parseSegments(const char* format)
+{
+	std::array<Segment, Count> segments = {};
+	int8_t argument = 0;
+	const char* it = format;
+	for (size_t i = 0; i < Count; i++)
+		segments[i] = nextSegment(format, it, argument);
+	return segments;
+}
+
+/**
+ * Divides by 10 with shifts and adds only, the M0+ has no divider
+ * @param[out] remainder n % 10
+ */
+inline uint32_t divideBy10(uint32_t n, uint32_t& remainder)
+{
+	uint32_t q = (n >> 1) + (n >> 2);
+	q += q >> 4;
+	q += q >> 8;
+	q += q >> 16;
+	q >>= 3;
+	uint32_t r = n - q * 10;
+	if (r > 9) {
+		q++;
+		r -= 10;
+	}
+	remainder = r;
+	return q;
+}
+
+template <typename Sink>
+void pad(Sink& sink, char fill, unsigned count)
+{
+	while (count-- > 0)
+		put(sink, fill);
+}
+
+template <typename Sink>
+void writeUnsigned(Sink& sink, uint32_t value, const Spec& spec, bool negative = false)
+{
+	char digits[10];
+	unsigned count = 0;
+	if (spec.type == 'd') {
+		do {
+			uint32_t remainder;
+			value = divideBy10(value, remainder);
+			digits[count++] = '0' + remainder;
+		} while (value != 0);
+	} else {
+		const char* hexDigits = spec.type == 'X' ? "0123456789ABCDEF" : "0123456789abcdef";
+		do {
+			digits[count++] = hexDigits[value & 0xf];
+			value >>= 4;
+		} while (value != 0);
+	}
+
+	const unsigned length = count + negative;
+	if (spec.fill == '0' && negative)
+		put(sink, '-');
+	if (spec.width > length)
+		pad(sink, spec.fill, spec.width - length);
+	if (spec.fill != '0' && negative)
+		put(sink, '-');
+	while (count > 0)
+		put(sink, digits[--count]);
+}
+
+template <typename Sink, typename T>
+void writeArgument(Sink& sink, const T& value, const Spec& spec)
+{
+	if constexpr (std::is_same_v<T, Fixed>) {
+		const bool negative = value.value < 0;
+		const uint32_t magnitude = negative ? -static_cast<uint32_t>(value.value) : value.value;
+		// Digits are generated together and the point inserted afterwards, so only one division chain is needed
+		char digits[16];
+		unsigned count = 0;
+		uint32_t rest = magnitude;
+		do {
+			uint32_t remainder;
+			rest = divideBy10(rest, remainder);
+			digits[count++] = '0' + remainder;
+		} while ((rest != 0 || count <= value.decimals) && count < sizeof(digits));
+
+		const unsigned length = count + (value.decimals != 0) + negative;
+		if (spec.width > length && spec.fill != '0')
+			pad(sink, ' ', spec.width - length);
+		if (negative)
+			put(sink, '-');
+		if (spec.width > length && spec.fill == '0')
+			pad(sink, '0', spec.width - length);
+		while (count > 0) {
+			if (count == value.decimals)
+				put(sink, '.');
+			put(sink, digits[--count]);
+		}
+	} else if constexpr (std::is_same_v<T, const char*> || std::is_same_v<T, char*>) {
+		for (const char* c = value; *c != '\0'; c++)
+			put(sink, *c);
+	} else if constexpr (std::is_same_v<T, char>) {
+		put(sink, value);
+	} else if constexpr (std::is_same_v<T, bool>) {
+		writeArgument(sink, value ? "true" : "false", spec);
+	} else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+		static_assert(sizeof(T) <= 4, "64-bit values are not supported");
+		if constexpr (std::is_signed_v<T>) {
+			if (value < 0 && spec.type == 'd') {
+				writeUnsigned(sink, -static_cast<uint32_t>(value), spec, true);
+				return;
+			}
+		}
+		writeUnsigned(sink, static_cast<uint32_t>(value), spec);
+	} else {
+		static_assert(std::is_integral_v<T>, "Unsupported argument type");
+	}
+}
+
+template <typename Sink, typename T>
+void writeNth(Sink& sink, unsigned index, const Spec& spec, unsigned& current, const T& value)
+{
+	if (current++ == index)
+		writeArgument(sink, value, spec);
+}
+
+} // namespace format
+
+/**
+ * Called by MCU_FORMAT. \p formatString returns the format string, it is validated and split into literal runs
+ * and placeholders at compile time, so only the output is generated at run time. Never allocates.
+ * @param sink BufferSink or anything with put(char), writeAll(span) like BufferedUART, transmit(std::byte) like UART
+ *             or transfer(uint8_t) like SPI
+ */
+template <typename Sink, typename Format, typename... Args>
+void formatTo(Sink& sink, Format formatString, const Args&... args)
+{
+	static_assert(format::countPlaceholders(formatString()) >= 0, "Malformed format string");
+	static_assert(format::countPlaceholders(formatString()) == sizeof...(Args), "Number of arguments does not match the format string");
+
+	static constexpr auto segments = format::parseSegments<format::countSegments(formatString())>(formatString());
+	const char* text = formatString();
+	for (const format::Segment& segment : segments) {
+		if (segment.argument < 0) {
+			for (unsigned i = 0; i < segment.length; i++)
+				format::put(sink, text[segment.offset + i]);
+		} else {
+			[[maybe_unused]] unsigned current = 0;
+			(format::writeNth(sink, segment.argument, segment.spec, current, std::decay_t<decltype(args)>(args)), ...);
+		}
+	}
+}
+
+} // namespace mcu
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <gsl/span>
+
+namespace mcu {
+
+namespace detail {
+
+/**
+ * Two frame buffers: the interrupt fills one while the application owns the other.
+ * A completed frame is published by storing its size, the application hands it back with release().
+ */
+template <size_t MaxFrameSize>
+class DoubleFrameBuffer {
+public:
+	/**
+	 * @return The last completed frame or std::nullopt if there is none.
+	 *         The frame stays valid until release() is called
+	 */
+	std::optional<gsl::span<const std::byte>> frame() const noexcept
+	{
+		const size_t size = readySize.load(std::memory_order_acquire);
+		if (size == 0)
+			return std::nullopt;
+		return gsl::span<const std::byte>(buffers[fillIndex ^ 1].data(), size);
+	}
+
+	/// Returns the frame obtained by frame() to the decoder
+	void release() noexcept { readySize.store(0, std::memory_order_release); }
+
+	/// Frames discarded because the application still held the previous one
+	uint32_t droppedFrames() const noexcept { return dropped; }
+	/// Frames discarded because they were malformed or longer than MaxFrameSize
+	uint32_t invalidFrames() const noexcept { return invalid; }
+
+protected:
+	void append(std::byte data) noexcept
+	{
+		if (length < MaxFrameSize)
+			buffers[fillIndex][length++] = data;
+		else
+			error = true;
+	}
+
+	void endFrame() noexcept
+	{
+		if (error) {
+			invalid = invalid + 1;
+		} else if (length != 0) {
+			if (readySize.load(std::memory_order_acquire) != 0) {
+				dropped = dropped + 1;
+			} else {
+				fillIndex ^= 1;
+				readySize.store(length, std::memory_order_release);
+			}
+		}
+		length = 0;
+		error = false;
+	}
+
+	bool error = false;
+
+private:
+	std::array<std::array<std::byte, MaxFrameSize>, 2> buffers;
+	std::atomic<size_t> readySize{0};
+	uint8_t fillIndex = 0;
+	size_t length = 0;
+	volatile uint32_t dropped = 0;
+	volatile uint32_t invalid = 0;
+};
+
+} // namespace detail
+
+/**
+ * @brief Incremental COBS decoder
+ *
+ * Call push() for every received byte, e.g. from the UART receive callback.
+ * Frames are delimited by 0x00 and decoded in place into one of two frame buffers.
+ *
+ * @tparam MaxFrameSize Maximum size of a decoded frame
+ */
+template <size_t MaxFrameSize>
+class CobsDecoder : public detail::DoubleFrameBuffer<MaxFrameSize> {
+public:
+	void push(std::byte data) noexcept
+	{
+		if (data == std::byte{0}) {
+			if (remaining != 0)
+				this->error = true;
+			this->endFrame();
+			code = 0xff;
+			remaining = 0;
+			firstBlock = true;
+			return;
+		}
+
+		if (remaining == 0) {
+			// Every block except the first one implies a zero, unless the previous block was full
+			if (!firstBlock && code != 0xff)
+				this->append(std::byte{0});
+			firstBlock = false;
+			code = std::to_integer<uint8_t>(data);
+			remaining = code - 1;
+		} else {
+			this->append(data);
+			remaining--;
+		}
+	}
+
+private:
+	uint8_t code = 0xff;
+	uint8_t remaining = 0;
+	bool firstBlock = true;
+};
+
+/**
+ * @brief Incremental SLIP (RFC 1055) decoder
+ *
+ * Call push() for every received byte, e.g. from the UART receive callback.
+ *
+ * @tparam MaxFrameSize Maximum size of a decoded frame
+ */
+template <size_t MaxFrameSize>
+class SlipDecoder : public detail::DoubleFrameBuffer<MaxFrameSize> {
+public:
+	void push(std::byte data) noexcept
+	{
+		if (data == SlipEnd) {
+			if (escaped)
+				this->error = true;
+			this->endFrame();
+			escaped = false;
+		} else if (escaped) {
+			if (data == SlipEscEnd)
+				this->append(SlipEnd);
+			else if (data == SlipEscEsc)
+				this->append(SlipEsc);
+			else
+				this->error = true;
+			escaped = false;
+		} else if (data == SlipEsc) {
+			escaped = true;
+		} else {
+			this->append(data);
+		}
+	}
+
+	static constexpr std::byte SlipEnd{0xc0};
+	static constexpr std::byte SlipEsc{0xdb};
+	static constexpr std::byte SlipEscEnd{0xdc};
+	static constexpr std::byte SlipEscEsc{0xdd};
+
+private:
+	bool escaped = false;
+};
+
+/**
+ * COBS encodes \p data including the trailing 0x00 delimiter.
+ * Runs of payload are passed to \p sink directly from \p data, no encoded copy is built.
+ * @param sink Callable that must consume all bytes passed to it. Signature: void sink(gsl::span<const std::byte> data)
+ */
+template <typename Sink>
+void cobsEncode(gsl::span<const std::byte> data, Sink&& sink)
+{
+	const size_t size = static_cast<size_t>(data.size());
+	size_t start = 0;
+	do {
+		size_t end = start;
+		while (end < size && data[end] != std::byte{0} && end - start < 0xfe)
+			end++;
+
+		const std::byte code{static_cast<uint8_t>(end - start + 1)};
+		sink(gsl::span<const std::byte>(&code, 1));
+		if (end != start)
+			sink(data.subspan(start, end - start));
+
+		// Skip the zero that is implied by the code. A full block implies none
+		const bool impliedZero = end - start < 0xfe && end < size && data[end] == std::byte{0};
+		start = impliedZero ? end + 1 : end;
+		if (impliedZero && start == size) {
+			// Trailing zero: needs its own empty block
+			const std::byte one{1};
+			sink(gsl::span<const std::byte>(&one, 1));
+		}
+	} while (start < size);
+
+	const std::byte delimiter{0};
+	sink(gsl::span<const std::byte>(&delimiter, 1));
+}
+
+/**
+ * SLIP encodes \p data including the trailing END delimiter.
+ * Runs of payload are passed to \p sink directly from \p data, no encoded copy is built.
+ * @param sink Callable that must consume all bytes passed to it. Signature: void sink(gsl::span<const std::byte> data)
+ */
+template <typename Sink>
+void slipEncode(gsl::span<const std::byte> data, Sink&& sink)
+{
+	using Slip = SlipDecoder<1>;
+	static constexpr std::byte escapedEnd[] = {Slip::SlipEsc, Slip::SlipEscEnd};
+	static constexpr std::byte escapedEsc[] = {Slip::SlipEsc, Slip::SlipEscEsc};
+
+	const size_t size = static_cast<size_t>(data.size());
+	size_t start = 0;
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] != Slip::SlipEnd && data[i] != Slip::SlipEsc)
+			continue;
+		if (i != start)
+			sink(data.subspan(start, i - start));
+		sink(gsl::span<const std::byte>(data[i] == Slip::SlipEnd ? escapedEnd : escapedEsc, 2));
+		start = i + 1;
+	}
+	if (start != size)
+		sink(data.subspan(start, size - start));
+	sink(gsl::span<const std::byte>(&Slip::SlipEnd, 1));
+}
+
+} // namespace mcu
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "i2c_master.h"
+#include "ring_buffer.h"
+
+namespace mcu {
+
+enum class I2cStatus : uint8_t {
+	Ok,
+	AddressNack,
+	DataNack,
+	ArbitrationLost,
+	BusError
+};
+
+/**
+ * Write-then-read transfer for I2cAsyncMaster. Must stay valid until the callback was called.
+ * The read part follows the write part with a repeated start. Either part may be empty.
+ */
+struct I2cTransaction {
+	/// Right aligned (without Read/Write bit)
+	uint8_t address;
+	gsl::span<const std::byte> write = {};
+	gsl::span<std::byte> read = {};
+	/// Called from the interrupt when the transaction is finished. May enqueue further transactions
+	void (*callback)(I2cTransaction& transaction, I2cStatus status, void* context) = nullptr;
+	void* context = nullptr;
+	I2cStatus status = I2cStatus::Ok;
+};
+
+/**
+ * @brief Interrupt driven I2C master running a queue of transactions
+ *
+ * The blocking functions of I2cMaster must not be used while transactions are pending.
+ * MB/SB only interrupt while a transaction runs, so they may be used while the queue is idle.
+ * Call I2cAsyncMaster::interrupt in the SERCOMx interrupt Handler
+ *
+ * @tparam Depth Maximum number of pending transactions. Must be a power of two
+ */
+template <size_t Depth>
+class I2cAsyncMaster : public I2cMaster {
+public:
+	I2cAsyncMaster(Sercom* sercom, const mcu::ClockGenerator& clock, const mcu::ClockGenerator& slowClock, unsigned frequency = 100000)
+		: I2cMaster(sercom, clock, slowClock, frequency)
+	{
+		auto irq = static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + util::getSercomIndex(sercom));
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+	}
+
+	/**
+	 * Queues \p transaction. Starts it immediately if the bus is idle.
+	 * May be called from any context including the completion callback
+	 * @return false if the queue is full
+	 */
+	bool enqueue(I2cTransaction& transaction) noexcept
+	{
+		const uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		const bool queued = pendingQueue.push(&transaction);
+		if (queued && current == nullptr)
+			startNext();
+		__set_PRIMASK(primask);
+		return queued;
+	}
+
+	/// @return Number of queued transactions including the active one
+	size_t pending() const noexcept { return pendingQueue.size() + (current != nullptr); }
+	bool idle() const noexcept { return current == nullptr; }
+
+	/**
+	 * Call in the Sercom Interrupt handler
+	 */
+	void interrupt() noexcept
+	{
+		I2cTransaction* const transaction = current;
+		if (transaction == nullptr) {
+			// Stale flags, e.g. from blocking use of I2cMaster. MB/SB are only enabled while a transaction runs
+			port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
+			port.INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB;
+			return;
+		}
+
+		const uint8_t flags = port.INTFLAG.reg;
+		const uint16_t status = port.STATUS.reg;
+		if (status & SERCOM_I2CM_STATUS_BUSERR) {
+			// The bus state is unknown after a bus error
+			port.STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_BUSSTATE(BusstateIdle);
+			port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
+			complete(I2cStatus::BusError);
+		} else if (status & SERCOM_I2CM_STATUS_ARBLOST) {
+			// The bus belongs to the other master, no stop condition
+			port.STATUS.reg = SERCOM_I2CM_STATUS_ARBLOST;
+			port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
+			complete(I2cStatus::ArbitrationLost);
+		} else if (flags & SERCOM_I2CM_INTFLAG_MB) {
+			masterOnBus(*transaction, status);
+		} else if (flags & SERCOM_I2CM_INTFLAG_SB) {
+			slaveOnBus(*transaction);
+		}
+	}
+
+private:
+	enum class State : uint8_t {
+		WriteAddress,
+		Write,
+		ReadAddress,
+		Read
+	};
+
+	/// Write address or data byte sent, or read address not acknowledged
+	void masterOnBus(I2cTransaction& transaction, uint16_t status) noexcept
+	{
+		if (status & SERCOM_I2CM_STATUS_RXNACK) {
+			// A NACK of the last written byte is allowed
+			const bool lastByte = state == State::Write && index == static_cast<size_t>(transaction.write.size());
+			if (!lastByte) {
+				sendCommand(CommandStop);
+				complete(state == State::Write ? I2cStatus::DataNack : I2cStatus::AddressNack);
+				return;
+			}
+		}
+
+		if (index < static_cast<size_t>(transaction.write.size())) {
+			state = State::Write;
+			port.DATA.reg = static_cast<uint8_t>(transaction.write[index++]);
+		} else if (!transaction.read.empty()) {
+			// Repeated start
+			state = State::ReadAddress;
+			index = 0;
+			port.ADDR.reg = (transaction.address << 1) | 1;
+		} else {
+			sendCommand(CommandStop);
+			complete(I2cStatus::Ok);
+		}
+	}
+
+	/// Byte received
+	void slaveOnBus(I2cTransaction& transaction) noexcept
+	{
+		state = State::Read;
+		if (index + 1 < static_cast<size_t>(transaction.read.size())) {
+			// Smart mode: reading DATA sends ACK and starts the next byte
+			transaction.read[index++] = static_cast<std::byte>(port.DATA.reg);
+		} else {
+			port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN | SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(CommandStop);
+			while (port.STATUS.bit.SYNCBUSY);
+			transaction.read[index++] = static_cast<std::byte>(port.DATA.reg);
+			complete(I2cStatus::Ok);
+		}
+	}
+
+	/// Starts the next transaction. Interrupts must be disabled
+	void startNext() noexcept
+	{
+		I2cTransaction* next = nullptr;
+		if (!pendingQueue.pop(next)) {
+			// An idle bus must not interrupt, MB/SB may stay set after the STOP
+			current = nullptr;
+			port.INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB;
+			return;
+		}
+		current = next;
+		index = 0;
+		port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN;
+		while (port.STATUS.bit.SYNCBUSY);
+		if (next->write.empty() && !next->read.empty()) {
+			state = State::ReadAddress;
+			port.ADDR.reg = (next->address << 1) | 1;
+		} else {
+			state = State::WriteAddress;
+			port.ADDR.reg = (next->address << 1) | 0;
+		}
+		port.INTENSET.reg = SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB;
+	}
+
+	void complete(I2cStatus status) noexcept
+	{
+		const uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		I2cTransaction& transaction = *current;
+		transaction.status = status;
+		if (transaction.callback != nullptr)
+			transaction.callback(transaction, status, transaction.context);
+		startNext();
+		__set_PRIMASK(primask);
+	}
+
+	RingBuffer<I2cTransaction*, Depth> pendingQueue;
+	I2cTransaction* volatile current = nullptr;
+	State state = State::WriteAddress;
+	size_t index = 0;
+};
+
+} // namespace mcu
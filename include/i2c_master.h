@@ -1,102 +1,277 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <optional>
 #include <sam.h>
 #include <gsl/span>
 #include "clocks.h"
+#include "GPIO.h"
 #include "utils.h"
 
 namespace mcu {
 
+/// Pins of an I2cMaster, needed to recover a stuck bus
+struct I2cRecoveryPins {
+	GPIO sda;
+	GPIO scl;
+	/// Peripheral function of the Sercom on these pins. Best practice is to use one of the MUX_* Macros
+	unsigned function;
+};
+
+/// Presence of the 128 7-bit addresses on an I2C bus
+class I2cBusMap {
+public:
+	bool contains(uint8_t address) const { return (bits[(address >> 5) & 3] >> (address & 0x1f)) & 1; }
+	void set(uint8_t address, bool present)
+	{
+		const uint32_t mask = uint32_t{1} << (address & 0x1f);
+		if (present)
+			bits[(address >> 5) & 3] |= mask;
+		else
+			bits[(address >> 5) & 3] &= ~mask;
+	}
+	bool empty() const { return (bits[0] | bits[1] | bits[2] | bits[3]) == 0; }
+
+	/// One bit per address, address 0 is bit 0 of the first word
+	std::array<uint32_t, 4> bits = {};
+};
+
+template <unsigned ClockFrequency, unsigned Frequency, unsigned RiseTime>
+struct I2cConfig;
+
 class I2cMaster {
 public:
 	I2cMaster(Sercom* sercom, const mcu::ClockGenerator& clock, const mcu::ClockGenerator& slowClock, unsigned frequency = 100000)
-		:port{sercom->I2CM}
+		:port{sercom->I2CM}, recoveryHalfPeriod{clock.frequency / (2 * frequency)}
 	{
-		int sercomIndex = mcu::util::getSercomIndex(sercom);
-		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
-		clock.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
-		slowClock.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOMX_SLOW_Val);
+		init(sercom, clock, slowClock, computeBaud(frequency, clock.frequency));
+	}
 
-		port.CTRLA.reg = SERCOM_I2CM_CTRLA_MODE_I2C_MASTER;
-		(void)port.CTRLB.reg;
-		volatile uint32_t ctrla = port.CTRLA.reg;
-		port.CTRLB.reg = 0;
-		port.BAUD.reg = computeBaud(frequency, clock.frequency);
-		while (port.STATUS.bit.SYNCBUSY);
-		port.CTRLA.bit.ENABLE = true;
-		while (port.STATUS.bit.SYNCBUSY);
-		port.STATUS.bit.BUSSTATE = BusstateIdle;
+	/**
+	 * Uses BAUD/BAUDLOW planned at compile time
+	 * @param clock Must run at Config::clockFrequency
+	 * @param config An I2cConfig
+	 */
+	template <unsigned ClockFrequency, unsigned Frequency, unsigned RiseTime>
+	I2cMaster(
+		Sercom* sercom, const mcu::ClockGenerator& clock, const mcu::ClockGenerator& slowClock,
+		const I2cConfig<ClockFrequency, Frequency, RiseTime>& config
+	)
+		:port{sercom->I2CM}, recoveryHalfPeriod{ClockFrequency / (2 * I2cConfig<ClockFrequency, Frequency, RiseTime>::frequency)}
+	{
+		using Config = I2cConfig<ClockFrequency, Frequency, RiseTime>;
+		(void)config;
+		assert(clock.frequency == Config::clockFrequency);
+		init(sercom, clock, slowClock, Config::baud);
 	}
 
-	std::optional<std::byte> readReg(uint8_t slaveAddress, uint8_t reg)
+	/// Result of planBaud
+	struct BaudPlan {
+		/// BAUD register value, BAUDLOW in the upper byte
+		uint16_t baud;
+		/// The real SCL frequency
+		uint32_t frequency;
+		bool valid;
+	};
+
+	/**
+	 * Splits the SCL period into high and low time so the minimum times of the I2C specification are met
+	 * for standard mode (100kHz), fast mode (400kHz) and Fast-mode Plus (1MHz).
+	 * The SCL frequency never exceeds \p frequency.
+	 * @param clockFrequency Frequency of the Sercom ClockGenerator
+	 * @param frequency Desired SCL frequency
+	 * @param riseTime Measured SCL rise time in ns
+	 */
+	static constexpr BaudPlan planBaud(uint32_t clockFrequency, uint32_t frequency, uint32_t riseTime)
 	{
-		port.ADDR.reg = (slaveAddress << 1) | 0;
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & (StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK) != 0) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
-			return std::nullopt;
-		}
-		
-		port.DATA.reg = reg;
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & StatusErrorMask) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
-			return std::nullopt;
-		}
+		if (frequency == 0 || frequency > 1000000)
+			return BaudPlan{0, 0, false};
+		// Minimum SCL low and high time in ns
+		const uint32_t lowMin = frequency <= 100000 ? 4700 : frequency <= 400000 ? 1300 : 500;
+		const uint32_t highMin = frequency <= 100000 ? 4000 : frequency <= 400000 ? 600 : 260;
 
-		port.ADDR.reg = (slaveAddress << 1) | 1;
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & (StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK) != 0) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
-			return std::nullopt;
-		}
+		// fSCL = fGCLK / (10 + BAUD + BAUDLOW + fGCLK * Trise), rounded so fSCL does not exceed the target
+		const uint64_t riseCycles = (uint64_t{clockFrequency} * riseTime + 999999999) / 1000000000;
+		const uint64_t periodCycles = (uint64_t{clockFrequency} + frequency - 1) / frequency;
+		if (periodCycles < 10 + riseCycles + 2)
+			return BaudPlan{0, 0, false};
+		const uint64_t sum = periodCycles - 10 - riseCycles;
+
+		// SCL high lasts BAUD + 5 cycles, low lasts BAUDLOW + 5 cycles. The rise time only lengthens the period
+		const uint64_t lowCycles = (uint64_t{clockFrequency} * lowMin + 999999999) / 1000000000;
+		const uint64_t highCycles = (uint64_t{clockFrequency} * highMin + 999999999) / 1000000000;
+		const uint64_t baudLowMin = lowCycles > 6 ? lowCycles - 5 : 1;
+		const uint64_t baudHighMin = highCycles > 6 ? highCycles - 5 : 1;
+		if (baudLowMin + baudHighMin > sum)
+			return BaudPlan{0, 0, false};
+
+		// The remaining cycles are shared equally
+		const uint64_t extra = sum - baudLowMin - baudHighMin;
+		uint64_t baudLow = baudLowMin + extra / 2;
+		uint64_t baudHigh = baudHighMin + extra / 2;
+		if (baudLow + baudHigh < sum)
+			baudLow++;
+		if (baudHigh > 0xff || baudLow > 0xff)
+			return BaudPlan{0, 0, false};
 
-		std::byte result = static_cast<std::byte>(port.DATA.reg);
-		port.CTRLB.reg = SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(CommandStop);
+		const uint32_t realFrequency = clockFrequency / (10 + baudHigh + baudLow + riseCycles);
+		// BAUDLOW = 0 uses BAUD for both halves
+		const uint16_t baud = baudLow == baudHigh ? baudHigh : baudHigh | (baudLow << 8);
+		return BaudPlan{baud, realFrequency, true};
+	}
+
+	/**
+	 * Changes the SCL frequency between transactions
+	 * @param baud BAUD register value, BAUDLOW in the upper byte
+	 */
+	void setBaud(uint16_t baud)
+	{
+		const uint32_t high = baud & 0xff;
+		const uint32_t low = (baud >> 8) != 0 ? baud >> 8 : high;
+		writeBaud(baud, (10 + high + low) / 2);
+	}
+
+	/**
+	 * Changes the SCL frequency between transactions to a plan of I2cConfig
+	 * @param config Must be planned for the frequency of the ClockGenerator
+	 */
+	template <unsigned ClockFrequency, unsigned Frequency, unsigned RiseTime>
+	void setBaud(const I2cConfig<ClockFrequency, Frequency, RiseTime>& config)
+	{
+		(void)config;
+		using Config = I2cConfig<ClockFrequency, Frequency, RiseTime>;
+		writeBaud(Config::baud, Config::clockFrequency / (2 * Config::frequency));
+	}
+
+	std::optional<std::byte> readReg(uint8_t slaveAddress, uint8_t reg)
+	{
+		std::byte result;
+		if (!readRegs(slaveAddress, reg, gsl::span<std::byte>(&result, 1)))
+			return std::nullopt;
 		return result;
 	}
 
 	bool writeReg(uint8_t slaveAddress, uint8_t reg, std::byte data)
 	{
-		port.ADDR.reg = (slaveAddress << 1) | 0;
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & (StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK) != 0) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
+		return writeRegs(slaveAddress, reg, gsl::span<const std::byte>(&data, 1));
+	}
+
+	/**
+	 * Reads consecutive registers starting at \p reg in one transaction with a repeated start.
+	 * Every byte but the last is acknowledged automatically by smart mode.
+	 * n registers take 29 + 9 * n SCL periods instead of 38 * n with readReg, e.g. 2.8x less bus time for 6 registers
+	 */
+	bool readRegs(uint8_t slaveAddress, uint8_t reg, gsl::span<std::byte> data)
+	{
+		if (!startWrite(slaveAddress, reg))
 			return false;
+		if (data.empty()) {
+			sendCommand(CommandStop);
+			return true;
 		}
-		
-		port.DATA.reg = reg;
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & (StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK) != 0) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
+
+		port.ADDR.reg = (slaveAddress << 1) | 1;
+		if (!waitForBus(StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK))
 			return false;
+
+		const size_t last = data.size() - 1;
+		for (size_t i = 0; i < last; i++) {
+			// Reading DATA sends ACK and starts the next byte
+			data[i] = static_cast<std::byte>(port.DATA.reg);
+			if (!waitForBus(StatusErrorMask))
+				return false;
 		}
+		port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN | SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(CommandStop);
+		while (port.STATUS.bit.SYNCBUSY);
+		data[last] = static_cast<std::byte>(port.DATA.reg);
+		return true;
+	}
 
-		port.DATA.reg = static_cast<uint8_t>(data);
-		while (port.INTFLAG.reg == 0);
-		port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
-		if (port.STATUS.reg & (StatusErrorMask) != 0) {
-			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
-				port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
+	/**
+	 * Writes consecutive registers starting at \p reg in one transaction
+	 */
+	bool writeRegs(uint8_t slaveAddress, uint8_t reg, gsl::span<const std::byte> data)
+	{
+		if (!startWrite(slaveAddress, reg))
 			return false;
+
+		const size_t size = data.size();
+		for (size_t i = 0; i < size; i++) {
+			port.DATA.reg = static_cast<uint8_t>(data[i]);
+			// The slave may NACK the last byte
+			if (!waitForBus(StatusErrorMask | (i + 1 < size ? SERCOM_I2CM_STATUS_RXNACK : 0)))
+				return false;
 		}
-		
-		port.CTRLB.reg = SERCOM_I2CM_CTRLB_CMD(CommandStop);
+		sendCommand(CommandStop);
 		return true;
 	}
 
-private:
+	/**
+	 * Bounds the duration of every call. Without it a wedged bus blocks forever.
+	 * SCL held low for 25-35ms is detected in hardware (LOWTOUT), a bus without activity is considered idle after
+	 * \p inactiveTimeout. Every wait for a byte gives up after \p pollLimit polls of INTFLAG.
+	 * On a timeout or bus error the bus is recovered: 9 SCL pulses are clocked out through GPIO followed by a STOP,
+	 * then the Sercom is re-enabled.
+	 *
+	 * Worst case duration of a call with n bytes: (n + 3) * pollLimit polls plus one recovery of about 10 SCL periods.
+	 *
+	 * @param pins SDA and SCL, used by the recovery
+	 * @param pollLimit Maximum number of INTFLAG polls per byte, an iteration count and not a time.
+	 *                  A poll takes a few CPU cycles plus the wait for the bus bridge, so the time it bounds depends
+	 *                  on the CPU clock. Must be larger than a byte time plus the longest clock stretching of the slaves
+	 * @param inactiveTimeout 0: disabled, 1: 5-6 SCL cycles, 2: 10-11 SCL cycles, 3: 20-21 SCL cycles
+	 */
+	void enableTimeouts(const I2cRecoveryPins& pins, uint32_t pollLimit = 100000, unsigned inactiveTimeout = 2)
+	{
+		recoveryPins.emplace(pins);
+		this->pollLimit = pollLimit;
+		port.CTRLA.bit.ENABLE = false;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.CTRLA.reg = (port.CTRLA.reg & ~SERCOM_I2CM_CTRLA_INACTOUT_Msk)
+			| SERCOM_I2CM_CTRLA_INACTOUT(inactiveTimeout)
+			| SERCOM_I2CM_CTRLA_LOWTOUT;
+		port.CTRLA.bit.ENABLE = true;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.STATUS.bit.BUSSTATE = BusstateIdle;
+	}
+
+	/// @return Number of bus recoveries after timeouts or bus errors
+	uint32_t recoveries() const { return recoveryCount; }
+
+	/**
+	 * Probes the addresses \p first to \p last with SMBus quick commands (address byte and STOP only)
+	 * and updates the cached bus map
+	 * @return The addresses whose presence changed since the last scan
+	 */
+	I2cBusMap scan(uint8_t first = 0x08, uint8_t last = 0x77)
+	{
+		I2cBusMap changed;
+		setQuickCommand(true);
+		for (unsigned address = first; address <= last; address++) {
+			const bool present = quickCommand(address);
+			if (present != map.contains(address)) {
+				map.set(address, present);
+				changed.set(address, true);
+			}
+		}
+		setQuickCommand(false);
+		return changed;
+	}
+
+	/// Rescans a single address, e.g. after hot plugging. @return true if the device is present
+	bool probe(uint8_t address)
+	{
+		scan(address, address);
+		return map.contains(address);
+	}
+
+	/// @return true if \p address answered the last scan. Does not access the bus
+	bool isPresent(uint8_t address) const { return map.contains(address); }
+	const I2cBusMap& busMap() const { return map; }
+
+protected:
 	SercomI2cm& port;
 	
 	static constexpr unsigned CommandRead = 0x2;
@@ -105,6 +280,149 @@ private:
 	static constexpr unsigned BusstateOwner = 0x2;
 	static constexpr unsigned StatusErrorMask = SERCOM_I2CM_STATUS_ARBLOST;
 	
+	/// Sends the address for writing followed by the register number
+	bool startWrite(uint8_t slaveAddress, uint8_t reg)
+	{
+		port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.ADDR.reg = (slaveAddress << 1) | 0;
+		if (!waitForBus(StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK))
+			return false;
+		port.DATA.reg = reg;
+		return waitForBus(StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK);
+	}
+
+	/// Waits for the running byte. If one of \p errorMask is set in STATUS the bus is released
+	bool waitForBus(uint16_t errorMask)
+	{
+		uint32_t polls = 0;
+		while (port.INTFLAG.reg == 0) {
+			if (pollLimit != 0 && ++polls == pollLimit) {
+				recoverBus();
+				return false;
+			}
+		}
+		if (port.STATUS.reg & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_LOWTOUT)) {
+			recoverBus();
+			return false;
+		}
+		if (port.STATUS.reg & errorMask) {
+			port.INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB;
+			if (port.STATUS.bit.BUSSTATE == BusstateOwner)
+				sendCommand(CommandStop);
+			return false;
+		}
+		return true;
+	}
+
+	void sendCommand(unsigned command)
+	{
+		port.CTRLB.reg = (port.CTRLB.reg & SERCOM_I2CM_CTRLB_QCEN) | SERCOM_I2CM_CTRLB_SMEN | SERCOM_I2CM_CTRLB_CMD(command);
+		while (port.STATUS.bit.SYNCBUSY);
+	}
+
+	/// QCEN is enable-protected
+	void setQuickCommand(bool enable)
+	{
+		port.CTRLA.bit.ENABLE = false;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN | (enable ? SERCOM_I2CM_CTRLB_QCEN : 0);
+		port.CTRLA.bit.ENABLE = true;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.STATUS.bit.BUSSTATE = BusstateIdle;
+	}
+
+	/// Quick write to \p address. Quick commands must be enabled
+	bool quickCommand(uint8_t address)
+	{
+		port.ADDR.reg = (address << 1) | 0;
+		if (!waitForBus(StatusErrorMask | SERCOM_I2CM_STATUS_RXNACK))
+			return false;
+		// With QCEN the hardware sets MB after the ACK of the address and holds the bus, the STOP is up to software
+		sendCommand(CommandStop);
+		return true;
+	}
+
+	/// @param halfPeriod Half a SCL period in Sercom clock cycles, used by the bus recovery
+	void writeBaud(uint16_t baud, uint32_t halfPeriod)
+	{
+		recoveryHalfPeriod = halfPeriod;
+		port.CTRLA.bit.ENABLE = false;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.BAUD.reg = baud;
+		port.CTRLA.bit.ENABLE = true;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.STATUS.bit.BUSSTATE = BusstateIdle;
+	}
+
+	void init(Sercom* sercom, const mcu::ClockGenerator& clock, const mcu::ClockGenerator& slowClock, uint16_t baud)
+	{
+		int sercomIndex = mcu::util::getSercomIndex(sercom);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
+		clock.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+		slowClock.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOMX_SLOW_Val);
+
+		port.CTRLA.reg = SERCOM_I2CM_CTRLA_MODE_I2C_MASTER;
+		(void)port.CTRLB.reg;
+		port.CTRLB.reg = SERCOM_I2CM_CTRLB_SMEN;
+		port.BAUD.reg = baud;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.CTRLA.bit.ENABLE = true;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.STATUS.bit.BUSSTATE = BusstateIdle;
+	}
+
+	/// Frees a slave that holds SDA low by clocking out its byte, then sends a STOP and restarts the Sercom
+	void recoverBus()
+	{
+		recoveryCount++;
+		port.CTRLA.bit.ENABLE = false;
+		while (port.STATUS.bit.SYNCBUSY);
+
+		if (recoveryPins) {
+			GPIO sda = recoveryPins->sda;
+			GPIO scl = recoveryPins->scl;
+			// Open drain: Output drives low, Input releases the line to the pull-up
+			sda.setMode(GPIO::Input);
+			scl.setMode(GPIO::Input);
+			for (unsigned i = 0; i < 9 && !sda.read(); i++) {
+				scl.setMode(GPIO::Output);
+				recoveryDelay();
+				scl.setMode(GPIO::Input);
+				recoveryDelay();
+			}
+			// STOP: SDA rises while SCL is high
+			scl.setMode(GPIO::Output);
+			recoveryDelay();
+			sda.setMode(GPIO::Output);
+			recoveryDelay();
+			scl.setMode(GPIO::Input);
+			recoveryDelay();
+			sda.setMode(GPIO::Input);
+			recoveryDelay();
+			sda.enablePeripheral(recoveryPins->function);
+			scl.enablePeripheral(recoveryPins->function);
+		}
+
+		port.CTRLA.bit.ENABLE = true;
+		while (port.STATUS.bit.SYNCBUSY);
+		port.STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LOWTOUT
+			| SERCOM_I2CM_STATUS_BUSSTATE(BusstateIdle);
+		while (port.STATUS.bit.SYNCBUSY);
+	}
+
+	/// Half a SCL period, assuming the CPU does not run faster than the Sercom clock
+	void recoveryDelay() const
+	{
+		for (volatile uint32_t i = 0; i < recoveryHalfPeriod / 4; i++);
+	}
+
+	uint32_t recoveryHalfPeriod;
+	std::optional<I2cRecoveryPins> recoveryPins;
+	uint32_t pollLimit = 0;
+	uint32_t recoveryCount = 0;
+	I2cBusMap map;
+
 	static constexpr unsigned i2cRise = 215;
 	static constexpr uint16_t computeBaud(unsigned desiredFrequency, unsigned coreFrequency)
 	{
@@ -121,4 +439,20 @@ private:
 	}
 };
 
+/**
+ * Compile time I2C configuration
+ * @tparam ClockFrequency Frequency of the ClockGenerator in Hz
+ * @tparam Frequency SCL frequency in Hz, at most 1MHz
+ * @tparam RiseTime Measured SCL rise time in ns
+ */
+template <unsigned ClockFrequency, unsigned Frequency, unsigned RiseTime = 215>
+struct I2cConfig {
+	static constexpr I2cMaster::BaudPlan plan = I2cMaster::planBaud(ClockFrequency, Frequency, RiseTime);
+	static_assert(plan.valid, "SCL frequency not reachable with this clock and rise time");
+
+	static constexpr unsigned clockFrequency = ClockFrequency;
+	static constexpr unsigned frequency = plan.frequency;
+	static constexpr uint16_t baud = plan.baud;
+};
+
 }
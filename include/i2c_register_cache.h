@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <gsl/span>
+#include "i2c_master.h"
+
+namespace mcu {
+
+enum class I2cRegisterKind : uint8_t {
+	/// Changed by the device (status, data). Always accessed on the bus
+	Volatile,
+	/// Only changed by the host (configuration). Reads are served from the cache, writes are deferred until flush()
+	Cacheable,
+	/// Cannot be read back. Writes are deferred until flush(), reads return the last written value
+	WriteOnly
+};
+
+struct I2cRegisterCacheStatistics {
+	/// Reads served from the cache and writes of an unchanged value
+	uint32_t hits = 0;
+	/// Reads that had to access the bus
+	uint32_t misses = 0;
+	/// Burst write transactions issued by flush()
+	uint32_t burstWrites = 0;
+	/// Registers written by flush()
+	uint32_t registersWritten = 0;
+};
+
+/**
+ * @brief Shadow copy of the registers of an I2C device
+ *
+ * The device must increment the register address during burst writes.
+ *
+ * Usage:
+ * constexpr std::array<I2cRegisterKind, 0x20> sensorRegisters = {...};
+ * I2cRegisterCache<sensorRegisters> registers(i2c, 0x68);
+ *
+ * @tparam Registers std::array of I2cRegisterKind, indexed by register number starting at 0
+ */
+template <const auto& Registers>
+class I2cRegisterCache {
+	static constexpr size_t Count = std::tuple_size_v<std::remove_cv_t<std::remove_reference_t<decltype(Registers)>>>;
+	static_assert(Count <= 256, "Register numbers are 8 bit");
+
+public:
+	/**
+	 * @param i2c The bus the device is connected to
+	 * @param slaveAddress Right aligned (without Read/Write bit)
+	 */
+	I2cRegisterCache(I2cMaster& i2c, uint8_t slaveAddress) noexcept : i2c{i2c}, slaveAddress{slaveAddress} {}
+
+	std::optional<std::byte> read(uint8_t reg)
+	{
+		assert(reg < Count);
+		switch (Registers[reg]) {
+			case I2cRegisterKind::Volatile:
+				stats.misses++;
+				return i2c.readReg(slaveAddress, reg);
+			case I2cRegisterKind::WriteOnly:
+				if (!isSet(valid, reg))
+					return std::nullopt;
+				stats.hits++;
+				return values[reg];
+			case I2cRegisterKind::Cacheable:
+				break;
+		}
+		if (isSet(valid, reg)) {
+			stats.hits++;
+			return values[reg];
+		}
+		stats.misses++;
+		std::optional<std::byte> value = i2c.readReg(slaveAddress, reg);
+		if (value) {
+			values[reg] = *value;
+			set(valid, reg, true);
+		}
+		return value;
+	}
+
+	/// Volatile registers are written immediately, all others on flush()
+	bool write(uint8_t reg, std::byte value)
+	{
+		assert(reg < Count);
+		if (Registers[reg] == I2cRegisterKind::Volatile)
+			return i2c.writeReg(slaveAddress, reg, value);
+		if (isSet(valid, reg) && values[reg] == value) {
+			stats.hits++;
+			return true;
+		}
+		values[reg] = value;
+		set(valid, reg, true);
+		set(dirty, reg, true);
+		return true;
+	}
+
+	/// Replaces the bits in \p mask with \p bits. Needs no bus access if the register is cached
+	bool modify(uint8_t reg, std::byte mask, std::byte bits)
+	{
+		const std::optional<std::byte> value = read(reg);
+		if (!value)
+			return false;
+		return write(reg, (*value & ~mask) | (bits & mask));
+	}
+
+	/**
+	 * Writes all dirty registers. Adjacent ones are combined into one burst
+	 * @return false if a transaction failed, its registers stay dirty
+	 */
+	bool flush()
+	{
+		bool ok = true;
+		size_t reg = 0;
+		while (reg < Count) {
+			if (!isSet(dirty, reg)) {
+				reg++;
+				continue;
+			}
+			size_t end = reg + 1;
+			while (end < Count && isSet(dirty, end))
+				end++;
+
+			const size_t length = end - reg;
+			if (i2c.writeRegs(slaveAddress, reg, gsl::span<const std::byte>(values.data() + reg, length))) {
+				for (size_t i = reg; i < end; i++)
+					set(dirty, i, false);
+				stats.burstWrites++;
+				stats.registersWritten += length;
+			} else {
+				ok = false;
+			}
+			reg = end;
+		}
+		return ok;
+	}
+
+	bool needsFlush() const
+	{
+		for (uint32_t word : dirty) {
+			if (word != 0)
+				return true;
+		}
+		return false;
+	}
+
+	/// Forgets all cached values, e.g. after a reset of the device. Unflushed writes are lost
+	void invalidate()
+	{
+		valid = {};
+		dirty = {};
+	}
+
+	const I2cRegisterCacheStatistics& statistics() const { return stats; }
+
+private:
+	using Bits = std::array<uint32_t, (Count + 31) / 32>;
+
+	static bool isSet(const Bits& bits, size_t reg) { return (bits[reg >> 5] >> (reg & 0x1f)) & 1; }
+	static void set(Bits& bits, size_t reg, bool value)
+	{
+		if (value)
+			bits[reg >> 5] |= uint32_t{1} << (reg & 0x1f);
+		else
+			bits[reg >> 5] &= ~(uint32_t{1} << (reg & 0x1f));
+	}
+
+	I2cMaster& i2c;
+	const uint8_t slaveAddress;
+	std::array<std::byte, Count> values = {};
+	Bits valid = {};
+	Bits dirty = {};
+	I2cRegisterCacheStatistics stats;
+};
+
+} // namespace mcu
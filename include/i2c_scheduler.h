@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include "i2c_async.h"
+#include "ring_buffer.h"
+#include "utils.h"
+
+namespace mcu {
+
+struct I2cPollStatistics {
+	volatile uint32_t samples = 0;
+	/// Reads skipped because the previous one of the same device was not finished when it became due again
+	volatile uint32_t overruns = 0;
+	/// Samples lost because the ring buffer of the device was full
+	volatile uint32_t dropped = 0;
+	/// Reads that failed on the bus
+	volatile uint32_t errors = 0;
+	/// Time from the tick the read became due to its completion in SysTick cycles
+	volatile uint32_t lastLatency = 0;
+	volatile uint32_t maxLatency = 0;
+	volatile uint32_t minLatency = UINT32_MAX;
+};
+
+template <size_t QueueDepth>
+class I2cPollScheduler;
+
+/**
+ * Periodic burst read of one device, polled by an I2cPollScheduler. Use I2cPollDevice
+ */
+class I2cPollTask {
+public:
+	// The scheduler and the queued transaction point to the task
+	I2cPollTask(const I2cPollTask&) = delete;
+	I2cPollTask& operator=(const I2cPollTask&) = delete;
+
+	/// @return Difference between the highest and lowest latency in SysTick cycles
+	uint32_t jitter() const noexcept { return stats.samples != 0 ? stats.maxLatency - stats.minLatency : 0; }
+	const I2cPollStatistics& statistics() const noexcept { return stats; }
+	uint32_t period() const noexcept { return periodTicks; }
+
+protected:
+	using StoreFunction = void (*)(I2cPollTask& task, uint32_t timestamp);
+
+	I2cPollTask(uint8_t address, uint8_t reg, uint32_t period, gsl::span<std::byte> buffer, StoreFunction store) noexcept
+		: registerNumber{static_cast<std::byte>(reg)}, periodTicks{period}, store{store}
+	{
+		transaction.address = address;
+		transaction.write = gsl::span<const std::byte>(&registerNumber, 1);
+		transaction.read = buffer;
+	}
+
+	I2cPollStatistics stats;
+
+private:
+	template <size_t QueueDepth>
+	friend class I2cPollScheduler;
+
+	I2cTransaction transaction{};
+	const std::byte registerNumber;
+	const uint32_t periodTicks;
+	const StoreFunction store;
+	I2cPollTask* next = nullptr;
+	const volatile uint32_t* schedulerTicks = nullptr;
+	uint32_t nextDue = 0;
+	uint32_t issueTick = 0;
+	uint32_t issueTime = 0;
+	volatile bool busy = false;
+};
+
+template <size_t BurstLength>
+struct I2cSample {
+	/// Scheduler tick the read was issued in
+	uint32_t timestamp;
+	std::array<std::byte, BurstLength> data;
+};
+
+/**
+ * Reads \p BurstLength registers starting at a register every period and keeps the samples in a ring buffer
+ * @tparam Depth Number of buffered samples. Must be a power of two
+ */
+template <size_t BurstLength, size_t Depth>
+class I2cPollDevice : public I2cPollTask {
+public:
+	/**
+	 * @param address Right aligned (without Read/Write bit)
+	 * @param reg First register of the burst
+	 * @param period Read period in scheduler ticks
+	 */
+	I2cPollDevice(uint8_t address, uint8_t reg, uint32_t period) noexcept
+		: I2cPollTask(address, reg, period, scratch, &storeSample) {}
+
+	/// Takes the oldest sample. Must only be called from one context
+	bool pop(I2cSample<BurstLength>& sample) noexcept { return samples.pop(sample); }
+	size_t available() const noexcept { return samples.size(); }
+
+private:
+	static void storeSample(I2cPollTask& task, uint32_t timestamp) noexcept
+	{
+		I2cPollDevice& self = static_cast<I2cPollDevice&>(task);
+		if (!self.samples.push(I2cSample<BurstLength>{timestamp, self.scratch}))
+			self.stats.dropped = self.stats.dropped + 1;
+	}
+
+	std::array<std::byte, BurstLength> scratch = {};
+	RingBuffer<I2cSample<BurstLength>, Depth> samples;
+};
+
+/**
+ * @brief Rate monotonic polling of several I2C devices
+ *
+ * Devices with shorter periods have higher priority. All reads due in a tick are queued in priority order
+ * and run back to back by the I2cAsyncMaster without CPU involvement.
+ * Call I2cPollScheduler::tick from SysTick_Handler, the latency statistics count SysTick cycles across ticks.
+ */
+template <size_t QueueDepth>
+class I2cPollScheduler {
+public:
+	explicit I2cPollScheduler(I2cAsyncMaster<QueueDepth>& i2c) noexcept : i2c{i2c} {}
+
+	/// Registers \p task. Must be called before the ticks start
+	void add(I2cPollTask& task) noexcept
+	{
+		task.transaction.callback = &completed;
+		task.transaction.context = &task;
+		task.schedulerTicks = &now;
+		task.nextDue = now + task.periodTicks;
+
+		I2cPollTask** it = &tasks;
+		while (*it != nullptr && (*it)->periodTicks <= task.periodTicks)
+			it = &(*it)->next;
+		task.next = *it;
+		*it = &task;
+	}
+
+	void tick() noexcept
+	{
+		now++;
+		const uint32_t time = util::sysTickTimestamp(now);
+		for (I2cPollTask* task = tasks; task != nullptr; task = task->next) {
+			if (static_cast<int32_t>(now - task->nextDue) < 0)
+				continue;
+			task->nextDue += task->periodTicks;
+			if (task->busy) {
+				task->stats.overruns = task->stats.overruns + 1;
+				continue;
+			}
+			task->busy = true;
+			task->issueTick = now;
+			task->issueTime = time;
+			if (!i2c.enqueue(task->transaction)) {
+				task->busy = false;
+				task->stats.overruns = task->stats.overruns + 1;
+			}
+		}
+	}
+
+	/// @return Number of ticks since start
+	uint32_t ticks() const noexcept { return now; }
+	/// @return SysTick cycles since start
+	uint32_t time() const noexcept { return util::sysTickTimestamp(now); }
+
+private:
+	static void completed(I2cTransaction&, I2cStatus status, void* context) noexcept
+	{
+		I2cPollTask& task = *static_cast<I2cPollTask*>(context);
+		if (status == I2cStatus::Ok) {
+			const uint32_t latency = util::sysTickTimestamp(*task.schedulerTicks) - task.issueTime;
+			I2cPollStatistics& stats = task.stats;
+			stats.samples = stats.samples + 1;
+			stats.lastLatency = latency;
+			if (latency > stats.maxLatency)
+				stats.maxLatency = latency;
+			if (latency < stats.minLatency)
+				stats.minLatency = latency;
+			task.store(task, task.issueTick);
+		} else {
+			task.stats.errors = task.stats.errors + 1;
+		}
+		task.busy = false;
+	}
+
+	I2cAsyncMaster<QueueDepth>& i2c;
+	I2cPollTask* tasks = nullptr;
+	volatile uint32_t now = 0;
+};
+
+} // namespace mcu
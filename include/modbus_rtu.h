@@ -0,0 +1,384 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "clocks.h"
+#include "GPIO.h"
+#include "uart.h"
+#include "utils.h"
+
+namespace mcu {
+
+namespace modbus {
+
+/// Updates a Modbus CRC-16 (polynomial 0xA001 reflected, initial value 0xFFFF) with one byte
+inline uint16_t crc16Update(uint16_t crc, uint8_t data)
+{
+	// Nibble table: 32 bytes of flash instead of 512 for a full table
+	static constexpr uint16_t table[16] = {
+		0x0000, 0xcc01, 0xd801, 0x1400, 0xf001, 0x3c00, 0x2800, 0xe401,
+		0xa001, 0x6c00, 0x7800, 0xb401, 0x5000, 0x9c01, 0x8801, 0x4400,
+	};
+	crc ^= data;
+	crc = (crc >> 4) ^ table[crc & 0xf];
+	crc = (crc >> 4) ^ table[crc & 0xf];
+	return crc;
+}
+
+/**
+ * Data served by ModbusRtuSlave. Writes from the master go directly into the spans.
+ * Coils and discrete inputs are bit packed, LSB of the first byte is address 0.
+ */
+struct RegisterTable {
+	gsl::span<uint16_t> holdingRegisters;
+	gsl::span<const uint16_t> inputRegisters;
+	gsl::span<uint8_t> coils;
+	gsl::span<const uint8_t> discreteInputs;
+};
+
+struct Statistics {
+	volatile uint32_t frames = 0;
+	volatile uint32_t crcErrors = 0;
+	/// Frames with UART errors, gaps of more than 1.5 characters, shorter than 4 or longer than 256 bytes
+	volatile uint32_t invalidFrames = 0;
+	volatile uint32_t exceptions = 0;
+};
+
+} // namespace modbus
+
+/**
+ * @brief Modbus RTU slave on RS-485
+ *
+ * Frame boundaries are detected in hardware: a one-shot TC is retriggered on every received byte
+ * and fires after 3.5 character times of silence. A byte after more than 1.5 character times of silence
+ * (compare channel 1) invalidates the frame. The CRC is computed while the bytes arrive.
+ * Requests are answered from the interrupt, the driver enable pin is released on TXC.
+ *
+ * Call uartInterrupt() in the SERCOMx and timerInterrupt() in the TCx interrupt handler.
+ */
+class ModbusRtuSlave : public UART {
+public:
+	/**
+	 * @param port The Sercom interface to use
+	 * @param clkGen ClockGenerator for the UART
+	 * @param baudRate Baud rate. Above 19200 the fixed delays of 750us and 1750us are used
+	 * @param pinLayout A combination of SERCOM_USART_CTRLA_TXPO and SERCOM_USART_CTRLA_RXPO
+	 * @param timer TC used for the inter-frame delay. It is used in 16-bit mode
+	 * @param timerClock ClockGenerator for the timer
+	 * @param driverEnable Pin that enables the RS-485 driver, high while transmitting
+	 * @param address Slave address 1-247
+	 * @param registers Data served to the master
+	 */
+	ModbusRtuSlave(
+		Sercom* port, const ClockGenerator& clkGen, unsigned baudRate, uint32_t pinLayout,
+		Tc* timer, const ClockGenerator& timerClock, GPIO driverEnable,
+		uint8_t address, const modbus::RegisterTable& registers
+	)
+		: UART(port, clkGen, baudRate, pinLayout), timer{timer->COUNT16}, driverEnable{driverEnable},
+		address{address}, registers{registers}
+	{
+		this->driverEnable.setMode(GPIO::Output);
+
+		const unsigned timerIndex = util::getTimerIndex(timer);
+		util::checkTimerGenerator(timerIndex, timerClock.id);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_TC0_Pos + timerIndex);
+		timerClock.routeToPeripheral(GCLK_CLKCTRL_ID_TC0_TC1_Val + timerIndex / 2);
+
+		// 1.5 and 3.5 characters of 11 bits
+		const unsigned characterGapUs = baudRate > 19200 ? 750 : 16500000 / baudRate;
+		const unsigned frameDelayUs = baudRate > 19200 ? 1750 : 38500000 / baudRate;
+		const unsigned long long ticks = static_cast<unsigned long long>(timerClock.frequency) * frameDelayUs / 1000000;
+		const unsigned long long gapTicks = static_cast<unsigned long long>(timerClock.frequency) * characterGapUs / 1000000;
+		static constexpr uint8_t prescalerShifts[] = {0, 1, 2, 3, 4, 6, 8, 10};
+		unsigned prescaler = 0;
+		while (prescaler < 7 && (ticks >> prescalerShifts[prescaler]) > 0xffff)
+			prescaler++;
+		// Exceeds 16 bits even with DIV1024 if the timer clock is too fast. Without asserts the longest delay is used
+		const unsigned long long period = ticks >> prescalerShifts[prescaler];
+		assert(period <= 0xffff);
+
+		this->timer.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ
+			| TC_CTRLA_PRESCALER(prescaler) | TC_CTRLA_PRESCSYNC_RESYNC;
+		this->timer.CC[0].reg = period > 0xffff ? 0xffff : period;
+		while (this->timer.STATUS.bit.SYNCBUSY);
+		this->timer.CC[1].reg = period > 0xffff ? 0xffff * 3 / 7 : gapTicks >> prescalerShifts[prescaler];
+		while (this->timer.STATUS.bit.SYNCBUSY);
+		this->timer.CTRLBSET.reg = TC_CTRLBSET_ONESHOT;
+		this->timer.INTENSET.reg = TC_INTENSET_OVF | TC_INTENSET_MC1;
+		while (this->timer.STATUS.bit.SYNCBUSY);
+		this->timer.CTRLA.bit.ENABLE = true;
+		while (this->timer.STATUS.bit.SYNCBUSY);
+		this->timer.CTRLBSET.reg = TC_CTRLBSET_CMD_STOP;
+
+		enableIrq(static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + util::getSercomIndex(port)));
+		enableIrq(static_cast<IRQn_Type>(static_cast<unsigned>(TC0_IRQn) + timerIndex));
+	}
+
+	/// Call in the Sercom Interrupt handler
+	void uartInterrupt() noexcept
+	{
+		if (sercom.INTFLAG.bit.RXC) {
+			const uint16_t status = sercom.STATUS.reg;
+			const uint8_t data = sercom.DATA.reg;
+			// Cleared for echoes of the own response, too, so the flags do not carry over into the next request
+			const uint16_t errors = status & (SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_BUFOVF);
+			if (errors != 0)
+				sercom.STATUS.reg = errors;
+			if (state != State::Transmitting) {
+				timer.CTRLBSET.reg = TC_CTRLBSET_CMD_RETRIGGER;
+				if (errors != 0 || characterGapExceeded)
+					frameError = true;
+				if (rxLength < frame.size()) {
+					frame[rxLength++] = data;
+					crc = modbus::crc16Update(crc, data);
+				} else {
+					frameError = true;
+				}
+			}
+		}
+
+		if ((sercom.INTENSET.reg & SERCOM_USART_INTENSET_DRE) && sercom.INTFLAG.bit.DRE) {
+			if (txIndex < txLength) {
+				sercom.DATA.reg = frame[txIndex++];
+			} else {
+				sercom.INTENCLR.reg = SERCOM_USART_INTENCLR_DRE;
+				sercom.INTFLAG.reg = SERCOM_USART_INTFLAG_TXC;
+				sercom.INTENSET.reg = SERCOM_USART_INTENSET_TXC;
+			}
+		}
+
+		if ((sercom.INTENSET.reg & SERCOM_USART_INTENSET_TXC) && sercom.INTFLAG.bit.TXC) {
+			sercom.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+			driverEnable.setLow();
+			state = State::Idle;
+		}
+	}
+
+	/// Call in the TC Interrupt handler. Processes the received frame after 3.5 character times of silence
+	void timerInterrupt() noexcept
+	{
+		if (timer.INTFLAG.bit.MC1) {
+			timer.INTFLAG.reg = TC_INTFLAG_MC1;
+			// 1.5 character times of silence, a further byte before the end of the frame breaks it
+			characterGapExceeded = true;
+		}
+		if (!timer.INTFLAG.bit.OVF)
+			return;
+		timer.INTFLAG.reg = TC_INTFLAG_OVF;
+
+		const size_t length = rxLength;
+		const bool valid = !frameError;
+		const uint16_t frameCrc = crc;
+		rxLength = 0;
+		crc = 0xffff;
+		frameError = false;
+		characterGapExceeded = false;
+
+		if (length == 0)
+			return;
+		if (!valid || length < 4) {
+			stats.invalidFrames = stats.invalidFrames + 1;
+			return;
+		}
+		// The CRC over a frame including its own CRC is 0
+		if (frameCrc != 0) {
+			stats.crcErrors = stats.crcErrors + 1;
+			return;
+		}
+		if (frame[0] != address && frame[0] != 0)
+			return;
+		stats.frames = stats.frames + 1;
+
+		const size_t responseLength = process(length - 2);
+		if (frame[0] == 0 || responseLength == 0)
+			return; // No response to broadcasts
+
+		uint16_t responseCrc = 0xffff;
+		for (size_t i = 0; i < responseLength; i++)
+			responseCrc = modbus::crc16Update(responseCrc, frame[i]);
+		frame[responseLength] = responseCrc & 0xff;
+		frame[responseLength + 1] = responseCrc >> 8;
+
+		state = State::Transmitting;
+		txIndex = 0;
+		txLength = responseLength + 2;
+		driverEnable.setHigh();
+		sercom.INTENSET.reg = SERCOM_USART_INTENSET_DRE;
+	}
+
+	const modbus::Statistics& statistics() const noexcept { return stats; }
+
+private:
+	enum class State : uint8_t { Idle, Transmitting };
+
+	enum Function : uint8_t {
+		ReadCoils = 0x01,
+		ReadDiscreteInputs = 0x02,
+		ReadHoldingRegisters = 0x03,
+		ReadInputRegisters = 0x04,
+		WriteSingleCoil = 0x05,
+		WriteSingleRegister = 0x06,
+		WriteMultipleCoils = 0x0f,
+		WriteMultipleRegisters = 0x10,
+	};
+
+	enum Exception : uint8_t {
+		IllegalFunction = 0x01,
+		IllegalDataAddress = 0x02,
+		IllegalDataValue = 0x03,
+	};
+
+	static void enableIrq(IRQn_Type irq)
+	{
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+	}
+
+	uint16_t word(size_t offset) const { return (frame[offset] << 8) | frame[offset + 1]; }
+
+	void putWord(size_t offset, uint16_t value)
+	{
+		frame[offset] = value >> 8;
+		frame[offset + 1] = value & 0xff;
+	}
+
+	static bool getBit(gsl::span<const uint8_t> bits, size_t index) { return (bits[index / 8] >> (index % 8)) & 1; }
+
+	static void setBit(gsl::span<uint8_t> bits, size_t index, bool value)
+	{
+		if (value)
+			bits[index / 8] |= 1 << (index % 8);
+		else
+			bits[index / 8] &= ~(1 << (index % 8));
+	}
+
+	static bool isSupported(uint8_t function)
+	{
+		switch (function) {
+			case ReadCoils:
+			case ReadDiscreteInputs:
+			case ReadHoldingRegisters:
+			case ReadInputRegisters:
+			case WriteSingleCoil:
+			case WriteSingleRegister:
+			case WriteMultipleCoils:
+			case WriteMultipleRegisters:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	size_t exception(uint8_t code)
+	{
+		stats.exceptions = stats.exceptions + 1;
+		frame[1] |= 0x80;
+		frame[2] = code;
+		return 3;
+	}
+
+	/**
+	 * Executes the request in frame and builds the response in place
+	 * @param length Request length without CRC
+	 * @return Response length without CRC
+	 */
+	size_t process(size_t length)
+	{
+		const uint8_t function = frame[1];
+		// An unknown function is reported as such, whatever its length
+		if (!isSupported(function))
+			return exception(IllegalFunction);
+		if (length < 6)
+			return exception(IllegalDataValue);
+		const uint16_t start = word(2);
+		const uint16_t count = word(4);
+
+		switch (function) {
+			case ReadCoils:
+			case ReadDiscreteInputs: {
+				const gsl::span<const uint8_t> bits = function == ReadCoils
+					? gsl::span<const uint8_t>(registers.coils)
+					: registers.discreteInputs;
+				if (count == 0 || count > 2000)
+					return exception(IllegalDataValue);
+				if (start + count > static_cast<size_t>(bits.size()) * 8)
+					return exception(IllegalDataAddress);
+				const uint8_t bytes = (count + 7) / 8;
+				frame[2] = bytes;
+				for (uint8_t i = 0; i < bytes; i++)
+					frame[3 + i] = 0;
+				for (uint16_t i = 0; i < count; i++) {
+					if (getBit(bits, start + i))
+						frame[3 + i / 8] |= 1 << (i % 8);
+				}
+				return 3 + bytes;
+			}
+			case ReadHoldingRegisters:
+			case ReadInputRegisters: {
+				const gsl::span<const uint16_t> values = function == ReadHoldingRegisters
+					? gsl::span<const uint16_t>(registers.holdingRegisters)
+					: registers.inputRegisters;
+				if (count == 0 || count > 125)
+					return exception(IllegalDataValue);
+				if (start + count > static_cast<size_t>(values.size()))
+					return exception(IllegalDataAddress);
+				frame[2] = count * 2;
+				for (uint16_t i = 0; i < count; i++)
+					putWord(3 + 2 * i, values[start + i]);
+				return 3 + count * 2;
+			}
+			case WriteSingleCoil:
+				if (count != 0xff00 && count != 0x0000)
+					return exception(IllegalDataValue);
+				if (start >= static_cast<size_t>(registers.coils.size()) * 8)
+					return exception(IllegalDataAddress);
+				setBit(registers.coils, start, count == 0xff00);
+				return 6; // Echo of the request
+			case WriteSingleRegister:
+				if (start >= static_cast<size_t>(registers.holdingRegisters.size()))
+					return exception(IllegalDataAddress);
+				registers.holdingRegisters[start] = count;
+				return 6; // Echo of the request
+			case WriteMultipleCoils:
+				if (count == 0 || count > 1968 || length < 7u + frame[6] || frame[6] != (count + 7) / 8)
+					return exception(IllegalDataValue);
+				if (start + count > static_cast<size_t>(registers.coils.size()) * 8)
+					return exception(IllegalDataAddress);
+				for (uint16_t i = 0; i < count; i++)
+					setBit(registers.coils, start + i, (frame[7 + i / 8] >> (i % 8)) & 1);
+				return 6;
+			case WriteMultipleRegisters:
+				if (count == 0 || count > 123 || length < 7u + frame[6] || frame[6] != count * 2)
+					return exception(IllegalDataValue);
+				if (start + count > static_cast<size_t>(registers.holdingRegisters.size()))
+					return exception(IllegalDataAddress);
+				for (uint16_t i = 0; i < count; i++)
+					registers.holdingRegisters[start + i] = word(7 + 2 * i);
+				return 6;
+			default:
+				return exception(IllegalFunction);
+		}
+	}
+
+	TcCount16& timer;
+	GPIO driverEnable;
+	const uint8_t address;
+	const modbus::RegisterTable registers;
+
+	/// Shared by the request and the response, a Modbus RTU frame has at most 256 bytes
+	std::array<uint8_t, 256> frame;
+	size_t rxLength = 0;
+	uint16_t crc = 0xffff;
+	bool frameError = false;
+	bool characterGapExceeded = false;
+	volatile State state = State::Idle;
+	size_t txIndex = 0;
+	size_t txLength = 0;
+	modbus::Statistics stats;
+};
+
+} // namespace mcu
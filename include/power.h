@@ -0,0 +1,32 @@
+#pragma once
+
+#include <sam.h>
+
+namespace mcu {
+namespace power {
+
+/**
+ * Enters IDLE sleep mode until the next interrupt
+ * @param mode 0: CPU stopped, 1: CPU and AHB clocks stopped, 2: CPU, AHB and APB clocks stopped
+ */
+inline void idle(unsigned mode = 0)
+{
+	SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+	PM->SLEEP.reg = PM_SLEEP_IDLE(mode);
+	__DSB();
+	__WFI();
+}
+
+/**
+ * Enters STANDBY sleep mode until the next interrupt.
+ * Only clocks with RUNSTDBY or ONDEMAND keep running, SysTick is stopped.
+ */
+inline void standby()
+{
+	SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+	__DSB();
+	__WFI();
+}
+
+} // namespace power
+} // namespace mcu
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <gsl/span>
+
+namespace mcu {
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring buffer
+ *
+ * One side (e.g. an interrupt handler) may only use the producer functions,
+ * the other side only the consumer functions. No critical sections are needed,
+ * because each index is written by exactly one side and aligned word loads and
+ * stores are atomic on Cortex-M0+.
+ *
+ * @tparam T Element type
+ * @tparam Capacity Number of elements. Must be a power of two
+ */
+template <typename T, size_t Capacity>
+class RingBuffer {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	static constexpr size_t capacity() noexcept { return Capacity; }
+
+	size_t size() const noexcept { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+	bool empty() const noexcept { return size() == 0; }
+	bool full() const noexcept { return size() == Capacity; }
+
+	// Producer side
+
+	/// @return false if the buffer is full
+	bool push(const T& value) noexcept
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == Capacity)
+			return false;
+		buffer[h & Mask] = value;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Copies as many elements from \p src as fit into the buffer
+	 * @return Number of elements accepted
+	 */
+	size_t write(gsl::span<const T> src) noexcept
+	{
+		size_t written = 0;
+		while (written < static_cast<size_t>(src.size())) {
+			gsl::span<T> space = writable();
+			if (space.empty())
+				break;
+			size_t chunk = std::min(static_cast<size_t>(space.size()), static_cast<size_t>(src.size()) - written);
+			for (size_t i = 0; i < chunk; i++)
+				space[i] = src[written + i];
+			commit(chunk);
+			written += chunk;
+		}
+		return written;
+	}
+
+	/// @return The largest contiguous free region. Fill it and call commit()
+	gsl::span<T> writable() noexcept
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		const size_t free = Capacity - (h - tail.load(std::memory_order_acquire));
+		const size_t offset = h & Mask;
+		return gsl::span<T>(buffer.data() + offset, std::min(free, Capacity - offset));
+	}
+
+	/// Publishes \p count elements previously written into writable()
+	void commit(size_t count) noexcept
+	{
+		head.store(head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	// Consumer side
+
+	/// @return false if the buffer is empty
+	bool pop(T& value) noexcept
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) == t)
+			return false;
+		value = buffer[t & Mask];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Moves up to dst.size() elements into \p dst
+	 * @return Number of elements read
+	 */
+	size_t read(gsl::span<T> dst) noexcept
+	{
+		size_t count = 0;
+		while (count < static_cast<size_t>(dst.size())) {
+			gsl::span<const T> data = readable();
+			if (data.empty())
+				break;
+			size_t chunk = std::min(static_cast<size_t>(data.size()), static_cast<size_t>(dst.size()) - count);
+			for (size_t i = 0; i < chunk; i++)
+				dst[count + i] = data[i];
+			consume(chunk);
+			count += chunk;
+		}
+		return count;
+	}
+
+	/// @return The largest contiguous region of stored elements without removing them
+	gsl::span<const T> readable() const noexcept
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		const size_t used = head.load(std::memory_order_acquire) - t;
+		const size_t offset = t & Mask;
+		return gsl::span<const T>(buffer.data() + offset, std::min(used, Capacity - offset));
+	}
+
+	/// Removes \p count elements previously obtained from readable()
+	void consume(size_t count) noexcept
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+	}
+
+	/// Discards all stored elements. Consumer side only
+	void clear() noexcept
+	{
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	static constexpr size_t Mask = Capacity - 1;
+
+	std::array<T, Capacity> buffer;
+	std::atomic<size_t> head{0};
+	std::atomic<size_t> tail{0};
+};
+
+} // namespace mcu
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <gsl/span>
+#include "clocks.h"
+#include "GPIO.h"
+#include "SPI.h"
+
+namespace mcu {
+
+/**
+ * @brief SD/SDHC card in SPI mode as a block device
+ *
+ * Data is transferred directly between the card and the user buffers.
+ * Multiple blocks are streamed with CMD18/CMD25, writes announce their length with ACMD23 so the card can pre-erase.
+ * The chip select pin must be configured as output and high.
+ */
+class SdCard
+{
+public:
+	static constexpr size_t BlockSize = 512;
+
+	/**
+	 * @param useCrc If true, CRCs of commands and data are checked (CMD59). Otherwise they are skipped
+	 */
+	SdCard(SPI& spi, GPIO chipSelect, bool useCrc = false) noexcept : spi{spi}, chipSelect{chipSelect}, useCrc{useCrc} {}
+
+	/**
+	 * Initializes the card at 400kHz and switches to \p baud afterwards
+	 * @param clkGen The ClockGenerator of the SPI
+	 * @param baud Baud rate after initialization. At most 25MHz
+	 * @return false if no usable card responds
+	 */
+	bool init(const ClockGenerator& clkGen, unsigned baud) noexcept;
+
+	/// @return Number of blocks. Only valid after init()
+	uint32_t blockCount() const noexcept { return blocks; }
+	bool isHighCapacity() const noexcept { return highCapacity; }
+
+	/**
+	 * Reads dst.size() / BlockSize blocks starting at \p block
+	 * @param dst Size must be a multiple of BlockSize
+	 */
+	bool read(uint32_t block, gsl::span<uint8_t> dst) noexcept;
+	/**
+	 * Writes src.size() / BlockSize blocks starting at \p block
+	 * @param src Size must be a multiple of BlockSize
+	 */
+	bool write(uint32_t block, gsl::span<const uint8_t> src) noexcept;
+
+	/// CRC7 of SD commands, shifted left by one with the end bit set
+	static uint8_t crc7(gsl::span<const uint8_t> data) noexcept;
+	/// CRC16-CCITT of SD data blocks
+	static uint16_t crc16(gsl::span<const uint8_t> data) noexcept;
+
+private:
+	enum Token : uint8_t {
+		StartBlock = 0xfe,
+		StartMultiWrite = 0xfc,
+		StopMultiWrite = 0xfd
+	};
+	static constexpr uint8_t R1Idle = 0x01;
+	static constexpr uint8_t R1IllegalCommand = 0x04;
+	static constexpr uint8_t DataAccepted = 0x05;
+	static constexpr unsigned InitBaud = 400000;
+
+	/// Sends a command and returns R1. The chip stays selected for the rest of the response
+	uint8_t command(uint8_t index, uint32_t argument) noexcept;
+	uint8_t appCommand(uint8_t index, uint32_t argument) noexcept;
+	void deselect() noexcept;
+	bool waitReady() noexcept;
+	bool waitToken(uint8_t token) noexcept;
+	bool receiveBlock(gsl::span<uint8_t> dst) noexcept;
+	bool sendBlock(uint8_t token, gsl::span<const uint8_t> src) noexcept;
+	bool readCsd() noexcept;
+
+	SPI& spi;
+	GPIO chipSelect;
+	const bool useCrc;
+	bool highCapacity = false;
+	uint32_t blocks = 0;
+};
+
+} // namespace mcu
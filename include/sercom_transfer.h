@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+
+namespace mcu {
+namespace detail {
+
+/*
+ * Bulk transfer loops shared by the synchronous SERCOM modes (SercomSpi, SercomUsart).
+ * Both have DRE/TXC/RXC at the same INTFLAG positions and a DATA register.
+ * The next byte is written on DRE while the previous one is still shifting,
+ * at most two bytes are in flight so the two level receive buffer cannot overflow.
+ */
+
+/// @param rx At least as large as \p tx, or empty to discard the received bytes
+template <typename Regs>
+void pipelinedTransfer(Regs& regs, gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx)
+{
+	assert(rx.empty() || rx.size() >= tx.size());
+	const size_t size = static_cast<size_t>(tx.size());
+	const uint8_t* txIt = tx.data();
+	// Without rx every byte goes to the same place, so the loop has no extra branch
+	uint8_t discard;
+	uint8_t* rxIt = rx.empty() ? &discard : rx.data();
+	const size_t rxStep = rx.empty() ? 0 : 1;
+	size_t sent = 0;
+	size_t received = 0;
+	while (received != size) {
+		if (sent < size && sent - received < 2 && regs.INTFLAG.bit.DRE) {
+			regs.DATA.reg = *txIt++;
+			sent++;
+		}
+		if (regs.INTFLAG.bit.RXC) {
+			*rxIt = regs.DATA.reg;
+			rxIt += rxStep;
+			received++;
+		}
+	}
+}
+
+/// Like pipelinedTransfer, but sends \p dummy for every byte
+template <typename Regs>
+void pipelinedRead(Regs& regs, gsl::span<uint8_t> rx, uint8_t dummy)
+{
+	const size_t size = static_cast<size_t>(rx.size());
+	uint8_t* rxIt = rx.data();
+	uint8_t* const rxEnd = rxIt + size;
+	size_t sent = 0;
+	while (rxIt != rxEnd) {
+		if (sent < size && sent - (rxIt - rx.data()) < 2 && regs.INTFLAG.bit.DRE) {
+			regs.DATA.reg = dummy;
+			sent++;
+		}
+		if (regs.INTFLAG.bit.RXC)
+			*rxIt++ = regs.DATA.reg;
+	}
+}
+
+/**
+ * Transmit only loop: keeps DATA full and waits for TXC at the end.
+ * The receiver must be disabled or drained by the caller afterwards.
+ */
+template <typename Regs>
+void pipelinedWrite(Regs& regs, gsl::span<const uint8_t> tx, uint8_t txcFlag)
+{
+	if (tx.empty())
+		return;
+	regs.INTFLAG.reg = txcFlag;
+	for (uint8_t data : tx) {
+		while (!regs.INTFLAG.bit.DRE);
+		regs.DATA.reg = data;
+	}
+	while (!regs.INTFLAG.bit.TXC);
+}
+
+/// Empties the receive buffer and clears \p overflowFlag in STATUS, e.g. after pipelinedWrite
+template <typename Regs>
+void discardReceived(Regs& regs, uint16_t overflowFlag)
+{
+	while (regs.INTFLAG.bit.RXC) {
+		[[maybe_unused]] const uint8_t data = regs.DATA.reg;
+	}
+	regs.STATUS.reg = overflowFlag;
+}
+
+} // namespace detail
+} // namespace mcu
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "clocks.h"
+#include "GPIO.h"
+#include "SPI.h"
+
+namespace mcu {
+
+class SpiDevice;
+
+/**
+ * @brief SPI Master shared by several SpiDevice with different modes and baud rates
+ *
+ * The bus remembers the active configuration and only rewrites CTRLA/BAUD when a device with a different one is selected.
+ * Transfers are only possible through SpiDevice::select, so nothing can change the configuration behind the bus' back.
+ */
+class SpiBus {
+public:
+	/**
+	 * @param sercom The Sercom interface to use
+	 * @param clkGen ClockGenerator for generating the Baud clock. Must be at least 2 * the highest baud rate
+	 * @param pinLayout a combination of SERCOM_SPI_CTRLA_DOPO and SERCOM_SPI_CTRLA_DIPO to set the pinLayout
+	 */
+	SpiBus(
+		Sercom* sercom, const ClockGenerator& clkGen,
+		uint32_t pinLayout = SERCOM_SPI_CTRLA_DOPO(0) | SERCOM_SPI_CTRLA_DIPO(2)
+	)
+		: sercom{sercom},
+		  spi{sercom, clkGen.frequency / 2, clkGen, 0, false, pinLayout},
+		  clockFrequency{clkGen.frequency},
+		  pinLayout{pinLayout & (SERCOM_SPI_CTRLA_DOPO_Msk | SERCOM_SPI_CTRLA_DIPO_Msk)},
+		  activeCtrla{ctrlaFor(0, false)}
+	{}
+
+	/// @return Number of times CTRLA/BAUD were rewritten
+	uint32_t reconfigurations() const noexcept { return reconfigurationCount; }
+
+private:
+	friend class SpiDevice;
+
+	uint32_t ctrlaFor(unsigned mode, bool lsbFirst) const noexcept
+	{
+		return SERCOM_SPI_CTRLA_MODE_SPI_MASTER | pinLayout | SERCOM_SPI_CTRLA_FORM_SPI
+			| (mode << SERCOM_SPI_CTRLA_CPHA_Pos)
+			| (static_cast<uint32_t>(lsbFirst) << SERCOM_SPI_CTRLA_DORD_Pos);
+	}
+
+	void configure(uint32_t ctrla, uint8_t baud) noexcept
+	{
+		if (ctrla == activeCtrla && baud == activeBaud)
+			return;
+		sercom->SPI.CTRLA.bit.ENABLE = false;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+		sercom->SPI.CTRLA.reg = ctrla;
+		sercom->SPI.BAUD.reg = baud;
+		while (sercom->SPI.STATUS.bit.SYNCBUSY);
+		sercom->SPI.CTRLA.bit.ENABLE = true;
+		activeCtrla = ctrla;
+		activeBaud = baud;
+		reconfigurationCount++;
+	}
+
+	Sercom* const sercom;
+	const SPI spi;
+	const uint32_t clockFrequency;
+	const uint32_t pinLayout;
+	uint32_t activeCtrla;
+	uint8_t activeBaud = 0;
+	uint32_t reconfigurationCount = 0;
+};
+
+/**
+ * @brief One device on a SpiBus
+ *
+ * The register values are computed once in the constructor.
+ * The chip select pin must be configured as output and high.
+ *
+ * Usage:
+ * {
+ *     auto transaction = device.select();
+ *     transaction.write(command);
+ *     transaction.read(response);
+ * }
+ */
+class SpiDevice {
+public:
+	/**
+	 * @param bus The bus the device is connected to
+	 * @param chipSelect Chip select pin, active low
+	 * @param baud Baud rate (bits per second)
+	 * @param mode SPI Mode 0, 1, 2 or 3
+	 * @param lsbFirst If true LSB is transmitted first
+	 */
+	SpiDevice(SpiBus& bus, GPIO chipSelect, unsigned baud, unsigned mode = 0, bool lsbFirst = false) noexcept
+		: bus{bus}, chipSelect{chipSelect},
+		  ctrla{bus.ctrlaFor(mode, lsbFirst)},
+		  baudRegister{static_cast<uint8_t>(bus.clockFrequency / (2 * baud) - 1)}
+	{}
+
+	/**
+	 * Asserts chip select for its lifetime. The bus is configured for the device on construction
+	 */
+	class Transaction {
+	public:
+		explicit Transaction(SpiDevice& device) noexcept : device{device}
+		{
+			device.bus.configure(device.ctrla, device.baudRegister);
+			device.chipSelect.setLow();
+		}
+		~Transaction() { device.chipSelect.setHigh(); }
+
+		Transaction(const Transaction&) = delete;
+		Transaction& operator=(const Transaction&) = delete;
+
+		uint8_t transfer(uint8_t data) const { return device.bus.spi.transfer(data); }
+		void transfer(gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx) const { device.bus.spi.transfer(tx, rx); }
+		void write(gsl::span<const uint8_t> tx) const { device.bus.spi.write(tx); }
+		void read(gsl::span<uint8_t> rx, uint8_t dummy = 0xff) const { device.bus.spi.read(rx, dummy); }
+
+	private:
+		SpiDevice& device;
+	};
+
+	/// Starts a transaction. Only one device on the bus may be selected at a time
+	[[nodiscard]] Transaction select() noexcept { return Transaction(*this); }
+
+private:
+	SpiBus& bus;
+	GPIO chipSelect;
+	const uint32_t ctrla;
+	const uint8_t baudRegister;
+};
+
+} // namespace mcu
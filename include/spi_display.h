@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include "GPIO.h"
+#include "SPI.h"
+
+namespace mcu {
+
+/**
+ * @brief Minimal command interface of MIPI DBI type C displays (ST7735, ILI9341, ...) with RGB565 pixels
+ *
+ * Chip select and data/command pins must be configured as output, chip select high.
+ * The controller initialization sequence is sent by the application with command().
+ */
+class SpiDisplay {
+public:
+	enum Command : uint8_t {
+		ColumnAddressSet = 0x2a,
+		RowAddressSet = 0x2b,
+		MemoryWrite = 0x2c
+	};
+
+	SpiDisplay(SPI& spi, GPIO chipSelect, GPIO dataCommand) noexcept
+		: spi{spi}, chipSelect{chipSelect}, dataCommand{dataCommand} {}
+
+	void command(uint8_t cmd, gsl::span<const uint8_t> parameters = {}) noexcept
+	{
+		chipSelect.setLow();
+		dataCommand.setLow();
+		spi.write(gsl::span<const uint8_t>(&cmd, 1));
+		dataCommand.setHigh();
+		spi.write(parameters);
+		chipSelect.setHigh();
+	}
+
+	/// Selects the inclusive window [x0, x1] x [y0, y1] and starts a memory write
+	void beginWrite(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) noexcept
+	{
+		const std::array<uint8_t, 4> columns = {
+			static_cast<uint8_t>(x0 >> 8), static_cast<uint8_t>(x0), static_cast<uint8_t>(x1 >> 8), static_cast<uint8_t>(x1)
+		};
+		const std::array<uint8_t, 4> rows = {
+			static_cast<uint8_t>(y0 >> 8), static_cast<uint8_t>(y0), static_cast<uint8_t>(y1 >> 8), static_cast<uint8_t>(y1)
+		};
+		command(ColumnAddressSet, columns);
+		command(RowAddressSet, rows);
+		command(MemoryWrite);
+		chipSelect.setLow();
+	}
+
+	/// Sends big endian RGB565 pixel data. Only valid between beginWrite() and endWrite()
+	void writePixels(gsl::span<const uint8_t> data) noexcept { spi.write(data); }
+
+	void endWrite() noexcept { chipSelect.setHigh(); }
+
+private:
+	SPI& spi;
+	GPIO chipSelect;
+	GPIO dataCommand;
+};
+
+/**
+ * @brief Redraws only the changed tiles of a display without a frame buffer
+ *
+ * The screen is divided into tiles that are marked dirty by the application.
+ * flush() merges horizontally adjacent dirty tiles into one window, lets the renderer draw it
+ * strip by strip into a small buffer and streams the strips with the bulk SPI path.
+ *
+ * @tparam Width Display width in pixels
+ * @tparam Height Display height in pixels
+ * @tparam TileSize Edge length of a tile in pixels
+ * @tparam StripPixels Size of the render buffer in pixels. Must hold at least one line of a tile
+ */
+template <uint16_t Width, uint16_t Height, uint16_t TileSize = 16, size_t StripPixels = 1024>
+class TiledDisplay {
+public:
+	static constexpr uint16_t Columns = (Width + TileSize - 1) / TileSize;
+	static constexpr uint16_t Rows = (Height + TileSize - 1) / TileSize;
+	static_assert(StripPixels >= TileSize, "The strip buffer must hold at least one tile line");
+	static_assert(Columns <= 32, "A tile row is stored as one 32 bit mask");
+
+	explicit TiledDisplay(SpiDisplay& display) noexcept : display{display} {}
+
+	/// Marks the tiles touched by the rectangle as dirty
+	void markDirty(uint16_t x, uint16_t y, uint16_t width, uint16_t height) noexcept
+	{
+		if (width == 0 || height == 0 || x >= Width || y >= Height)
+			return;
+		const unsigned firstColumn = x / TileSize;
+		const unsigned lastColumn = std::min<unsigned>(x + width - 1, Width - 1) / TileSize;
+		const unsigned lastRow = std::min<unsigned>(y + height - 1, Height - 1) / TileSize;
+		const uint32_t mask = (lastColumn - firstColumn == 31 ? ~uint32_t{0} : (uint32_t{1} << (lastColumn - firstColumn + 1)) - 1) << firstColumn;
+		for (unsigned row = y / TileSize; row <= lastRow; row++)
+			dirty[row] |= mask;
+	}
+
+	void markAllDirty() noexcept { markDirty(0, 0, Width, Height); }
+
+	bool isDirty() const noexcept
+	{
+		for (uint32_t row : dirty) {
+			if (row != 0)
+				return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Redraws all dirty tiles
+	 * @param render Callable that draws a rectangle. Pixels are RGB565 in row major order.
+	 *               Signature: void render(uint16_t x, uint16_t y, uint16_t width, uint16_t height, gsl::span<uint16_t> pixels)
+	 * @return Number of bytes sent to the display including window commands
+	 */
+	template <typename Renderer>
+	size_t flush(Renderer render) noexcept
+	{
+		size_t bytesSent = 0;
+		for (unsigned row = 0; row < Rows; row++) {
+			uint32_t mask = dirty[row];
+			dirty[row] = 0;
+			unsigned column = 0;
+			while (mask != 0) {
+				// Skip to the next run of dirty tiles
+				while (!(mask & 1)) {
+					mask >>= 1;
+					column++;
+				}
+				unsigned runLength = 0;
+				while (mask & 1) {
+					mask >>= 1;
+					runLength++;
+				}
+				bytesSent += drawWindow(render, column, row, runLength);
+				column += runLength;
+			}
+		}
+		return bytesSent;
+	}
+
+private:
+	/// Bytes of the CASET, RASET and RAMWR commands of one window
+	static constexpr size_t WindowOverhead = 3 + 2 * 4;
+
+	template <typename Renderer>
+	size_t drawWindow(Renderer& render, unsigned column, unsigned row, unsigned runLength) noexcept
+	{
+		const uint16_t x = column * TileSize;
+		const uint16_t y = row * TileSize;
+		const uint16_t width = std::min<unsigned>((column + runLength) * TileSize, Width) - x;
+		const uint16_t height = std::min<unsigned>(y + TileSize, Height) - y;
+		// Wide runs are drawn in several strips of whole lines
+		const uint16_t linesPerStrip = std::max<unsigned>(1, std::min<unsigned>(height, StripPixels / width));
+
+		display.beginWrite(x, y, x + width - 1, y + height - 1);
+		for (uint16_t line = 0; line < height; line += linesPerStrip) {
+			const uint16_t lines = std::min<unsigned>(linesPerStrip, height - line);
+			const size_t pixels = static_cast<size_t>(width) * lines;
+			if (pixels <= StripPixels) {
+				render(x, y + line, width, lines, gsl::span<uint16_t>(strip.data(), pixels));
+				sendStrip(pixels);
+			} else {
+				// A single line wider than the buffer
+				for (uint16_t offset = 0; offset < width; offset += StripPixels) {
+					const uint16_t part = std::min<unsigned>(StripPixels, width - offset);
+					render(x + offset, y + line, part, 1, gsl::span<uint16_t>(strip.data(), part));
+					sendStrip(part);
+				}
+			}
+		}
+		display.endWrite();
+		return WindowOverhead + static_cast<size_t>(width) * height * 2;
+	}
+
+	void sendStrip(size_t pixels) noexcept
+	{
+		// The display expects big endian pixels
+		for (size_t i = 0; i < pixels; i++)
+			strip[i] = static_cast<uint16_t>((strip[i] << 8) | (strip[i] >> 8));
+		display.writePixels(gsl::span<const uint8_t>(reinterpret_cast<const uint8_t*>(strip.data()), pixels * 2));
+	}
+
+	SpiDisplay& display;
+	std::array<uint32_t, Rows> dirty = {};
+	std::array<uint16_t, StripPixels> strip;
+};
+
+} // namespace mcu
@@ -0,0 +1,85 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <gsl/span>
+#include "GPIO.h"
+#include "SPI.h"
+
+namespace mcu {
+
+/**
+ * @brief Driver for JEDEC compatible SPI NOR flash (W25Q and similar) with 3 byte addresses
+ *
+ * The chip select pin must be configured as output and high.
+ * Small reads are served from a read-ahead cache, larger reads are streamed with fast-read.
+ */
+class SpiNorFlash
+{
+public:
+	struct JedecId {
+		uint8_t manufacturer;
+		uint8_t memoryType;
+		/// Log2 of the size in bytes for most manufacturers
+		uint8_t capacity;
+	};
+
+	static constexpr uint32_t PageSize = 256;
+	static constexpr uint32_t SectorSize = 4096;
+	/// Reads smaller than this are served through the cache
+	static constexpr size_t CacheSize = 32;
+
+	SpiNorFlash(SPI& spi, GPIO chipSelect) noexcept : spi{spi}, chipSelect{chipSelect} {}
+
+	/**
+	 * Reads the JEDEC ID and derives the size of the chip from it
+	 * @return false if no chip answers
+	 */
+	bool identify() noexcept;
+	JedecId jedecId() noexcept;
+	/// @return Size in bytes. Only valid after identify()
+	uint32_t size() const noexcept { return chipSize; }
+
+	void read(uint32_t address, gsl::span<uint8_t> dst) noexcept;
+	/// Programs \p src, split at page boundaries. The area must be erased
+	void write(uint32_t address, gsl::span<const uint8_t> src) noexcept;
+	/**
+	 * Erases [address, address + length) with the fewest, largest possible 4K/32K/64K erase commands
+	 * @param address Must be a multiple of SectorSize
+	 * @param length Must be a multiple of SectorSize
+	 */
+	void erase(uint32_t address, uint32_t length) noexcept;
+	void eraseChip() noexcept;
+
+	bool busy() noexcept;
+	void waitReady() noexcept;
+
+private:
+	enum Command : uint8_t {
+		WriteEnable = 0x06,
+		ReadStatus = 0x05,
+		PageProgram = 0x02,
+		FastRead = 0x0b,
+		Erase4K = 0x20,
+		Erase32K = 0x52,
+		Erase64K = 0xd8,
+		ChipErase = 0xc7,
+		ReadJedecId = 0x9f
+	};
+	static constexpr uint8_t StatusBusy = 0x01;
+
+	void command(uint8_t cmd) noexcept;
+	/// Selects the chip and sends \p cmd followed by \p address. The caller must deselect the chip
+	void beginAddressed(uint8_t cmd, uint32_t address) noexcept;
+	void fastRead(uint32_t address, gsl::span<uint8_t> dst) noexcept;
+	void invalidateCache(uint32_t address, uint32_t length) noexcept;
+
+	SPI& spi;
+	GPIO chipSelect;
+	uint32_t chipSize = 0;
+
+	std::array<uint8_t, CacheSize> cache;
+	uint32_t cacheAddress = 0;
+	uint32_t cacheLength = 0;
+};
+
+} // namespace mcu
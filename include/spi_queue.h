@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "clocks.h"
+#include "GPIO.h"
+#include "ring_buffer.h"
+#include "utils.h"
+
+namespace mcu {
+
+/**
+ * One transfer on a shared SPI bus. Must stay valid until the callback was called.
+ * tx and rx may differ in size: missing tx bytes are sent as 0xff, surplus rx bytes are discarded.
+ */
+struct SpiTransaction {
+	/// Driven low for the duration of the transaction. Must already be configured as output and high
+	GPIO chipSelect;
+	/// Bits per second
+	uint32_t baud;
+	/// SPI Mode 0, 1, 2 or 3
+	uint8_t mode = 0;
+	bool lsbFirst = false;
+	gsl::span<const uint8_t> tx = {};
+	gsl::span<uint8_t> rx = {};
+	/// Called from the interrupt after chip select was released. May enqueue further transactions
+	void (*callback)(SpiTransaction& transaction, void* context) = nullptr;
+	void* context = nullptr;
+
+	/// SysTick cycles from enqueue() to completion, see util::sysTickTimestamp()
+	uint32_t latency = 0;
+
+	// Set by SpiQueue::enqueue
+	uint32_t ctrla = 0;
+	uint8_t baudRegister = 0;
+	uint32_t enqueueTime = 0;
+};
+
+struct SpiQueueStatistics {
+	volatile uint32_t completed = 0;
+	/// Number of times CTRLA/BAUD had to be rewritten because the device changed
+	volatile uint32_t reconfigurations = 0;
+	/// Highest number of pending transactions including the active one
+	volatile uint32_t maxDepth = 0;
+	/// Completion latencies in SysTick cycles
+	volatile uint32_t lastLatency = 0;
+	volatile uint32_t maxLatency = 0;
+};
+
+/**
+ * @brief Interrupt driven SPI master running a queue of transactions
+ *
+ * Transactions are executed back to back from the Sercom interrupt, chip select is handled automatically.
+ * The Sercom is only reconfigured when mode, bit order or baud rate differ from the previous transaction.
+ * SysTick must be running and SysTick_Handler must call util::countSysTick() for the latency statistics.
+ * Call SpiQueue::interrupt in the SERCOMx interrupt Handler
+ *
+ * @tparam Depth Maximum number of pending transactions. Must be a power of two
+ */
+template <size_t Depth>
+class SpiQueue {
+public:
+	/**
+	 * @param sercom The Sercom interface to use
+	 * @param clkGen ClockGenerator for generating the Baud clock. Must be at least 2 * the highest baud rate
+	 * @param pinLayout a combination of SERCOM_SPI_CTRLA_DOPO and SERCOM_SPI_CTRLA_DIPO to set the pinLayout
+	 */
+	SpiQueue(
+		Sercom* sercom, const ClockGenerator& clkGen,
+		uint32_t pinLayout = SERCOM_SPI_CTRLA_DOPO(0) | SERCOM_SPI_CTRLA_DIPO(2)
+	)
+		: sercom{sercom}, clockFrequency{clkGen.frequency},
+		  pinLayout{pinLayout & (SERCOM_SPI_CTRLA_DOPO_Msk | SERCOM_SPI_CTRLA_DIPO_Msk)}
+	{
+		unsigned sercomIndex = util::getSercomIndex(sercom);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
+		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+
+		sercom->SPI.CTRLB.reg = SERCOM_SPI_CTRLB_RXEN | SERCOM_SPI_CTRLB_CHSIZE(0);
+		auto irq = static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + sercomIndex);
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+	}
+
+	/**
+	 * Queues \p transaction. Starts it immediately if the bus is idle.
+	 * May be called from any context including the completion callback
+	 * @return false if the queue is full
+	 */
+	bool enqueue(SpiTransaction& transaction) noexcept
+	{
+		transaction.ctrla = SERCOM_SPI_CTRLA_MODE_SPI_MASTER | pinLayout | SERCOM_SPI_CTRLA_FORM_SPI
+			| (static_cast<uint32_t>(transaction.mode) << SERCOM_SPI_CTRLA_CPHA_Pos)
+			| (static_cast<uint32_t>(transaction.lsbFirst) << SERCOM_SPI_CTRLA_DORD_Pos);
+		// Rounded up, so SCK never exceeds the requested baud rate. Without asserts a too low rate gives the slowest SCK
+		assert(transaction.baud != 0);
+		const uint32_t divider = (clockFrequency + 2 * transaction.baud - 1) / (2 * transaction.baud);
+		assert(divider - 1 <= 0xff);
+		transaction.baudRegister = static_cast<uint8_t>(std::min<uint32_t>(divider - 1, 0xff));
+		transaction.enqueueTime = util::sysTickTimestamp();
+
+		const uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		const bool queued = pendingQueue.push(&transaction);
+		if (queued) {
+			const uint32_t depth = pending();
+			if (depth > stats.maxDepth)
+				stats.maxDepth = depth;
+			if (current == nullptr)
+				startNext();
+		}
+		__set_PRIMASK(primask);
+		return queued;
+	}
+
+	/// @return Number of queued transactions including the active one
+	size_t pending() const noexcept { return pendingQueue.size() + (current != nullptr); }
+	bool idle() const noexcept { return current == nullptr; }
+	const SpiQueueStatistics& statistics() const noexcept { return stats; }
+
+	/**
+	 * Call in the Sercom Interrupt handler
+	 */
+	void interrupt() noexcept
+	{
+		SpiTransaction* const transaction = current;
+		if (transaction == nullptr)
+			return;
+
+		SercomSpi& spi = sercom->SPI;
+		if (spi.INTFLAG.bit.RXC) {
+			const uint8_t data = spi.DATA.reg;
+			if (received < static_cast<size_t>(transaction->rx.size()))
+				transaction->rx[received] = data;
+			received++;
+			// The window has room again
+			if (sent < length)
+				spi.INTENSET.reg = SERCOM_SPI_INTENSET_DRE;
+		}
+		// At most two bytes in flight, so the receive buffer cannot overflow
+		if (sent < length && sent - received < 2 && spi.INTFLAG.bit.DRE) {
+			spi.DATA.reg = sent < static_cast<size_t>(transaction->tx.size()) ? transaction->tx[sent] : 0xff;
+			sent++;
+			// DRE stays set while the window is full, it would interrupt continuously until the next RXC
+			if (sent == length || sent - received == 2)
+				spi.INTENCLR.reg = SERCOM_SPI_INTENCLR_DRE;
+		}
+		if (received == length)
+			complete();
+	}
+
+private:
+	/// Starts the next transaction or disables the interrupts if none is left. Interrupts must be disabled
+	void startNext() noexcept
+	{
+		SercomSpi& spi = sercom->SPI;
+		SpiTransaction* next;
+		while (pendingQueue.pop(next)) {
+			current = next;
+			if (current->ctrla != activeCtrla || current->baudRegister != activeBaud) {
+				spi.CTRLA.bit.ENABLE = false;
+				while (spi.STATUS.bit.SYNCBUSY);
+				spi.CTRLA.reg = current->ctrla;
+				spi.BAUD.reg = current->baudRegister;
+				while (spi.STATUS.bit.SYNCBUSY);
+				spi.CTRLA.bit.ENABLE = true;
+				activeCtrla = current->ctrla;
+				activeBaud = current->baudRegister;
+				stats.reconfigurations = stats.reconfigurations + 1;
+			}
+
+			length = std::max(static_cast<size_t>(current->tx.size()), static_cast<size_t>(current->rx.size()));
+			sent = 0;
+			received = 0;
+			current->chipSelect.setLow();
+			if (length != 0) {
+				spi.INTENSET.reg = SERCOM_SPI_INTENSET_DRE | SERCOM_SPI_INTENSET_RXC;
+				return;
+			}
+			finish();
+		}
+		current = nullptr;
+		spi.INTENCLR.reg = SERCOM_SPI_INTENCLR_DRE | SERCOM_SPI_INTENCLR_RXC;
+	}
+
+	void complete() noexcept
+	{
+		sercom->SPI.INTENCLR.reg = SERCOM_SPI_INTENCLR_RXC;
+		const uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		finish();
+		startNext();
+		__set_PRIMASK(primask);
+	}
+
+	/// Releases chip select, records the statistics and calls the callback of the active transaction
+	void finish() noexcept
+	{
+		SpiTransaction& transaction = *current;
+		transaction.chipSelect.setHigh();
+		transaction.latency = util::sysTickTimestamp() - transaction.enqueueTime;
+		stats.completed = stats.completed + 1;
+		stats.lastLatency = transaction.latency;
+		if (transaction.latency > stats.maxLatency)
+			stats.maxLatency = transaction.latency;
+		if (transaction.callback != nullptr)
+			transaction.callback(transaction, transaction.context);
+	}
+
+	Sercom* const sercom;
+	const uint32_t clockFrequency;
+	const uint32_t pinLayout;
+	RingBuffer<SpiTransaction*, Depth> pendingQueue;
+	SpiTransaction* volatile current = nullptr;
+	size_t length = 0;
+	size_t sent = 0;
+	size_t received = 0;
+	uint32_t activeCtrla = 0;
+	uint8_t activeBaud = 0;
+	SpiQueueStatistics stats;
+};
+
+} // namespace mcu
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "clocks.h"
+#include "utils.h"
+
+namespace mcu {
+
+/// Hardware address recognition of SpiSlave. The first byte of every frame is compared to the address
+struct SpiAddressMatch {
+	uint8_t address;
+	/// Meaning depends on mode: bit mask, second address or lower limit of the range
+	uint8_t addressMask = 0;
+	/// One of SERCOM_SPI_CTRLB_AMODE_*_Val
+	uint8_t mode = SERCOM_SPI_CTRLB_AMODE_MASK_Val;
+};
+
+struct SpiSlaveStatistics {
+	/// Frames ended by the host releasing slave select
+	volatile uint32_t frames = 0;
+	/// Received bytes lost because the interrupt did not read DATA in time
+	volatile uint32_t overflows = 0;
+	/// Received bytes that did not fit into the receive buffer
+	volatile uint32_t truncated = 0;
+};
+
+/**
+ * @brief Interrupt driven SPI slave serving a double buffered register image
+ *
+ * Every frame the host reads the image from the start. The first byte behind its end is 0xff, later ones are undefined.
+ * The first byte is preloaded (PLOADEN) so it goes out on the first SCK edge without interrupt latency.
+ * Bytes written by the host are collected and passed to the frame callback when slave select goes high.
+ * The transmit path only refills DATA on DRE, one byte ahead of the shift register,
+ * so a byte may take up to one byte time of interrupt latency before the host underruns it.
+ * The host must keep slave select high for a few GCLK cycles between frames, the buffers are reset there.
+ *
+ * Call SpiSlave::interrupt in the SERCOMx interrupt Handler
+ *
+ * @tparam ImageSize Size of the transmitted register image in bytes
+ * @tparam RxSize Maximum number of received bytes per frame
+ */
+template <size_t ImageSize, size_t RxSize = ImageSize>
+class SpiSlave {
+public:
+	/**
+	 * @param sercom The Sercom interface to use
+	 * @param clkGen ClockGenerator clocking the Sercom. Must be faster than SCK
+	 * @param mode SPI Mode 0, 1, 2 or 3
+	 * @param lsbFirst If true LSB is transmitted first
+	 * @param pinLayout a combination of SERCOM_SPI_CTRLA_DOPO and SERCOM_SPI_CTRLA_DIPO to set the pinLayout
+	 */
+	SpiSlave(
+		Sercom* sercom, const ClockGenerator& clkGen,
+		unsigned mode = 0, bool lsbFirst = false,
+		uint32_t pinLayout = SERCOM_SPI_CTRLA_DOPO(0) | SERCOM_SPI_CTRLA_DIPO(2)
+	)
+		: sercom{sercom}
+	{
+		init(clkGen, mode, lsbFirst, pinLayout, nullptr);
+	}
+
+	/**
+	 * Like above, but frames whose first byte does not match \p addressMatch are ignored in hardware
+	 * and do not cause any interrupt. The address byte is not passed to the frame callback.
+	 */
+	SpiSlave(
+		Sercom* sercom, const ClockGenerator& clkGen, const SpiAddressMatch& addressMatch,
+		unsigned mode = 0, bool lsbFirst = false,
+		uint32_t pinLayout = SERCOM_SPI_CTRLA_DOPO(0) | SERCOM_SPI_CTRLA_DIPO(2)
+	)
+		: sercom{sercom}, addressMode{true}
+	{
+		init(clkGen, mode, lsbFirst, pinLayout, &addressMatch);
+	}
+
+	/**
+	 * @return The image that is not being transmitted. Fill it and call publish().
+	 *         Must not be modified while isPublishing() is true
+	 */
+	gsl::span<uint8_t, ImageSize> backImage() noexcept { return images[activeImage ^ 1]; }
+
+	/// Transmits the back image starting with the next frame, a running frame is not torn
+	void publish() noexcept { publishPending = true; }
+
+	/// @return true while a published image waits for the end of the running frame
+	bool isPublishing() const noexcept { return publishPending; }
+
+	const SpiSlaveStatistics& statistics() const noexcept { return stats; }
+
+	/**
+	 * Call in the Sercom Interrupt handler
+	 * @param onFrame Callable that gets called when slave select goes high. Signature: void onFrame(gsl::span<const uint8_t> received)
+	 */
+	template <typename Fun>
+	void interrupt(Fun onFrame)
+	{
+		SercomSpi& spi = sercom->SPI;
+		const uint8_t flags = spi.INTFLAG.reg & spi.INTENSET.reg;
+		// Transmit first, it has the tighter deadline
+		if (flags & SERCOM_SPI_INTFLAG_DRE) {
+			if (txIndex < ImageSize) {
+				spi.DATA.reg = images[activeImage][txIndex++];
+			} else {
+				spi.DATA.reg = 0xff;
+				spi.INTENCLR.reg = SERCOM_SPI_INTENCLR_DRE;
+			}
+		}
+		if (flags & SERCOM_SPI_INTFLAG_RXC) {
+			if (spi.STATUS.bit.BUFOVF) {
+				spi.STATUS.reg = SERCOM_SPI_STATUS_BUFOVF;
+				stats.overflows = stats.overflows + 1;
+			}
+			const uint8_t data = spi.DATA.reg;
+			if (skipAddress)
+				skipAddress = false;
+			else if (rxIndex < RxSize)
+				rxBuffer[rxIndex++] = data;
+			else
+				stats.truncated = stats.truncated + 1;
+		}
+		// TXC is set when slave select goes high
+		if (flags & SERCOM_SPI_INTFLAG_TXC) {
+			spi.INTFLAG.reg = SERCOM_SPI_INTFLAG_TXC;
+			// Bytes still in DATA or RX buffer belong to the finished frame
+			while (spi.INTFLAG.bit.RXC) {
+				const uint8_t data = spi.DATA.reg;
+				if (!skipAddress && rxIndex < RxSize)
+					rxBuffer[rxIndex++] = data;
+			}
+			stats.frames = stats.frames + 1;
+			const size_t received = rxIndex;
+			restart();
+			onFrame(gsl::span<const uint8_t>(rxBuffer.data(), received));
+		}
+	}
+
+private:
+	void init(const ClockGenerator& clkGen, unsigned mode, bool lsbFirst, uint32_t pinLayout, const SpiAddressMatch* addressMatch)
+	{
+		unsigned sercomIndex = util::getSercomIndex(sercom);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
+		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+
+		sercom->SPI.CTRLA.reg = SERCOM_SPI_CTRLA_MODE_SPI_SLAVE
+			| (pinLayout & (SERCOM_SPI_CTRLA_DOPO_Msk | SERCOM_SPI_CTRLA_DIPO_Msk))
+			| (addressMatch ? SERCOM_SPI_CTRLA_FORM_SPI_ADDR : SERCOM_SPI_CTRLA_FORM_SPI)
+			| (mode << SERCOM_SPI_CTRLA_CPHA_Pos)
+			| (lsbFirst << SERCOM_SPI_CTRLA_DORD_Pos);
+		sercom->SPI.CTRLB.reg = SERCOM_SPI_CTRLB_RXEN | SERCOM_SPI_CTRLB_PLOADEN | SERCOM_SPI_CTRLB_CHSIZE(0)
+			| (addressMatch ? SERCOM_SPI_CTRLB_AMODE(addressMatch->mode) : 0);
+		if (addressMatch)
+			sercom->SPI.ADDR.reg = SERCOM_SPI_ADDR_ADDR(addressMatch->address) | SERCOM_SPI_ADDR_ADDRMASK(addressMatch->addressMask);
+		sercom->SPI.INTENSET.reg = SERCOM_SPI_INTENSET_RXC | SERCOM_SPI_INTENSET_TXC;
+		auto irq = static_cast<IRQn_Type>(static_cast<unsigned>(SERCOM0_IRQn) + sercomIndex);
+		NVIC_ClearPendingIRQ(irq);
+		NVIC_EnableIRQ(irq);
+		restart();
+	}
+
+	/// Flushes the stale transmit bytes of the last frame and preloads the start of the image
+	void restart() noexcept
+	{
+		SercomSpi& spi = sercom->SPI;
+		spi.CTRLA.bit.ENABLE = false;
+		while (spi.STATUS.bit.SYNCBUSY);
+		if (publishPending) {
+			activeImage ^= 1;
+			publishPending = false;
+		}
+		spi.CTRLA.bit.ENABLE = true;
+		while (spi.STATUS.bit.SYNCBUSY);
+
+		// Preloaded into the shift register while idle, the next byte is written on DRE
+		spi.DATA.reg = images[activeImage][0];
+		txIndex = 1;
+		rxIndex = 0;
+		skipAddress = addressMode;
+		spi.INTENSET.reg = SERCOM_SPI_INTENSET_DRE;
+	}
+
+	static_assert(ImageSize > 0, "The image needs at least one byte");
+
+	Sercom* const sercom;
+	std::array<uint8_t, ImageSize> images[2] = {};
+	std::array<uint8_t, RxSize> rxBuffer;
+	volatile uint8_t activeImage = 0;
+	volatile bool publishPending = false;
+	const bool addressMode = false;
+	bool skipAddress = false;
+	size_t txIndex = 0;
+	size_t rxIndex = 0;
+	SpiSlaveStatistics stats;
+};
+
+} // namespace mcu
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <cstddef>
 #include <sam.h>
@@ -13,19 +14,49 @@ public:
 	UART(Sercom* port, const ClockGenerator& clkGen, unsigned baudRate, uint32_t pinLayout) noexcept
 		:sercom(port->USART)
 	{
-		unsigned sercomIndex = util::getSercomIndex(port);
-		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
-		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+		init(port, clkGen, computeBaud(clkGen.frequency, baudRate), pinLayout);
+	}
 
-		while (sercom.STATUS.bit.SYNCBUSY);
-		sercom.CTRLA.reg = SERCOM_USART_CTRLA_MODE_USART_INT_CLK | SERCOM_USART_CTRLA_FORM_0 | SERCOM_USART_CTRLA_DORD | pinLayout;
-		sercom.CTRLB.reg = SERCOM_USART_CTRLB_CHSIZE(0) | SERCOM_USART_CTRLB_TXEN | SERCOM_USART_CTRLB_RXEN;
-		sercom.BAUD.reg = 65536 - (65536ULL * 16 * baudRate) / clkGen.frequency;
-		sercom.INTENSET.reg = SERCOM_USART_INTENSET_RXC;
-		while (sercom.STATUS.bit.SYNCBUSY);
-		sercom.CTRLA.bit.ENABLE = 1;
+	/**
+	 * Uses a configuration computed at compile time, so no division is needed at runtime
+	 * @param clkGen Must run at Config::clockFrequency
+	 * @param config A UartConfig
+	 */
+	template <typename Config>
+	UART(Sercom* port, const ClockGenerator& clkGen, Config config) noexcept
+		:sercom(port->USART)
+	{
+		(void)config;
+		assert(clkGen.frequency == Config::clockFrequency);
+		init(port, clkGen, Config::baud, Config::pinLayout);
+	}
+
+	/// @return BAUD register value for asynchronous arithmetic mode with 16x oversampling
+	static constexpr uint16_t computeBaud(unsigned clockFrequency, unsigned baudRate)
+	{
+		return 65536 - (65536ULL * 16 * baudRate) / clockFrequency;
 	}
 
+	/// @return Deviation of the real baud rate for the register value \p baud from \p baudRate in ppm
+	static constexpr unsigned baudErrorPpm(unsigned clockFrequency, unsigned baudRate, uint16_t baud)
+	{
+		// f = fref / 16 * (1 - BAUD / 65536)
+		const unsigned long long actualTimes65536x16 = static_cast<unsigned long long>(clockFrequency) * (65536 - baud);
+		const unsigned long long desiredTimes65536x16 = 65536ULL * 16 * baudRate;
+		const unsigned long long diff = actualTimes65536x16 > desiredTimes65536x16
+			? actualTimes65536x16 - desiredTimes65536x16
+			: desiredTimes65536x16 - actualTimes65536x16;
+		return diff * 1000000 / desiredTimes65536x16;
+	}
+
+	/**
+	 * Wraps an already configured USART register block without touching clocks or configuration.
+	 * Useful if a bootloader set up the port, or to run against a simulated register block on the host.
+	 */
+	explicit UART(SercomUsart& usart) noexcept
+		:sercom(usart)
+	{}
+
 	void transmit(std::byte data) noexcept
 	{
 		while (!sercom.INTFLAG.bit.DRE);
@@ -40,8 +71,44 @@ public:
 		}
 	}
 
-private:
+protected:
 	SercomUsart& sercom;
+
+private:
+	void init(Sercom* port, const ClockGenerator& clkGen, uint16_t baud, uint32_t pinLayout) noexcept
+	{
+		unsigned sercomIndex = util::getSercomIndex(port);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
+		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+
+		while (sercom.STATUS.bit.SYNCBUSY);
+		sercom.CTRLA.reg = SERCOM_USART_CTRLA_MODE_USART_INT_CLK | SERCOM_USART_CTRLA_FORM_0 | SERCOM_USART_CTRLA_DORD | pinLayout;
+		sercom.CTRLB.reg = SERCOM_USART_CTRLB_CHSIZE(0) | SERCOM_USART_CTRLB_TXEN | SERCOM_USART_CTRLB_RXEN;
+		sercom.BAUD.reg = baud;
+		sercom.INTENSET.reg = SERCOM_USART_INTENSET_RXC;
+		while (sercom.STATUS.bit.SYNCBUSY);
+		sercom.CTRLA.bit.ENABLE = 1;
+	}
+};
+
+/**
+ * Compile time UART configuration
+ * @tparam ClockFrequency Frequency of the ClockGenerator in Hz
+ * @tparam BaudRate Baud rate in bits per second
+ * @tparam PinLayout A combination of SERCOM_USART_CTRLA_TXPO and SERCOM_USART_CTRLA_RXPO
+ * @tparam MaxErrorPpm Maximum allowed deviation of the real baud rate in ppm
+ */
+template <unsigned ClockFrequency, unsigned BaudRate, uint32_t PinLayout, unsigned MaxErrorPpm = 10000>
+struct UartConfig {
+	static_assert(16ULL * BaudRate <= ClockFrequency, "Clock must be at least 16 times the baud rate");
+
+	static constexpr unsigned clockFrequency = ClockFrequency;
+	static constexpr unsigned baudRate = BaudRate;
+	static constexpr uint32_t pinLayout = PinLayout;
+	static constexpr uint16_t baud = UART::computeBaud(ClockFrequency, BaudRate);
+	static constexpr unsigned errorPpm = UART::baudErrorPpm(ClockFrequency, BaudRate, baud);
+
+	static_assert(errorPpm <= MaxErrorPpm, "Baud rate error exceeds tolerance");
 };
 
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <gsl/span>
+#include <sam.h>
+#include "clocks.h"
+#include "sercom_transfer.h"
+#include "utils.h"
+
+namespace mcu {
+
+/**
+ * @brief Synchronous USART master (CMODE) with transfer functions named like those of SPI
+ *
+ * The master drives XCK, TXD and RXD act as MOSI and MISO, chip select is handled by the caller.
+ * This is not a replacement for SPI on an SPI bus:
+ * - Every character is framed by a start and a stop bit, so the peer must use synchronous USART framing.
+ *   Ordinary SPI devices see 10 bit words and get out of step.
+ * - A byte takes ClocksPerByte XCK cycles, the throughput is at most baud / 10 bytes per second,
+ *   80% of SPI at the same clock.
+ * - Data changes on the rising XCK edge and is sampled on the falling edge, inverted with \p invertClock.
+ *   This corresponds to SPI modes 1 and 3, modes 0 and 2 are not available.
+ */
+class UsartSPI {
+public:
+	/// XCK cycles per byte: start bit, 8 data bits and stop bit
+	static constexpr unsigned ClocksPerByte = 10;
+
+	/**
+	 * @param sercom The Sercom interface to use
+	 * @param baud XCK frequency in Hz
+	 * @param clkGen ClockGenerator for generating XCK. Must be at least 2 * baud
+	 * @param invertClock Sets CPOL: data changes on the falling edge and is sampled on the rising edge
+	 * @param lsbFirst If true LSB is transmitted first
+	 * @param pinLayout A combination of SERCOM_USART_CTRLA_TXPO (selects TXD and XCK pad) and SERCOM_USART_CTRLA_RXPO
+	 */
+	UsartSPI(
+		Sercom* sercom, unsigned baud, const ClockGenerator& clkGen,
+		bool invertClock = false, bool lsbFirst = false,
+		uint32_t pinLayout = SERCOM_USART_CTRLA_TXPO_PAD0 | SERCOM_USART_CTRLA_RXPO_PAD2
+	)
+		: usart{sercom->USART}
+	{
+		unsigned sercomIndex = util::getSercomIndex(sercom);
+		PM->APBCMASK.reg |= 1 << (PM_APBCMASK_SERCOM0_Pos + sercomIndex);
+		clkGen.routeToPeripheral(GCLK_CLKCTRL_ID_SERCOM0_CORE_Val + sercomIndex);
+
+		while (usart.STATUS.bit.SYNCBUSY);
+		usart.CTRLA.reg = SERCOM_USART_CTRLA_MODE_USART_INT_CLK
+			| SERCOM_USART_CTRLA_CMODE
+			| SERCOM_USART_CTRLA_FORM(0)
+			| (pinLayout & (SERCOM_USART_CTRLA_TXPO | SERCOM_USART_CTRLA_RXPO_Msk))
+			| (invertClock << SERCOM_USART_CTRLA_CPOL_Pos)
+			| (lsbFirst << SERCOM_USART_CTRLA_DORD_Pos);
+		usart.CTRLB.reg = SERCOM_USART_CTRLB_CHSIZE(0) | SERCOM_USART_CTRLB_TXEN | SERCOM_USART_CTRLB_RXEN;
+		// Synchronous mode uses the same divider as SPI
+		usart.BAUD.reg = clkGen.frequency / (2 * baud) - 1;
+		while (usart.STATUS.bit.SYNCBUSY);
+		usart.CTRLA.bit.ENABLE = true;
+	}
+
+	/**
+	 * Synchronously sends and receives a byte
+	 * @param data Data to send
+	 * @return Received data
+	 */
+	uint8_t transfer(uint8_t data) const
+	{
+		usart.DATA.reg = data;
+		while (!usart.INTFLAG.bit.RXC);
+		return usart.DATA.reg;
+	}
+
+	/**
+	 * Sends \p tx and receives the same number of bytes into \p rx. The next byte is preloaded while one is shifting.
+	 * @param rx At least as large as \p tx, or empty to discard the received bytes
+	 */
+	void transfer(gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx) const
+	{
+		detail::pipelinedTransfer(usart, tx, rx);
+	}
+
+	/// Sends \p tx and discards the received bytes
+	void write(gsl::span<const uint8_t> tx) const
+	{
+		detail::pipelinedWrite(usart, tx, SERCOM_USART_INTFLAG_TXC);
+		detail::discardReceived(usart, SERCOM_USART_STATUS_BUFOVF);
+	}
+
+	/// Receives into \p rx while sending \p dummy
+	void read(gsl::span<uint8_t> rx, uint8_t dummy = 0xff) const
+	{
+		detail::pipelinedRead(usart, rx, dummy);
+	}
+
+private:
+	SercomUsart& usart;
+};
+
+} // namespace mcu
@@ -35,5 +35,48 @@ inline void checkTimerGenerator(unsigned timerIndex, uint8_t requiredGenerator)
 #endif
 }
 
+/// @return Current SysTick counter value. SysTick counts down and must be enabled with a reload value
+inline uint32_t sysTickNow()
+{
+	return SysTick->VAL;
+}
+
+/// @return SysTick cycles between two sysTickNow() values. Only valid for intervals shorter than one SysTick period
+inline uint32_t sysTickElapsed(uint32_t start, uint32_t end)
+{
+	return start >= end ? start - end : start + (SysTick->LOAD + 1) - end;
+}
+
+/// SysTick periods counted by countSysTick()
+inline volatile uint32_t sysTickPeriods = 0;
+
+/// Call in SysTick_Handler when sysTickTimestamp() is used with the default period counter
+inline void countSysTick()
+{
+	sysTickPeriods = sysTickPeriods + 1;
+}
+
+/**
+ * SysTick period count combined with the SysTick counter. Unlike sysTickNow() it does not wrap every period,
+ * so intervals longer than a period are measured correctly. Wraps after 2^32 cycles
+ * @param periods Counter incremented in SysTick_Handler, countSysTick() by default
+ * @return SysTick cycles since start
+ */
+inline uint32_t sysTickTimestamp(const volatile uint32_t& periods = sysTickPeriods)
+{
+	const uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t count = periods;
+	uint32_t value = SysTick->VAL;
+	// SysTick wrapped but its handler did not run yet, e.g. when called from a higher priority interrupt
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		value = SysTick->VAL;
+		count++;
+	}
+	__set_PRIMASK(primask);
+	const uint32_t reload = SysTick->LOAD;
+	return count * (reload + 1) + (reload - value);
+}
+
 } // namespace util
 } // namespace mcu
@@ -0,0 +1,270 @@
+#include "sd_card.h"
+#include <array>
+
+namespace {
+
+// Timeouts are counted in transferred bytes
+constexpr uint32_t BusyTimeout = 1000000;
+constexpr uint32_t TokenTimeout = 400000;
+constexpr unsigned InitTries = 2000;
+constexpr unsigned ResponseTries = 8;
+
+} // namespace
+
+bool mcu::SdCard::init(const ClockGenerator& clkGen, unsigned baud) noexcept
+{
+	blocks = 0;
+	spi.setBaud(InitBaud, clkGen);
+	chipSelect.setHigh();
+	// At least 74 clocks with chip select high to enter SPI mode
+	for (unsigned i = 0; i < 10; i++)
+		spi.transfer(0xff);
+
+	uint8_t r1 = 0xff;
+	for (unsigned i = 0; i < 10 && r1 != R1Idle; i++) {
+		r1 = command(0, 0);
+		deselect();
+	}
+	if (r1 != R1Idle)
+		return false;
+
+	if (useCrc) {
+		r1 = command(59, 1);
+		deselect();
+		if (r1 != R1Idle)
+			return false;
+	}
+
+	// CMD8 is only known to version 2 cards
+	bool version2 = false;
+	r1 = command(8, 0x1aa);
+	if (!(r1 & R1IllegalCommand)) {
+		std::array<uint8_t, 4> r7;
+		spi.read(r7);
+		deselect();
+		if ((r7[2] & 0x0f) != 0x01 || r7[3] != 0xaa)
+			return false;
+		version2 = true;
+	} else {
+		deselect();
+	}
+
+	for (unsigned i = 0; ; i++) {
+		if (i == InitTries)
+			return false;
+		r1 = appCommand(41, version2 ? 1 << 30 : 0);
+		deselect();
+		if (r1 == 0)
+			break;
+	}
+
+	highCapacity = false;
+	if (version2) {
+		std::array<uint8_t, 4> ocr;
+		r1 = command(58, 0);
+		spi.read(ocr);
+		deselect();
+		if (r1 != 0)
+			return false;
+		highCapacity = (ocr[0] & 0x40) != 0;
+	}
+	if (!highCapacity) {
+		r1 = command(16, BlockSize);
+		deselect();
+		if (r1 != 0)
+			return false;
+	}
+
+	spi.setBaud(baud, clkGen);
+	return readCsd();
+}
+
+bool mcu::SdCard::read(uint32_t block, gsl::span<uint8_t> dst) noexcept
+{
+	const uint32_t count = dst.size() / BlockSize;
+	const uint32_t address = highCapacity ? block : block * BlockSize;
+	if (count == 0)
+		return true;
+
+	if (count == 1) {
+		const bool ok = command(17, address) == 0 && receiveBlock(dst.first(BlockSize));
+		deselect();
+		return ok;
+	}
+
+	if (command(18, address) != 0) {
+		deselect();
+		return false;
+	}
+	bool ok = true;
+	for (uint32_t i = 0; i < count && ok; i++)
+		ok = receiveBlock(dst.subspan(i * BlockSize, BlockSize));
+	ok = command(12, 0) == 0 && ok;
+	ok = waitReady() && ok;
+	deselect();
+	return ok;
+}
+
+bool mcu::SdCard::write(uint32_t block, gsl::span<const uint8_t> src) noexcept
+{
+	const uint32_t count = src.size() / BlockSize;
+	const uint32_t address = highCapacity ? block : block * BlockSize;
+	if (count == 0)
+		return true;
+
+	if (count == 1) {
+		const bool ok = command(24, address) == 0 && sendBlock(StartBlock, src.first(BlockSize));
+		deselect();
+		return ok;
+	}
+
+	// Lets the card erase all blocks in advance instead of one by one
+	const uint8_t r1 = appCommand(23, count);
+	deselect();
+	if (r1 != 0 || command(25, address) != 0) {
+		deselect();
+		return false;
+	}
+	bool ok = true;
+	for (uint32_t i = 0; i < count && ok; i++)
+		ok = sendBlock(StartMultiWrite, src.subspan(i * BlockSize, BlockSize));
+	spi.transfer(StopMultiWrite);
+	spi.transfer(0xff);
+	ok = waitReady() && ok;
+	deselect();
+	return ok;
+}
+
+uint8_t mcu::SdCard::crc7(gsl::span<const uint8_t> data) noexcept
+{
+	uint8_t crc = 0;
+	for (uint8_t byte : data) {
+		for (unsigned i = 0; i < 8; i++) {
+			crc <<= 1;
+			if ((byte ^ crc) & 0x80)
+				crc ^= 0x09;
+			byte <<= 1;
+		}
+	}
+	return (crc << 1) | 1;
+}
+
+uint16_t mcu::SdCard::crc16(gsl::span<const uint8_t> data) noexcept
+{
+	// Bytewise CCITT without table
+	uint16_t crc = 0;
+	for (uint8_t byte : data) {
+		crc = static_cast<uint16_t>((crc >> 8) | (crc << 8));
+		crc ^= byte;
+		crc ^= (crc & 0xff) >> 4;
+		crc ^= crc << 12;
+		crc ^= (crc & 0xff) << 5;
+	}
+	return crc;
+}
+
+uint8_t mcu::SdCard::command(uint8_t index, uint32_t argument) noexcept
+{
+	chipSelect.setLow();
+	// CMD12 interrupts a running data transfer, CMD0 is sent before the card is initialized
+	if (index != 0 && index != 12 && !waitReady())
+		return 0xff;
+
+	std::array<uint8_t, 6> frame = {
+		static_cast<uint8_t>(0x40 | index),
+		static_cast<uint8_t>(argument >> 24), static_cast<uint8_t>(argument >> 16),
+		static_cast<uint8_t>(argument >> 8), static_cast<uint8_t>(argument),
+		0x01
+	};
+	// CMD0 and CMD8 are always checked, even with CRC disabled
+	if (useCrc || index == 0 || index == 8)
+		frame[5] = crc7(gsl::span<const uint8_t>(frame.data(), 5));
+	spi.write(frame);
+
+	if (index == 12)
+		spi.transfer(0xff);
+	uint8_t r1 = 0xff;
+	for (unsigned i = 0; i < ResponseTries && (r1 & 0x80); i++)
+		r1 = spi.transfer(0xff);
+	return r1;
+}
+
+uint8_t mcu::SdCard::appCommand(uint8_t index, uint32_t argument) noexcept
+{
+	command(55, 0);
+	deselect();
+	return command(index, argument);
+}
+
+void mcu::SdCard::deselect() noexcept
+{
+	chipSelect.setHigh();
+	// The card releases MISO with the next clock
+	spi.transfer(0xff);
+}
+
+bool mcu::SdCard::waitReady() noexcept
+{
+	for (uint32_t i = 0; i < BusyTimeout; i++) {
+		if (spi.transfer(0xff) == 0xff)
+			return true;
+	}
+	return false;
+}
+
+bool mcu::SdCard::waitToken(uint8_t token) noexcept
+{
+	for (uint32_t i = 0; i < TokenTimeout; i++) {
+		const uint8_t data = spi.transfer(0xff);
+		if (data == token)
+			return true;
+		// Error token
+		if (data != 0xff)
+			return false;
+	}
+	return false;
+}
+
+bool mcu::SdCard::receiveBlock(gsl::span<uint8_t> dst) noexcept
+{
+	if (!waitToken(StartBlock))
+		return false;
+	spi.read(dst);
+	std::array<uint8_t, 2> crc;
+	spi.read(crc);
+	return !useCrc || crc16(dst) == ((crc[0] << 8) | crc[1]);
+}
+
+bool mcu::SdCard::sendBlock(uint8_t token, gsl::span<const uint8_t> src) noexcept
+{
+	const uint16_t crc = useCrc ? crc16(src) : 0xffff;
+	// Nwr: the card needs at least one byte between its response and the data token
+	spi.transfer(0xff);
+	spi.transfer(token);
+	spi.write(src);
+	spi.transfer(crc >> 8);
+	spi.transfer(crc);
+	if ((spi.transfer(0xff) & 0x1f) != DataAccepted)
+		return false;
+	return waitReady();
+}
+
+bool mcu::SdCard::readCsd() noexcept
+{
+	std::array<uint8_t, 16> csd;
+	const bool ok = command(9, 0) == 0 && receiveBlock(csd);
+	deselect();
+	if (!ok)
+		return false;
+
+	if ((csd[0] >> 6) == 1) {
+		const uint32_t cSize = ((csd[7] & 0x3f) << 16) | (csd[8] << 8) | csd[9];
+		blocks = (cSize + 1) * 1024;
+	} else {
+		const uint32_t readBlockLength = csd[5] & 0x0f;
+		const uint32_t cSize = ((csd[6] & 0x03) << 10) | (csd[7] << 2) | (csd[8] >> 6);
+		const uint32_t cSizeMult = ((csd[9] & 0x03) << 1) | (csd[10] >> 7);
+		blocks = (cSize + 1) << (cSizeMult + 2 + readBlockLength - 9);
+	}
+	return true;
+}
@@ -0,0 +1,140 @@
+#include "spi_nor_flash.h"
+#include <algorithm>
+
+mcu::SpiNorFlash::JedecId mcu::SpiNorFlash::jedecId() noexcept
+{
+	std::array<uint8_t, 3> id;
+	chipSelect.setLow();
+	spi.transfer(ReadJedecId);
+	spi.read(id);
+	chipSelect.setHigh();
+	return JedecId{id[0], id[1], id[2]};
+}
+
+bool mcu::SpiNorFlash::identify() noexcept
+{
+	const JedecId id = jedecId();
+	if (id.manufacturer == 0x00 || id.manufacturer == 0xff || id.capacity < 16 || id.capacity > 31) {
+		chipSize = 0;
+		return false;
+	}
+	// Only the lower 16MiB are reachable with 3 byte addresses
+	chipSize = uint32_t{1} << std::min<uint8_t>(id.capacity, 24);
+	cacheLength = 0;
+	return true;
+}
+
+void mcu::SpiNorFlash::read(uint32_t address, gsl::span<uint8_t> dst) noexcept
+{
+	const uint32_t length = dst.size();
+	if (length >= CacheSize) {
+		fastRead(address, dst);
+		return;
+	}
+
+	if (address < cacheAddress || address + length > cacheAddress + cacheLength) {
+		// Sequential small reads continue in the cache
+		cacheAddress = address;
+		const uint32_t available = chipSize > address ? chipSize - address : 0;
+		cacheLength = std::max(length, std::min<uint32_t>(CacheSize, available));
+		fastRead(cacheAddress, gsl::span<uint8_t>(cache.data(), cacheLength));
+	}
+	const uint8_t* src = cache.data() + (address - cacheAddress);
+	std::copy(src, src + length, dst.begin());
+}
+
+void mcu::SpiNorFlash::write(uint32_t address, gsl::span<const uint8_t> src) noexcept
+{
+	invalidateCache(address, src.size());
+	while (!src.empty()) {
+		const uint32_t chunkSize = std::min<uint32_t>(PageSize - (address & (PageSize - 1)), src.size());
+		command(WriteEnable);
+		beginAddressed(PageProgram, address);
+		spi.write(src.first(chunkSize));
+		chipSelect.setHigh();
+		waitReady();
+
+		address += chunkSize;
+		src = src.subspan(chunkSize);
+	}
+}
+
+void mcu::SpiNorFlash::erase(uint32_t address, uint32_t length) noexcept
+{
+	invalidateCache(address, length);
+	const uint32_t end = address + length;
+	while (address < end) {
+		// Larger blocks always erase faster per byte, so greedily take the largest aligned one that fits
+		uint8_t cmd = Erase4K;
+		uint32_t blockSize = SectorSize;
+		if ((address & 0xffff) == 0 && end - address >= 0x10000) {
+			cmd = Erase64K;
+			blockSize = 0x10000;
+		} else if ((address & 0x7fff) == 0 && end - address >= 0x8000) {
+			cmd = Erase32K;
+			blockSize = 0x8000;
+		}
+		command(WriteEnable);
+		beginAddressed(cmd, address);
+		chipSelect.setHigh();
+		waitReady();
+		address += blockSize;
+	}
+}
+
+void mcu::SpiNorFlash::eraseChip() noexcept
+{
+	cacheLength = 0;
+	command(WriteEnable);
+	command(ChipErase);
+	waitReady();
+}
+
+bool mcu::SpiNorFlash::busy() noexcept
+{
+	chipSelect.setLow();
+	spi.transfer(ReadStatus);
+	const uint8_t status = spi.transfer(0xff);
+	chipSelect.setHigh();
+	return (status & StatusBusy) != 0;
+}
+
+void mcu::SpiNorFlash::waitReady() noexcept
+{
+	chipSelect.setLow();
+	spi.transfer(ReadStatus);
+	// The status register is output continuously while the chip stays selected
+	while (spi.transfer(0xff) & StatusBusy);
+	chipSelect.setHigh();
+}
+
+void mcu::SpiNorFlash::command(uint8_t cmd) noexcept
+{
+	chipSelect.setLow();
+	spi.transfer(cmd);
+	chipSelect.setHigh();
+}
+
+void mcu::SpiNorFlash::beginAddressed(uint8_t cmd, uint32_t address) noexcept
+{
+	const std::array<uint8_t, 4> header = {
+		cmd, static_cast<uint8_t>(address >> 16), static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address)
+	};
+	chipSelect.setLow();
+	spi.write(header);
+}
+
+void mcu::SpiNorFlash::fastRead(uint32_t address, gsl::span<uint8_t> dst) noexcept
+{
+	beginAddressed(FastRead, address);
+	// One dummy byte, then the data streams continuously across pages
+	spi.transfer(0xff);
+	spi.read(dst);
+	chipSelect.setHigh();
+}
+
+void mcu::SpiNorFlash::invalidateCache(uint32_t address, uint32_t length) noexcept
+{
+	if (address < cacheAddress + cacheLength && cacheAddress < address + length)
+		cacheLength = 0;
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "binary_log.h"
+#include "check.h"
+
+/*
+ * Checks the record layout and compares the cost of a record with snprintf of the same text.
+ * With two arguments it also writes a BinaryLogger record stream and the text printf produces for the same calls.
+ * log_decoder_test.py decodes the stream with tools/log_decoder.py and compares both.
+ */
+
+// On the device .logstr starts at address 0. Aligning it to 64K makes the low 16 bits of an address its offset here, too
+[[gnu::section(".logstr"), gnu::used]] alignas(65536) static constexpr char logstrStart[] = "";
+
+namespace {
+
+/// Accepts at most \p limit bytes per call, like a nearly full BufferedUART
+struct Transport {
+	size_t write(gsl::span<const std::byte> data)
+	{
+		const size_t accepted = std::min<size_t>(limit, data.size());
+		stream.insert(stream.end(), data.begin(), data.begin() + accepted);
+		return accepted;
+	}
+
+	size_t limit;
+	std::vector<std::byte> stream;
+};
+
+std::string expected;
+
+template <typename... Args>
+void expect(const char* format, Args... args)
+{
+	char text[256];
+	std::snprintf(text, sizeof(text), format, args...);
+	expected += text;
+	expected += '\n';
+}
+
+#define LOG_AND_EXPECT(logger, format, ...) \
+	do { \
+		MCU_LOG(logger, format, ##__VA_ARGS__); \
+		expect(format, ##__VA_ARGS__); \
+	} while (0)
+
+void testRecordLayout()
+{
+	mcu::BinaryLogger<64> logger;
+	Transport transport{64, {}};
+	MCU_LOG(logger, "value=%u", 0x12345678u);
+	logger.flush(transport);
+
+	// [length][format id][argument]
+	CHECK_EQUAL(7u, transport.stream.size());
+	CHECK_EQUAL(6, std::to_integer<int>(transport.stream[0]));
+	CHECK_EQUAL(0x78, std::to_integer<int>(transport.stream[3]));
+	CHECK_EQUAL(0x12, std::to_integer<int>(transport.stream[6]));
+}
+
+void testDroppedRecords()
+{
+	mcu::BinaryLogger<16> logger;
+	for (int i = 0; i < 3; i++)
+		MCU_LOG(logger, "%d", i);
+	// 7 bytes each, the third does not fit
+	CHECK_EQUAL(1u, logger.droppedRecords());
+}
+
+/// Counts the bytes of the flushed records, like a UART that is never full
+struct NullTransport {
+	size_t write(gsl::span<const std::byte> data)
+	{
+		bytes += data.size();
+		return data.size();
+	}
+
+	size_t bytes;
+};
+
+/**
+ * Time and transport bytes of a typical record against snprintf of the same text, which is what printf costs before
+ * the UART sees a byte. Host timings only show the relative cost, the best of several rounds is taken
+ */
+void benchmark()
+{
+	constexpr int Iterations = 100000;
+	constexpr int Rounds = 5;
+	mcu::BinaryLogger<256> logger;
+	NullTransport transport{0};
+	char buffer[64];
+	size_t textBytes = 0;
+
+	using Nanoseconds = std::chrono::duration<double, std::nano>;
+	double logTime = 1e30;
+	double printfTime = 1e30;
+	for (int round = 0; round < Rounds; round++) {
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < Iterations; i++) {
+			MCU_LOG(logger, "adc=%u temp=%d state=%s", static_cast<unsigned>(i & 0xfff), i - 40, "run");
+			logger.flush(transport);
+		}
+		const auto middle = std::chrono::steady_clock::now();
+		for (int i = 0; i < Iterations; i++) {
+			textBytes += std::snprintf(buffer, sizeof(buffer), "adc=%u temp=%d state=%s\n",
+				static_cast<unsigned>(i & 0xfff), i - 40, "run");
+		}
+		const auto end = std::chrono::steady_clock::now();
+		logTime = std::min(logTime, Nanoseconds(middle - start).count() / Iterations);
+		printfTime = std::min(printfTime, Nanoseconds(end - middle).count() / Iterations);
+	}
+
+	const double recordBytes = static_cast<double>(transport.bytes) / (Rounds * Iterations);
+	const double lineBytes = static_cast<double>(textBytes) / (Rounds * Iterations);
+	std::printf("MCU_LOG + flush %.1f ns/record, %.1f bytes; snprintf %.1f ns/line, %.1f bytes\n",
+		logTime, recordBytes, printfTime, lineBytes);
+	CHECK_EQUAL(0u, logger.droppedRecords());
+	CHECK(logTime < printfTime);
+	CHECK(recordBytes < lineBytes);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	testRecordLayout();
+	testDroppedRecords();
+	benchmark();
+	if (argc == 1)
+		return check::result();
+	if (argc != 3) {
+		std::fprintf(stderr, "Usage: %s [records.bin expected.txt]\n", argv[0]);
+		return 2;
+	}
+
+	mcu::BinaryLogger<1024> logger;
+	LOG_AND_EXPECT(logger, "plain text");
+	LOG_AND_EXPECT(logger, "adc=%u temp=%d", 1234u, -40);
+	LOG_AND_EXPECT(logger, "%08x %X %o %#x", 0xbeefu, 0xabcu, 8u, 255u);
+	LOG_AND_EXPECT(logger, "%hhd %hd %i %+d % d", static_cast<int8_t>(-5), static_cast<int16_t>(-300), 17, 5, 7);
+	LOG_AND_EXPECT(logger, "%lld %llu", static_cast<long long>(-1234567890123), static_cast<unsigned long long>(1) << 40);
+	LOG_AND_EXPECT(logger, "%.3f %e %g", 3.14159, 1.5e-7, 2.5);
+	LOG_AND_EXPECT(logger, "%f", 0.25f);
+	LOG_AND_EXPECT(logger, "%s|%5s|%-5s|", "abc", "xy", "z");
+	// Strings are cut at MaxStringLength
+	LOG_AND_EXPECT(logger, "%.32s", "0123456789012345678901234567890123456789");
+	LOG_AND_EXPECT(logger, "%c%c", 'O', 'K');
+	LOG_AND_EXPECT(logger, "100%% done");
+
+	static int object;
+	MCU_LOG(logger, "ptr=%p", &object);
+	expect("ptr=0x%08x", static_cast<unsigned>(reinterpret_cast<uintptr_t>(&object)));
+
+	// Several partial writes per record
+	Transport transport{5, {}};
+	for (int i = 0; i < 1000 && transport.stream.size() < expected.size(); i++)
+		logger.flush(transport);
+	CHECK_EQUAL(0u, logger.droppedRecords());
+
+	std::ofstream(argv[1], std::ios::binary).write(reinterpret_cast<const char*>(transport.stream.data()), transport.stream.size());
+	std::ofstream(argv[2], std::ios::binary) << expected;
+	return check::result();
+}
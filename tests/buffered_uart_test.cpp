@@ -0,0 +1,200 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "buffered_uart.h"
+#include "check.h"
+#include "fake/usart_model.h"
+
+namespace {
+
+// No counters, no wakeup timestamp
+static_assert(std::is_empty_v<mcu::NoUartStatistics>);
+
+template <typename Uart>
+void serviceInterrupts(fake::Usart& usart, Uart& uart)
+{
+	while (usart.interruptPending())
+		uart.interrupt();
+}
+
+void testTransmitBuffer()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16, 8, mcu::UartStatistics> uart(SERCOM0->USART);
+
+	std::array<std::byte, 20> data;
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<std::byte>(i + 1);
+
+	CHECK(uart.isFlushed());
+	// write() never blocks, the rest is left to the caller
+	CHECK_EQUAL(16u, uart.write(data));
+	CHECK_EQUAL(0u, uart.writable());
+	CHECK(usart.enabledInterrupts() & SERCOM_USART_INTENSET_DRE);
+	CHECK(!uart.isFlushed());
+	CHECK(usart.transmitted.empty());
+
+	serviceInterrupts(usart, uart);
+	CHECK_EQUAL(16u, usart.transmitted.size());
+	// DRE is disabled once the buffer is drained, otherwise the interrupt would fire continuously
+	CHECK(!(usart.enabledInterrupts() & SERCOM_USART_INTENSET_DRE));
+	CHECK(uart.isFlushed());
+
+	CHECK_EQUAL(4u, uart.write(gsl::span<const std::byte>(data).subspan(16)));
+	serviceInterrupts(usart, uart);
+	CHECK_EQUAL(20u, usart.transmitted.size());
+	for (size_t i = 0; i < usart.transmitted.size(); i++)
+		CHECK_EQUAL(i + 1, usart.transmitted[i]);
+	CHECK_EQUAL(20u, uart.statistics().txBytes);
+	SERCOM0->detach();
+}
+
+void testReceiveBuffer()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16, 8, mcu::UartStatistics> uart(SERCOM0->USART);
+	usart.write(fake::sercom::INTENSET, SERCOM_USART_INTENSET_RXC);
+
+	for (uint8_t i = 0; i < 10; i++) {
+		usart.receive(i);
+		serviceInterrupts(usart, uart);
+	}
+	CHECK_EQUAL(8u, uart.available());
+	CHECK_EQUAL(2u, uart.statistics().dropped);
+	CHECK_EQUAL(10u, uart.statistics().rxBytes);
+	CHECK_EQUAL(8u, uart.statistics().maxRxDepth);
+
+	gsl::span<const std::byte> received = uart.peek();
+	CHECK_EQUAL(8, static_cast<int>(received.size()));
+	for (size_t i = 0; i < 8; i++)
+		CHECK_EQUAL(i, std::to_integer<size_t>(received[i]));
+	uart.consume(8);
+	CHECK_EQUAL(0u, uart.available());
+	SERCOM0->detach();
+}
+
+void testReceiveErrors()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16, 8> uart(SERCOM0->USART);
+	usart.write(fake::sercom::INTENSET, SERCOM_USART_INTENSET_RXC);
+
+	usart.receive(0x11, SERCOM_USART_STATUS_FERR);
+	serviceInterrupts(usart, uart);
+	usart.receive(0x22, SERCOM_USART_STATUS_PERR);
+	serviceInterrupts(usart, uart);
+	// A byte was lost before this one, but it is valid itself
+	usart.overflow();
+	usart.receive(0x33);
+	serviceInterrupts(usart, uart);
+
+	CHECK_EQUAL(1u, uart.statistics().framingErrors);
+	CHECK_EQUAL(1u, uart.statistics().parityErrors);
+	CHECK_EQUAL(1u, uart.statistics().overflows);
+	CHECK_EQUAL(0u, usart.read(fake::sercom::STATUS));
+
+	std::array<std::byte, 4> data;
+	CHECK_EQUAL(1u, uart.read(data));
+	CHECK_EQUAL(0x33, std::to_integer<int>(data[0]));
+	SERCOM0->detach();
+}
+
+void testCallbackErrors()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16> uart(SERCOM0->USART);
+	usart.write(fake::sercom::INTENSET, SERCOM_USART_INTENSET_RXC);
+
+	std::vector<uint8_t> received;
+	const auto callback = [&](std::byte data) { received.push_back(std::to_integer<uint8_t>(data)); };
+	usart.receive(0x11, SERCOM_USART_STATUS_FERR);
+	usart.receive(0x22, SERCOM_USART_STATUS_PERR);
+	usart.receive(0x33);
+	usart.overflow();
+	usart.receive(0x44);
+	while (usart.interruptPending())
+		uart.interrupt(callback);
+
+	// Bad bytes never reach the callback
+	CHECK((received == std::vector<uint8_t>{0x33, 0x44}));
+	CHECK_EQUAL(1u, uart.statistics().framingErrors);
+	CHECK_EQUAL(1u, uart.statistics().parityErrors);
+	CHECK_EQUAL(1u, uart.statistics().overflows);
+	CHECK_EQUAL(0u, usart.read(fake::sercom::STATUS));
+	SERCOM0->detach();
+}
+
+void testWakeupLatency()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16, 8, mcu::UartStatistics> uart(SERCOM0->USART);
+	usart.write(fake::sercom::INTENSET, SERCOM_USART_INTENSET_RXC);
+	SysTick->LOAD = 999;
+	SysTick->VAL = 999 - 900;
+	mcu::util::sysTickPeriods = 5;
+
+	uart.sleepUntilReceive();
+	CHECK(usart.enabledInterrupts() & SERCOM_USART_INTENSET_RXS);
+	usart.startOfFrame();
+	serviceInterrupts(usart, uart);
+	// Disabled after the wakeup, not every start bit interrupts
+	CHECK(!(usart.enabledInterrupts() & SERCOM_USART_INTENSET_RXS));
+	CHECK_EQUAL(0u, uart.statistics().wakeups);
+
+	// The byte arrives more than two SysTick periods later, after the counter wrapped
+	SysTick->VAL = 999 - 150;
+	mcu::util::sysTickPeriods = 8;
+	usart.receive(0x55);
+	serviceInterrupts(usart, uart);
+	CHECK_EQUAL(1u, uart.statistics().wakeups);
+	CHECK_EQUAL(2250u, uart.statistics().lastWakeupLatency);
+	CHECK_EQUAL(2250u, uart.statistics().maxWakeupLatency);
+
+	// Bytes without a preceding wakeup are not counted
+	usart.receive(0x56);
+	serviceInterrupts(usart, uart);
+	CHECK_EQUAL(1u, uart.statistics().wakeups);
+	CHECK_EQUAL(2u, uart.available());
+	mcu::util::sysTickPeriods = 0;
+	SERCOM0->detach();
+}
+
+void testNoStatisticsWakeup()
+{
+	fake::Usart usart;
+	SERCOM0->attach(usart);
+	mcu::BufferedUART<16, 8, mcu::NoUartStatistics> uart(SERCOM0->USART);
+	usart.write(fake::sercom::INTENSET, SERCOM_USART_INTENSET_RXC);
+
+	// The received byte wakes the device, the start bit is not needed
+	uart.sleepUntilReceive();
+	CHECK_EQUAL(SERCOM_USART_INTENSET_RXC, usart.enabledInterrupts());
+	usart.startOfFrame();
+	CHECK(!usart.interruptPending());
+	usart.receive(0x42);
+	serviceInterrupts(usart, uart);
+	CHECK_EQUAL(1u, uart.available());
+	// The receive interrupt does not look at RXS
+	CHECK(usart.read(fake::sercom::INTFLAG) & SERCOM_USART_INTFLAG_RXS);
+	SERCOM0->detach();
+}
+
+} // namespace
+
+int main()
+{
+	testTransmitBuffer();
+	testReceiveBuffer();
+	testReceiveErrors();
+	testCallbackErrors();
+	testWakeupLatency();
+	testNoStatisticsWakeup();
+	return check::result();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <type_traits>
+
+/*
+ * Minimal assertions for the host tests. A failed check is reported and the test continues,
+ * main() returns check::result().
+ */
+
+namespace check {
+
+inline int failures = 0;
+
+template <typename T>
+auto printable(const T& value)
+{
+	if constexpr (std::is_same_v<T, std::byte>)
+		return static_cast<unsigned>(value);
+	else if constexpr (std::is_enum_v<T>)
+		return static_cast<long long>(value);
+	else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+		return static_cast<long long>(value);
+	else if constexpr (std::is_integral_v<T>)
+		return static_cast<unsigned long long>(value);
+	else
+		return value;
+}
+
+template <typename Expected, typename Actual>
+void equal(const Expected& expected, const Actual& actual, const char* expression, const char* file, int line)
+{
+	if (expected == actual)
+		return;
+	std::cerr << file << ':' << line << ": CHECK_EQUAL(" << expression << ") failed: expected " << printable(expected)
+		<< ", got " << printable(actual) << '\n';
+	failures++;
+}
+
+inline int result()
+{
+	if (failures != 0)
+		std::cerr << failures << " check(s) failed\n";
+	return failures != 0;
+}
+
+} // namespace check
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+			::check::failures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(expected, actual) ::check::equal((expected), (actual), #expected ", " #actual, __FILE__, __LINE__)
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "clocks.h"
+
+namespace fake {
+
+/// Clock source with a fixed frequency. Generators using it only write the plain GCLK registers
+class Clock final : public mcu::ClockSource {
+public:
+	explicit constexpr Clock(unsigned frequency) noexcept : hz{frequency} {}
+
+	int id() const override { return 0; }
+	unsigned frequency() const override { return hz; }
+
+private:
+	const unsigned hz;
+};
+
+} // namespace fake
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "sam.h"
+
+namespace fake {
+
+/**
+ * Device on the simulated I2C bus
+ */
+class I2cTarget {
+public:
+	/// @param address Right aligned (without Read/Write bit)
+	explicit I2cTarget(uint8_t address) : address{address} {}
+
+	/// Called when the target is addressed. @return ACK
+	virtual bool start(bool /*read*/) { return true; }
+	/// @return ACK
+	virtual bool write(uint8_t data) = 0;
+	virtual uint8_t read() = 0;
+	virtual void stop() {}
+
+	const uint8_t address;
+
+protected:
+	~I2cTarget() = default;
+};
+
+/// Register file with auto increment, the first byte of a write selects the register
+class RegisterTarget final : public I2cTarget {
+public:
+	explicit RegisterTarget(uint8_t address) : I2cTarget{address} {}
+
+	bool start(bool /*read*/) override
+	{
+		first = true;
+		return present;
+	}
+
+	bool write(uint8_t data) override
+	{
+		if (first)
+			pointer = data;
+		else
+			registers[pointer++] = data;
+		first = false;
+		return true;
+	}
+
+	uint8_t read() override
+	{
+		reads++;
+		return registers[pointer++];
+	}
+
+	std::array<uint8_t, 256> registers = {};
+	/// A missing device does not acknowledge its address
+	bool present = true;
+	unsigned reads = 0;
+
+private:
+	uint8_t pointer = 0;
+	bool first = true;
+};
+
+/**
+ * SERCOM in I2C master mode with smart mode. Time is counted in cycles of the core clock, every register access
+ * takes one cycle and the test lets the bus run with advance(). An SCL period lasts 10 + BAUD + BAUDLOW cycles
+ * plus the rise time, a START with the address byte 10 periods and every other byte 9 periods.
+ * Like the device MB/SB stay set until they are cleared or the next byte or command is started.
+ * A target can stretch SCL indefinitely with holdScl(). With CTRLA.LOWTOUT the running byte is then aborted
+ * after lowTimeout cycles with STATUS.LOWTOUT and MB set.
+ */
+class I2cMaster final : public Peripheral {
+public:
+	/**
+	 * @param riseCycles SCL rise time in cycles, added to every SCL period
+	 * @param lowTimeout Cycles of SCL low until LOWTOUT, 25ms at 48MHz by default
+	 */
+	explicit I2cMaster(unsigned riseCycles = 0, uint64_t lowTimeout = 1200000)
+		: riseCycles{riseCycles}, lowTimeout{lowTimeout} {}
+
+	void connect(I2cTarget& target) { targets.push_back(&target); }
+
+	/// Lets \p cycles pass, the running byte completes when its time is up
+	void advance(uint64_t cycles)
+	{
+		now += cycles;
+		if (operation == Operation::None)
+			return;
+		if (sclHeld) {
+			if ((memory.read(sercom::CTRLA) & SERCOM_I2CM_CTRLA_LOWTOUT) && now - std::max(heldSince, started) >= lowTimeout) {
+				operation = Operation::None;
+				status |= SERCOM_I2CM_STATUS_LOWTOUT;
+				flags |= SERCOM_I2CM_INTFLAG_MB;
+			}
+			return;
+		}
+		if (now >= completion)
+			complete();
+	}
+
+	/// A target holds SCL low from now on, no byte completes until releaseScl()
+	void holdScl()
+	{
+		sclHeld = true;
+		heldSince = now;
+	}
+
+	/// The running byte continues where it was stopped
+	void releaseScl()
+	{
+		if (sclHeld && operation != Operation::None)
+			completion += now - std::max(heldSince, started);
+		sclHeld = false;
+	}
+
+	/// @return Cycles until the running byte completes, 0 if nothing runs or SCL is held
+	uint64_t remaining() const
+	{
+		return operation != Operation::None && !sclHeld && completion > now ? completion - now : 0;
+	}
+	uint64_t time() const { return now; }
+
+	bool interruptPending() const { return (flags & intenset) != 0; }
+	uint8_t enabledInterrupts() const { return intenset; }
+	uint8_t pendingFlags() const { return flags; }
+	/// Sets INTFLAG bits, e.g. a flag left over from a transfer the driver gave up on
+	void raise(uint8_t interruptFlags) { flags |= interruptFlags; }
+
+	/// @return Cycles of a SCL period with the current BAUD
+	uint64_t sclPeriod()
+	{
+		const uint32_t baud = memory.read(sercom::BAUD);
+		const uint32_t high = baud & 0xff;
+		const uint32_t low = (baud >> 8) & 0xff;
+		return 10 + high + (low != 0 ? low : high) + riseCycles;
+	}
+
+	/// Bytes on the bus including the address bytes
+	unsigned bytes = 0;
+	unsigned stops = 0;
+
+	uint32_t read(uint32_t offset) override
+	{
+		advance(1);
+		switch (offset) {
+			case sercom::INTENCLR:
+			case sercom::INTENSET:
+				return intenset;
+			case sercom::INTFLAG:
+				return flags;
+			case sercom::STATUS:
+				return status | (rxNack ? SERCOM_I2CM_STATUS_RXNACK : 0) | SERCOM_I2CM_STATUS_BUSSTATE(busState);
+			case sercom::DATA:
+				return readData();
+			default:
+				return memory.read(offset);
+		}
+	}
+
+	void write(uint32_t offset, uint32_t value) override
+	{
+		advance(1);
+		switch (offset) {
+			case sercom::CTRLA:
+				// Enabling resets the bus state to unknown
+				if ((value & SERCOM_I2CM_CTRLA_ENABLE) && !(memory.read(offset) & SERCOM_I2CM_CTRLA_ENABLE)) {
+					busState = Unknown;
+					operation = Operation::None;
+				}
+				memory.write(offset, value);
+				break;
+			case sercom::CTRLB:
+				memory.write(offset, value & ~SERCOM_I2CM_CTRLB_CMD_Msk);
+				if (((value & SERCOM_I2CM_CTRLB_CMD_Msk) >> SERCOM_I2CM_CTRLB_CMD_Pos) == CommandStop)
+					sendStop();
+				break;
+			case sercom::INTENCLR:
+				intenset &= ~value;
+				break;
+			case sercom::INTENSET:
+				intenset |= value;
+				break;
+			case sercom::INTFLAG:
+				flags &= ~value;
+				break;
+			case sercom::STATUS:
+				status &= ~(value & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LOWTOUT));
+				if (((value & SERCOM_I2CM_STATUS_BUSSTATE_Msk) >> SERCOM_I2CM_STATUS_BUSSTATE_Pos) == Idle && busState != Owner)
+					busState = Idle;
+				break;
+			case sercom::ADDR:
+				sendAddress(static_cast<uint8_t>(value));
+				break;
+			case sercom::DATA:
+				flags = 0;
+				if (busState == Owner && !reading)
+					startByte(Operation::Write, 9, static_cast<uint8_t>(value));
+				break;
+			default:
+				memory.write(offset, value);
+		}
+	}
+
+private:
+	enum BusState : uint8_t { Unknown = 0, Idle = 1, Owner = 2 };
+	enum class Operation : uint8_t { None, Address, Write, Read };
+	static constexpr unsigned CommandStop = 3;
+
+	void startByte(Operation next, unsigned periods, uint8_t data)
+	{
+		operation = next;
+		shiftData = data;
+		started = now;
+		completion = std::max(now, busFree) + periods * sclPeriod();
+	}
+
+	void sendAddress(uint8_t value)
+	{
+		flags = 0;
+		rxNack = false;
+		reading = false;
+		if (busState == Unknown)
+			return;
+		if (busState == Owner && active != nullptr)
+			active->stop();
+		busState = Owner;
+		startByte(Operation::Address, 10, value);
+	}
+
+	void sendStop()
+	{
+		flags = 0;
+		operation = Operation::None;
+		reading = false;
+		if (busState != Owner)
+			return;
+		if (active != nullptr)
+			active->stop();
+		active = nullptr;
+		busState = Idle;
+		busFree = now + sclPeriod();
+		stops++;
+	}
+
+	uint32_t readData()
+	{
+		const uint8_t data = received;
+		flags &= ~SERCOM_I2CM_INTFLAG_SB;
+		// Smart mode: reading DATA acknowledges and receives the next byte
+		const uint32_t ctrlb = memory.read(sercom::CTRLB);
+		if (reading && operation == Operation::None && (ctrlb & SERCOM_I2CM_CTRLB_SMEN)
+			&& !(ctrlb & SERCOM_I2CM_CTRLB_ACKACT))
+			startByte(Operation::Read, 9, 0);
+		return data;
+	}
+
+	void complete()
+	{
+		const Operation finished = operation;
+		operation = Operation::None;
+		bytes++;
+		if (finished == Operation::Address) {
+			active = nullptr;
+			for (I2cTarget* target : targets) {
+				if (target->address == shiftData >> 1)
+					active = target;
+			}
+			const bool read = shiftData & 1;
+			const bool ack = active != nullptr && active->start(read);
+			if (!ack)
+				active = nullptr;
+			rxNack = !ack;
+			if (read && ack && !(memory.read(sercom::CTRLB) & SERCOM_I2CM_CTRLB_QCEN)) {
+				// The first byte follows the address directly
+				reading = true;
+				completion += 9 * sclPeriod();
+				operation = Operation::Read;
+				if (now >= completion)
+					complete();
+				return;
+			}
+			flags |= read && ack ? SERCOM_I2CM_INTFLAG_SB : SERCOM_I2CM_INTFLAG_MB;
+		} else if (finished == Operation::Write) {
+			rxNack = active == nullptr || !active->write(shiftData);
+			flags |= SERCOM_I2CM_INTFLAG_MB;
+		} else {
+			reading = true;
+			received = active->read();
+			flags |= SERCOM_I2CM_INTFLAG_SB;
+		}
+	}
+
+	const unsigned riseCycles;
+	const uint64_t lowTimeout;
+	std::vector<I2cTarget*> targets;
+	I2cTarget* active = nullptr;
+	Memory memory;
+	uint64_t now = 0;
+	uint64_t completion = 0;
+	uint64_t busFree = 0;
+	uint64_t started = 0;
+	uint64_t heldSince = 0;
+	bool sclHeld = false;
+	Operation operation = Operation::None;
+	uint8_t shiftData = 0;
+	uint8_t received = 0;
+	uint8_t intenset = 0;
+	uint8_t flags = 0;
+	uint16_t status = 0;
+	BusState busState = Unknown;
+	bool rxNack = false;
+	bool reading = false;
+};
+
+} // namespace fake
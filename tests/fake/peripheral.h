@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace fake {
+
+/**
+ * Simulated peripheral behind a register block. Offsets are the byte offsets of the real registers
+ */
+class Peripheral {
+public:
+	virtual uint32_t read(uint32_t offset) = 0;
+	virtual void write(uint32_t offset, uint32_t value) = 0;
+
+protected:
+	~Peripheral() = default;
+};
+
+/// Registers without side effects. Used until a model is attached to a register block
+class Memory final : public Peripheral {
+public:
+	uint32_t read(uint32_t offset) override { return values[offset & 0x3f]; }
+	void write(uint32_t offset, uint32_t value) override { values[offset & 0x3f] = value; }
+
+private:
+	std::array<uint32_t, 0x40> values = {};
+};
+
+/// The peripheral currently attached to a register block, shared by all its register proxies
+struct Slot {
+	Peripheral* peripheral;
+};
+
+/// Stands in for the .reg member of a register union, every access is forwarded to the attached peripheral
+template <typename T>
+class Register {
+public:
+	Register(Slot& slot, uint32_t offset) noexcept : slot{slot}, offset{offset} {}
+	Register(const Register&) = default;
+
+	operator T() const { return static_cast<T>(slot.peripheral->read(offset)); }
+	explicit operator std::byte() const { return static_cast<std::byte>(static_cast<T>(*this)); }
+
+	Register& operator=(uint32_t value)
+	{
+		slot.peripheral->write(offset, value);
+		return *this;
+	}
+	Register& operator=(const Register& other) { return *this = static_cast<T>(other); }
+	Register& operator|=(uint32_t value) { return *this = *this | value; }
+	Register& operator&=(uint32_t value) { return *this = *this & value; }
+
+private:
+	Slot& slot;
+	const uint32_t offset;
+};
+
+/// Stands in for a member of the .bit struct of a register union. Writes are read-modify-write like on the device
+template <unsigned Pos, unsigned Width = 1>
+class Field {
+	static constexpr uint32_t Mask = (uint32_t{1} << Width) - 1;
+
+public:
+	Field(Slot& slot, uint32_t offset) noexcept : slot{slot}, offset{offset} {}
+
+	operator uint32_t() const { return (slot.peripheral->read(offset) >> Pos) & Mask; }
+
+	Field& operator=(uint32_t value)
+	{
+		const uint32_t old = slot.peripheral->read(offset);
+		slot.peripheral->write(offset, (old & ~(Mask << Pos)) | ((value & Mask) << Pos));
+		return *this;
+	}
+
+private:
+	Slot& slot;
+	const uint32_t offset;
+};
+
+/// A register that is only accessed as a whole
+template <typename T>
+struct PlainRegister {
+	PlainRegister(Slot& slot, uint32_t offset) noexcept : reg{slot, offset} {}
+	Register<T> reg;
+};
+
+} // namespace fake
@@ -0,0 +1,414 @@
+#pragma once
+
+/*
+ * Host replacement of the device and CMSIS headers for the tests.
+ * The register definitions of samd20/include/component are used unchanged. PM, GCLK, SYSCTRL, NVMCTRL, PORT and
+ * the timers are plain memory, the SERCOMs and PORT_IOBUS forward every access to a model (see peripheral.h),
+ * so the drivers run unmodified against simulated hardware.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "peripheral.h"
+
+#ifndef __SAMD20E17__
+#error "The host tests simulate a SAMD20E17"
+#endif
+
+typedef volatile uint32_t RoReg;
+typedef volatile uint16_t RoReg16;
+typedef volatile uint8_t RoReg8;
+typedef volatile uint32_t WoReg;
+typedef volatile uint16_t WoReg16;
+typedef volatile uint8_t WoReg8;
+typedef volatile uint32_t RwReg;
+typedef volatile uint16_t RwReg16;
+typedef volatile uint8_t RwReg8;
+
+#define __I volatile
+#define __O volatile
+#define __IO volatile
+
+#define _U_(x) x ## U
+#define _L_(x) x ## L
+#define _UL_(x) x ## UL
+
+typedef enum IRQn {
+	NonMaskableInt_IRQn = -14,
+	HardFault_IRQn = -13,
+	SVCall_IRQn = -5,
+	PendSV_IRQn = -2,
+	SysTick_IRQn = -1,
+	PM_IRQn = 0,
+	SYSCTRL_IRQn = 1,
+	WDT_IRQn = 2,
+	RTC_IRQn = 3,
+	EIC_IRQn = 4,
+	NVMCTRL_IRQn = 5,
+	EVSYS_IRQn = 6,
+	SERCOM0_IRQn = 7,
+	SERCOM1_IRQn = 8,
+	SERCOM2_IRQn = 9,
+	SERCOM3_IRQn = 10,
+	TC0_IRQn = 13,
+	TC1_IRQn = 14,
+	TC2_IRQn = 15,
+	TC3_IRQn = 16,
+	TC4_IRQn = 17,
+	TC5_IRQn = 18,
+	ADC_IRQn = 21,
+	AC_IRQn = 22,
+	DAC_IRQn = 23,
+	PTC_IRQn = 24,
+	PERIPH_COUNT_IRQn = 25
+} IRQn_Type;
+
+#include "component/ac.h"
+#include "component/adc.h"
+#include "component/dac.h"
+#include "component/dsu.h"
+#include "component/eic.h"
+#include "component/evsys.h"
+#include "component/gclk.h"
+#include "component/nvmctrl.h"
+#include "component/pac.h"
+#include "component/pm.h"
+#include "component/port.h"
+#include "component/rtc.h"
+// The real SERCOM register structs are only used for their layout, the drivers see the proxies below
+#define SercomI2cm DeviceSercomI2cm
+#define SercomI2cs DeviceSercomI2cs
+#define SercomSpi DeviceSercomSpi
+#define SercomUsart DeviceSercomUsart
+#define Sercom DeviceSercom
+#include "component/sercom.h"
+#undef SercomI2cm
+#undef SercomI2cs
+#undef SercomSpi
+#undef SercomUsart
+#undef Sercom
+#include "component/sysctrl.h"
+#include "component/tc.h"
+#include "component/wdt.h"
+#include "pio/samd20e17.h"
+
+#define SERCOM_INST_NUM 4
+#define TC_INST_NUM 6
+#define NVMCTRL_OTP4 (0x00806020UL)
+
+namespace fake {
+
+/// Register offsets shared by all SERCOM modes
+namespace sercom {
+constexpr uint32_t CTRLA = offsetof(DeviceSercomSpi, CTRLA);
+constexpr uint32_t CTRLB = offsetof(DeviceSercomSpi, CTRLB);
+constexpr uint32_t BAUD = offsetof(DeviceSercomSpi, BAUD);
+constexpr uint32_t INTENCLR = offsetof(DeviceSercomSpi, INTENCLR);
+constexpr uint32_t INTENSET = offsetof(DeviceSercomSpi, INTENSET);
+constexpr uint32_t INTFLAG = offsetof(DeviceSercomSpi, INTFLAG);
+constexpr uint32_t STATUS = offsetof(DeviceSercomSpi, STATUS);
+constexpr uint32_t ADDR = offsetof(DeviceSercomSpi, ADDR);
+constexpr uint32_t DATA = offsetof(DeviceSercomSpi, DATA);
+} // namespace sercom
+
+struct SercomCtrla {
+	explicit SercomCtrla(Slot& slot) noexcept : reg{slot, sercom::CTRLA}, bit{{slot, sercom::CTRLA}} {}
+	Register<uint32_t> reg;
+	struct {
+		Field<SERCOM_SPI_CTRLA_ENABLE_Pos> ENABLE;
+	} bit;
+};
+
+struct SercomCtrlb {
+	explicit SercomCtrlb(Slot& slot) noexcept : reg{slot, sercom::CTRLB}, bit{{slot, sercom::CTRLB}} {}
+	Register<uint32_t> reg;
+	struct {
+		Field<SERCOM_SPI_CTRLB_RXEN_Pos> RXEN;
+	} bit;
+};
+
+/// The flags of all modes, DRE/TXC/RXC share their positions with MB/SB
+struct SercomIntflag {
+	explicit SercomIntflag(Slot& slot) noexcept
+		: reg{slot, sercom::INTFLAG},
+		  bit{{slot, sercom::INTFLAG}, {slot, sercom::INTFLAG}, {slot, sercom::INTFLAG}, {slot, sercom::INTFLAG},
+		      {slot, sercom::INTFLAG}, {slot, sercom::INTFLAG}}
+	{}
+	Register<uint8_t> reg;
+	struct {
+		Field<SERCOM_SPI_INTFLAG_DRE_Pos> DRE;
+		Field<SERCOM_SPI_INTFLAG_TXC_Pos> TXC;
+		Field<SERCOM_SPI_INTFLAG_RXC_Pos> RXC;
+		Field<SERCOM_USART_INTFLAG_RXS_Pos> RXS;
+		Field<SERCOM_I2CM_INTFLAG_MB_Pos> MB;
+		Field<SERCOM_I2CM_INTFLAG_SB_Pos> SB;
+	} bit;
+};
+
+struct SercomStatus {
+	explicit SercomStatus(Slot& slot) noexcept
+		: reg{slot, sercom::STATUS},
+		  bit{{slot, sercom::STATUS}, {slot, sercom::STATUS}, {slot, sercom::STATUS}, {slot, sercom::STATUS}}
+	{}
+	Register<uint16_t> reg;
+	struct {
+		Field<SERCOM_SPI_STATUS_SYNCBUSY_Pos> SYNCBUSY;
+		Field<SERCOM_SPI_STATUS_BUFOVF_Pos> BUFOVF;
+		Field<SERCOM_I2CM_STATUS_RXNACK_Pos> RXNACK;
+		Field<SERCOM_I2CM_STATUS_BUSSTATE_Pos, 2> BUSSTATE;
+	} bit;
+};
+
+/// Register block of one SERCOM mode. \p Mode only keeps the three modes distinct types like on the device
+template <typename Data, int Mode>
+struct SercomRegisters {
+	explicit SercomRegisters(Slot& slot) noexcept
+		: CTRLA{slot}, CTRLB{slot}, BAUD{slot, sercom::BAUD}, INTENCLR{slot, sercom::INTENCLR},
+		  INTENSET{slot, sercom::INTENSET}, INTFLAG{slot}, STATUS{slot}, ADDR{slot, sercom::ADDR}, DATA{slot, sercom::DATA}
+	{}
+
+	SercomCtrla CTRLA;
+	SercomCtrlb CTRLB;
+	PlainRegister<uint16_t> BAUD;
+	PlainRegister<uint8_t> INTENCLR;
+	PlainRegister<uint8_t> INTENSET;
+	SercomIntflag INTFLAG;
+	SercomStatus STATUS;
+	PlainRegister<uint32_t> ADDR;
+	PlainRegister<Data> DATA;
+};
+
+} // namespace fake
+
+typedef fake::SercomRegisters<uint8_t, 0> SercomI2cm;
+typedef fake::SercomRegisters<uint32_t, 1> SercomSpi;
+typedef fake::SercomRegisters<uint16_t, 2> SercomUsart;
+
+/// One SERCOM instance. All modes share the attached model
+struct Sercom {
+	Sercom() noexcept : I2CM{slot}, SPI{slot}, USART{slot} {}
+	Sercom(const Sercom&) = delete;
+	Sercom& operator=(const Sercom&) = delete;
+
+	/// Routes all register accesses to \p model
+	void attach(fake::Peripheral& model) noexcept { slot.peripheral = &model; }
+	/// Back to plain memory
+	void detach() noexcept { slot.peripheral = &memory; }
+
+	fake::Memory memory;
+	fake::Slot slot{&memory};
+	SercomI2cm I2CM;
+	SercomSpi SPI;
+	SercomUsart USART;
+};
+
+namespace fake {
+
+/// Routes the registers of \p sercom to \p model while the object lives
+class SercomAttachment {
+public:
+	SercomAttachment(Sercom* sercom, Peripheral& model) noexcept : sercom{sercom} { sercom->attach(model); }
+	~SercomAttachment() { sercom->detach(); }
+	SercomAttachment(const SercomAttachment&) = delete;
+	SercomAttachment& operator=(const SercomAttachment&) = delete;
+
+private:
+	Sercom* const sercom;
+};
+
+class PinWatch;
+
+/**
+ * PORT_IOBUS. Output changes are applied to PORT and reported to the PinWatch objects of the pin.
+ * Pins are numbered sequentially, PB00 is 32
+ */
+class Pins final : public Peripheral {
+public:
+	uint32_t read(uint32_t offset) override;
+	void write(uint32_t offset, uint32_t value) override;
+
+	bool level(unsigned pin) const;
+
+private:
+	friend class PinWatch;
+
+	void setOutput(unsigned group, uint32_t value);
+
+	std::vector<PinWatch*> watches;
+};
+
+/// Calls \p changed whenever the output level of \p pin changes while the object lives
+class PinWatch {
+public:
+	PinWatch(unsigned pin, std::function<void(bool high)> changed);
+	~PinWatch();
+	PinWatch(const PinWatch&) = delete;
+	PinWatch& operator=(const PinWatch&) = delete;
+
+private:
+	friend class Pins;
+
+	const unsigned pin;
+	const std::function<void(bool high)> changed;
+};
+
+struct IobusGroup {
+	IobusGroup(Slot& slot, uint32_t base) noexcept
+		: DIR(slot, base + offsetof(PortGroup, DIR)), DIRCLR(slot, base + offsetof(PortGroup, DIRCLR)),
+		  DIRSET(slot, base + offsetof(PortGroup, DIRSET)), DIRTGL(slot, base + offsetof(PortGroup, DIRTGL)),
+		  OUT(slot, base + offsetof(PortGroup, OUT)), OUTCLR(slot, base + offsetof(PortGroup, OUTCLR)),
+		  OUTSET(slot, base + offsetof(PortGroup, OUTSET)), OUTTGL(slot, base + offsetof(PortGroup, OUTTGL)),
+		  IN(slot, base + offsetof(PortGroup, IN))
+	{}
+
+	PlainRegister<uint32_t> DIR;
+	PlainRegister<uint32_t> DIRCLR;
+	PlainRegister<uint32_t> DIRSET;
+	PlainRegister<uint32_t> DIRTGL;
+	PlainRegister<uint32_t> OUT;
+	PlainRegister<uint32_t> OUTCLR;
+	PlainRegister<uint32_t> OUTSET;
+	PlainRegister<uint32_t> OUTTGL;
+	PlainRegister<uint32_t> IN;
+};
+
+inline Pins pins;
+
+struct IobusPort {
+	IobusPort() noexcept : Group{{{slot, 0}, {slot, sizeof(PortGroup)}}} {}
+
+	Slot slot{&pins};
+	std::array<IobusGroup, 2> Group;
+};
+
+struct SysTickType {
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+};
+
+struct ScbType {
+	volatile uint32_t CPUID;
+	volatile uint32_t ICSR;
+	volatile uint32_t VTOR;
+	volatile uint32_t AIRCR;
+	volatile uint32_t SCR;
+	volatile uint32_t CCR;
+};
+
+inline Gclk gclk{};
+inline Nvmctrl nvmctrl{};
+inline Pm pm{};
+inline Port port{};
+inline IobusPort portIobus;
+inline Sysctrl sysctrl{};
+inline Sercom sercoms[SERCOM_INST_NUM];
+inline Tc tcs[TC_INST_NUM]{};
+inline SysTickType sysTick{};
+inline ScbType scb{};
+/// PRIMASK of the simulated core
+inline uint32_t primask = 0;
+
+inline uint32_t Pins::read(uint32_t offset)
+{
+	const PortGroup& group = port.Group[offset / sizeof(PortGroup)];
+	switch (offset % sizeof(PortGroup)) {
+		case offsetof(PortGroup, DIR): return group.DIR.reg;
+		case offsetof(PortGroup, OUT): return group.OUT.reg;
+		case offsetof(PortGroup, IN): return group.IN.reg;
+		default: return 0;
+	}
+}
+
+inline void Pins::write(uint32_t offset, uint32_t value)
+{
+	const unsigned index = offset / sizeof(PortGroup);
+	PortGroup& group = port.Group[index];
+	switch (offset % sizeof(PortGroup)) {
+		case offsetof(PortGroup, DIR): group.DIR.reg = value; break;
+		case offsetof(PortGroup, DIRCLR): group.DIR.reg &= ~value; break;
+		case offsetof(PortGroup, DIRSET): group.DIR.reg |= value; break;
+		case offsetof(PortGroup, DIRTGL): group.DIR.reg ^= value; break;
+		case offsetof(PortGroup, OUT): setOutput(index, value); break;
+		case offsetof(PortGroup, OUTCLR): setOutput(index, group.OUT.reg & ~value); break;
+		case offsetof(PortGroup, OUTSET): setOutput(index, group.OUT.reg | value); break;
+		case offsetof(PortGroup, OUTTGL): setOutput(index, group.OUT.reg ^ value); break;
+		default: break;
+	}
+}
+
+inline bool Pins::level(unsigned pin) const
+{
+	return (port.Group[pin / 32].IN.reg >> (pin % 32)) & 1;
+}
+
+inline void Pins::setOutput(unsigned group, uint32_t value)
+{
+	const uint32_t changed = port.Group[group].OUT.reg ^ value;
+	port.Group[group].OUT.reg = value;
+	port.Group[group].IN.reg = value;
+	// A watcher may react by changing other pins, so iterate over a copy
+	const std::vector<PinWatch*> current = watches;
+	for (PinWatch* watch : current) {
+		if (watch->pin / 32 == group && (changed >> (watch->pin % 32)) & 1)
+			watch->changed((value >> (watch->pin % 32)) & 1);
+	}
+}
+
+inline PinWatch::PinWatch(unsigned pin, std::function<void(bool high)> changed) : pin{pin}, changed{std::move(changed)}
+{
+	pins.watches.push_back(this);
+}
+
+inline PinWatch::~PinWatch()
+{
+	pins.watches.erase(std::find(pins.watches.begin(), pins.watches.end(), this));
+}
+
+} // namespace fake
+
+#define GCLK (&fake::gclk)
+#define NVMCTRL (&fake::nvmctrl)
+#define PM (&fake::pm)
+#define PORT (&fake::port)
+#define PORT_IOBUS (&fake::portIobus)
+#define SYSCTRL (&fake::sysctrl)
+#define SERCOM0 (&fake::sercoms[0])
+#define SERCOM1 (&fake::sercoms[1])
+#define SERCOM2 (&fake::sercoms[2])
+#define SERCOM3 (&fake::sercoms[3])
+#define TC0 (&fake::tcs[0])
+#define TC1 (&fake::tcs[1])
+#define TC2 (&fake::tcs[2])
+#define TC3 (&fake::tcs[3])
+#define TC4 (&fake::tcs[4])
+#define TC5 (&fake::tcs[5])
+#define SysTick (&fake::sysTick)
+#define SCB (&fake::scb)
+
+#define SCB_ICSR_PENDSTSET_Msk (1UL << 26)
+#define SCB_SCR_SLEEPDEEP_Msk (1UL << 2)
+#define SysTick_CTRL_ENABLE_Msk (1UL << 0)
+#define SysTick_CTRL_TICKINT_Msk (1UL << 1)
+#define SysTick_CTRL_CLKSOURCE_Msk (1UL << 2)
+
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_ClearPendingIRQ(IRQn_Type) {}
+inline void NVIC_SetPendingIRQ(IRQn_Type) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+
+inline uint32_t __get_PRIMASK() { return fake::primask; }
+inline void __set_PRIMASK(uint32_t value) { fake::primask = value; }
+inline void __disable_irq() { fake::primask = 1; }
+inline void __enable_irq() { fake::primask = 0; }
+inline void __DSB() {}
+inline void __ISB() {}
+inline void __WFI() {}
+inline void __NOP() {}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "sam.h"
+
+namespace fake {
+
+/**
+ * Device on the simulated SPI bus, selected while its chip select pin is low
+ */
+class SpiTarget {
+public:
+	/// Called at the end of every byte clocked while the target is selected. @return MISO
+	virtual uint8_t exchange(uint8_t mosi) = 0;
+	/// Called for every byte clocked while the target is not selected
+	virtual void idleClock(uint8_t /*mosi*/) {}
+
+	bool selected() const { return isSelected; }
+
+protected:
+	/// @param chipSelect Pin number, PA00 is 0
+	explicit SpiTarget(unsigned chipSelect)
+		: chipSelectWatch{chipSelect, [this](bool high) {
+			isSelected = !high;
+			if (high)
+				onDeselect();
+			else
+				onSelect();
+		}}
+	{}
+	~SpiTarget() = default;
+
+	virtual void onSelect() {}
+	virtual void onDeselect() {}
+
+private:
+	bool isSelected = false;
+	PinWatch chipSelectWatch;
+};
+
+/**
+ * SERCOM in SPI master mode, the synchronous USART mode behaves the same.
+ * Time advances by one step with every register access and a byte takes byteTime steps.
+ * Like the device there is a one byte transmit buffer in front of the shift register and a two level receive buffer.
+ * Bytes are exchanged with the selected targets when they are complete, so a chip select released too early loses data.
+ */
+class SpiMaster final : public Peripheral {
+public:
+	/**
+	 * @param rxcDelay Steps from the end of a byte, when the next one moves into the shift register and DRE is set,
+	 *                 until RXC. Smaller than \p byteTime
+	 */
+	explicit SpiMaster(unsigned byteTime = 16, unsigned rxcDelay = 0) : byteTime{byteTime}, rxcDelay{rxcDelay} {}
+
+	void connect(SpiTarget& target) { targets.push_back(&target); }
+
+	void resetStatistics()
+	{
+		bytes = 0;
+		gaps = 0;
+		overflows = 0;
+		lostWrites = 0;
+		steps = 0;
+		afterByte = false;
+	}
+
+	/// @return true while a byte is shifting or waiting in the transmit buffer
+	bool busy() const { return shifting || txFull; }
+	bool interruptPending() const { return (flags() & intenset) != 0; }
+	uint8_t enabledInterrupts() const { return intenset; }
+	/// Lets \p count steps pass without a register access, e.g. while the core waits for an interrupt
+	void wait(unsigned count)
+	{
+		while (count-- > 0)
+			step();
+	}
+	size_t receivePending() const { return rx.size(); }
+
+	/// Bytes clocked
+	unsigned bytes = 0;
+	/// Number of times the shift register ran empty before the next byte. 0 means SCK ran continuously
+	unsigned gaps = 0;
+	/// Bytes lost because the receive buffer was full
+	unsigned overflows = 0;
+	/// DATA writes while the transmit buffer was full
+	unsigned lostWrites = 0;
+	/// Register accesses, the time base of the model
+	unsigned steps = 0;
+
+	/**
+	 * @param clocksPerByte SCK cycles a byte takes, 10 for the synchronous USART with start and stop bit
+	 * @return Bytes per SCK cycle since resetStatistics(), 1 / clocksPerByte if SCK ran continuously all the time
+	 */
+	double bytesPerSckCycle(unsigned clocksPerByte = 8) const
+	{
+		return bytes / (static_cast<double>(clocksPerByte) * steps / byteTime);
+	}
+
+	uint32_t read(uint32_t offset) override
+	{
+		step();
+		switch (offset) {
+			case sercom::INTENCLR:
+			case sercom::INTENSET:
+				return intenset;
+			case sercom::INTFLAG:
+				return flags();
+			case sercom::STATUS:
+				return status;
+			case sercom::DATA: {
+				if (rx.empty())
+					return 0;
+				const uint8_t data = rx.front();
+				rx.pop_front();
+				return data;
+			}
+			default:
+				return memory.read(offset);
+		}
+	}
+
+	void write(uint32_t offset, uint32_t value) override
+	{
+		step();
+		switch (offset) {
+			case sercom::INTENCLR:
+				intenset &= ~value;
+				break;
+			case sercom::INTENSET:
+				intenset |= value;
+				break;
+			case sercom::INTFLAG:
+				if (value & SERCOM_SPI_INTFLAG_TXC)
+					txc = false;
+				break;
+			case sercom::STATUS:
+				status &= ~(value & SERCOM_SPI_STATUS_BUFOVF);
+				break;
+			case sercom::DATA:
+				txc = false;
+				if (txFull)
+					lostWrites++;
+				txData = static_cast<uint8_t>(value);
+				txFull = true;
+				if (!shifting) {
+					if (afterByte)
+						gaps++;
+					startByte();
+				}
+				break;
+			default:
+				memory.write(offset, value);
+		}
+	}
+
+private:
+	uint8_t flags() const
+	{
+		return (txFull ? 0 : SERCOM_SPI_INTFLAG_DRE) | (txc ? SERCOM_SPI_INTFLAG_TXC : 0)
+			| (rx.empty() ? 0 : SERCOM_SPI_INTFLAG_RXC);
+	}
+
+	void step()
+	{
+		steps++;
+		if (delayedCount != 0 && --delayedCount == 0)
+			receive(delayedData);
+		if (shifting && --remaining == 0)
+			finishByte();
+	}
+
+	void receive(uint8_t miso)
+	{
+		if (memory.read(sercom::CTRLB) & SERCOM_SPI_CTRLB_RXEN) {
+			if (rx.size() < 2) {
+				rx.push_back(miso);
+			} else {
+				status |= SERCOM_SPI_STATUS_BUFOVF;
+				overflows++;
+			}
+		}
+	}
+
+	void startByte()
+	{
+		shiftData = txData;
+		txFull = false;
+		shifting = true;
+		remaining = byteTime;
+		afterByte = false;
+	}
+
+	void finishByte()
+	{
+		shifting = false;
+		bytes++;
+		uint8_t miso = 0xff;
+		for (SpiTarget* target : targets) {
+			if (target->selected())
+				miso &= target->exchange(shiftData);
+			else
+				target->idleClock(shiftData);
+		}
+		if (rxcDelay == 0) {
+			receive(miso);
+		} else {
+			delayedData = miso;
+			delayedCount = rxcDelay;
+		}
+		if (txFull) {
+			startByte();
+		} else {
+			txc = true;
+			afterByte = true;
+		}
+	}
+
+	const unsigned byteTime;
+	const unsigned rxcDelay;
+	std::vector<SpiTarget*> targets;
+	Memory memory;
+	std::deque<uint8_t> rx;
+	uint8_t intenset = 0;
+	uint16_t status = 0;
+	bool txc = false;
+	bool txFull = false;
+	uint8_t txData = 0;
+	bool shifting = false;
+	uint8_t shiftData = 0;
+	unsigned remaining = 0;
+	bool afterByte = false;
+	uint8_t delayedData = 0;
+	unsigned delayedCount = 0;
+};
+
+/**
+ * SERCOM in SPI slave mode, the test acts as host. Time advances by one step with every register access or wait().
+ * While a frame runs the host clocks a byte every byteTime steps without pauses.
+ * Like the device DATA is a one byte transmit buffer in front of the shift register and the next byte moves into
+ * the shift register when a byte ends. With PLOADEN a byte written while slave select is high goes directly into
+ * the shift register. A byte clocked while the shift register is empty is an underrun.
+ */
+class SpiSlavePort final : public Peripheral {
+public:
+	explicit SpiSlavePort(unsigned byteTime = 16) : byteTime{byteTime} {}
+
+	/// Pulls slave select low and clocks \p mosi back to back
+	void startFrame(std::vector<uint8_t> mosi)
+	{
+		frame = std::move(mosi);
+		position = 0;
+		selected = true;
+		remaining = byteTime;
+	}
+
+	bool frameRunning() const { return selected && position < frame.size(); }
+
+	/// Releases slave select, which sets TXC
+	void endFrame()
+	{
+		selected = false;
+		txc = true;
+	}
+
+	bool interruptPending() const { return (flags() & intenset) != 0; }
+
+	/// Lets \p count steps pass without a register access
+	void wait(unsigned count)
+	{
+		while (count-- > 0)
+			step();
+	}
+
+	/// MISO of all frames
+	std::vector<uint8_t> miso;
+	/// Bytes clocked with an empty shift register
+	unsigned underruns = 0;
+	/// Bytes lost because the receive buffer was full
+	unsigned overflows = 0;
+
+	uint32_t read(uint32_t offset) override
+	{
+		step();
+		switch (offset) {
+			case sercom::INTENCLR:
+			case sercom::INTENSET:
+				return intenset;
+			case sercom::INTFLAG:
+				return flags();
+			case sercom::STATUS:
+				return status;
+			case sercom::DATA: {
+				if (rx.empty())
+					return 0;
+				const uint8_t data = rx.front();
+				rx.pop_front();
+				return data;
+			}
+			default:
+				return memory.read(offset);
+		}
+	}
+
+	void write(uint32_t offset, uint32_t value) override
+	{
+		step();
+		switch (offset) {
+			case sercom::CTRLA:
+				// Disabling discards the transmit and receive buffers
+				if (!(value & SERCOM_SPI_CTRLA_ENABLE)) {
+					txFull = false;
+					shiftLoaded = false;
+					rx.clear();
+				}
+				memory.write(offset, value);
+				break;
+			case sercom::INTENCLR:
+				intenset &= ~value;
+				break;
+			case sercom::INTENSET:
+				intenset |= value;
+				break;
+			case sercom::INTFLAG:
+				if (value & SERCOM_SPI_INTFLAG_TXC)
+					txc = false;
+				break;
+			case sercom::STATUS:
+				status &= ~(value & SERCOM_SPI_STATUS_BUFOVF);
+				break;
+			case sercom::DATA:
+				if (!selected && !shiftLoaded && (memory.read(sercom::CTRLB) & SERCOM_SPI_CTRLB_PLOADEN)) {
+					shiftData = static_cast<uint8_t>(value);
+					shiftLoaded = true;
+				} else {
+					txData = static_cast<uint8_t>(value);
+					txFull = true;
+				}
+				break;
+			default:
+				memory.write(offset, value);
+		}
+	}
+
+private:
+	uint8_t flags() const
+	{
+		return (txFull ? 0 : SERCOM_SPI_INTFLAG_DRE) | (txc ? SERCOM_SPI_INTFLAG_TXC : 0)
+			| (rx.empty() ? 0 : SERCOM_SPI_INTFLAG_RXC);
+	}
+
+	void step()
+	{
+		if (!frameRunning() || --remaining != 0)
+			return;
+		if (shiftLoaded) {
+			miso.push_back(shiftData);
+		} else {
+			miso.push_back(0xff);
+			underruns++;
+		}
+		if (rx.size() < 2) {
+			rx.push_back(frame[position]);
+		} else {
+			status |= SERCOM_SPI_STATUS_BUFOVF;
+			overflows++;
+		}
+		position++;
+		remaining = byteTime;
+		shiftLoaded = txFull;
+		shiftData = txData;
+		txFull = false;
+	}
+
+	const unsigned byteTime;
+	Memory memory;
+	std::vector<uint8_t> frame;
+	size_t position = 0;
+	bool selected = false;
+	unsigned remaining = 0;
+	std::deque<uint8_t> rx;
+	uint8_t intenset = 0;
+	uint16_t status = 0;
+	bool txc = false;
+	bool txFull = false;
+	uint8_t txData = 0;
+	bool shiftLoaded = false;
+	uint8_t shiftData = 0;
+};
+
+} // namespace fake
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "sam.h"
+
+namespace fake {
+
+/**
+ * USART in asynchronous mode. Transmission takes no time, received bytes are injected by the test
+ */
+class Usart final : public Peripheral {
+public:
+	/**
+	 * Queues a received byte
+	 * @param errors SERCOM_USART_STATUS_FERR and SERCOM_USART_STATUS_PERR, raised in STATUS when the byte reaches DATA
+	 */
+	void receive(uint8_t data, uint16_t errors = 0)
+	{
+		rx.push_back({data, errors});
+		if (rx.size() == 1)
+			status |= errors;
+	}
+	/// Signals that a byte was lost in the hardware buffer
+	void overflow() { status |= SERCOM_USART_STATUS_BUFOVF; }
+	/// Signals a start bit, sets RXS
+	void startOfFrame() { rxs = true; }
+	/// Signals that the last byte left the shift register, sets TXC again after the driver cleared it
+	void transmissionComplete() { txc = true; }
+
+	bool interruptPending() { return (read(sercom::INTFLAG) & intenset) != 0; }
+	uint8_t enabledInterrupts() const { return intenset; }
+	size_t pendingReceive() const { return rx.size(); }
+
+	std::vector<uint8_t> transmitted;
+
+	uint32_t read(uint32_t offset) override
+	{
+		switch (offset) {
+			case sercom::INTENCLR:
+			case sercom::INTENSET:
+				return intenset;
+			case sercom::INTFLAG:
+				return SERCOM_USART_INTFLAG_DRE | (txc ? SERCOM_USART_INTFLAG_TXC : 0)
+					| (!rx.empty() ? SERCOM_USART_INTFLAG_RXC : 0) | (rxs ? SERCOM_USART_INTFLAG_RXS : 0);
+			case sercom::STATUS:
+				return status;
+			case sercom::DATA: {
+				if (rx.empty())
+					return 0;
+				const uint8_t data = rx.front().data;
+				rx.pop_front();
+				if (!rx.empty())
+					status |= rx.front().errors;
+				return data;
+			}
+			default:
+				return memory.read(offset);
+		}
+	}
+
+	void write(uint32_t offset, uint32_t value) override
+	{
+		switch (offset) {
+			case sercom::INTENCLR:
+				intenset &= ~value;
+				break;
+			case sercom::INTENSET:
+				intenset |= value;
+				break;
+			case sercom::INTFLAG:
+				if (value & SERCOM_USART_INTFLAG_TXC)
+					txc = false;
+				if (value & SERCOM_USART_INTFLAG_RXS)
+					rxs = false;
+				break;
+			case sercom::STATUS:
+				// The error flags are write-one-to-clear
+				status &= ~(value & (SERCOM_USART_STATUS_FERR | SERCOM_USART_STATUS_PERR | SERCOM_USART_STATUS_BUFOVF));
+				break;
+			case sercom::DATA:
+				transmitted.push_back(static_cast<uint8_t>(value));
+				txc = true;
+				break;
+			default:
+				memory.write(offset, value);
+		}
+	}
+
+private:
+	struct Received {
+		uint8_t data;
+		uint16_t errors;
+	};
+
+	Memory memory;
+	std::deque<Received> rx;
+	uint8_t intenset = 0;
+	bool txc = false;
+	bool rxs = false;
+	uint16_t status = 0;
+};
+
+} // namespace fake
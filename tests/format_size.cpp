@@ -0,0 +1,28 @@
+/*
+ * Cortex-M0+ program for format_size_test.py. Built once per variant with newlib-nano:
+ * FORMAT_BASELINE without formatting, FORMAT_MCU with MCU_FORMAT and FORMAT_SNPRINTF with snprintf
+ */
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include "format.h"
+
+volatile int sensor;
+volatile size_t length;
+char buffer[64];
+
+int main()
+{
+	const int value = sensor;
+#if defined(FORMAT_MCU)
+	mcu::BufferSink sink(buffer);
+	MCU_FORMAT(sink, "t={} raw={:04x} n={}\n", mcu::fixed(value, 2), value & 0xffff, value);
+	length = sink.size();
+#elif defined(FORMAT_SNPRINTF)
+	length = std::snprintf(buffer, sizeof(buffer), "t=%s%d.%02d raw=%04x n=%d\n", value < 0 ? "-" : "",
+		std::abs(value) / 100, std::abs(value) % 100, value & 0xffff, value);
+#else
+	length = value;
+#endif
+	return 0;
+}
@@ -0,0 +1,50 @@
+#!/usr/bin/env python3
+"""Compares the flash size of MCU_FORMAT with snprintf from newlib-nano on the Cortex-M0+.
+
+Builds format_size.cpp without formatting, with MCU_FORMAT and with snprintf, prints the text and data size
+each adds to the baseline and fails unless MCU_FORMAT is smaller.
+
+Usage: format_size_test.py arm-none-eabi-g++ arm-none-eabi-size format_size.cpp include_dir...
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+FLAGS = [
+	"-mcpu=cortex-m0plus", "-mthumb", "-Os", "-std=c++17", "-fno-exceptions", "-fno-rtti",
+	"-ffunction-sections", "-fdata-sections", "-Wl,--gc-sections", "--specs=nano.specs", "--specs=nosys.specs",
+]
+
+
+def flash_size(cxx, size, source, include_dirs, variant, tmp):
+	binary = os.path.join(tmp, variant + ".elf")
+	subprocess.run([cxx] + FLAGS + ["-D" + variant] + ["-I" + d for d in include_dirs] + [source, "-o", binary],
+		check=True)
+	# Berkeley format: text data bss dec hex filename
+	output = subprocess.run([size, binary], check=True, capture_output=True, text=True).stdout
+	text, data = output.splitlines()[1].split()[:2]
+	return int(text) + int(data)
+
+
+def main():
+	if len(sys.argv) < 4:
+		sys.exit(__doc__)
+	cxx, size, source = sys.argv[1:4]
+	include_dirs = sys.argv[4:]
+
+	with tempfile.TemporaryDirectory() as tmp:
+		sizes = {variant: flash_size(cxx, size, source, include_dirs, variant, tmp)
+			for variant in ("FORMAT_BASELINE", "FORMAT_MCU", "FORMAT_SNPRINTF")}
+
+	baseline = sizes["FORMAT_BASELINE"]
+	mcu_format = sizes["FORMAT_MCU"] - baseline
+	snprintf = sizes["FORMAT_SNPRINTF"] - baseline
+	print("MCU_FORMAT %d bytes, snprintf (newlib-nano) %d bytes of flash above a %d byte baseline"
+		% (mcu_format, snprintf, baseline))
+	sys.exit(0 if mcu_format < snprintf else 1)
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "format.h"
+
+namespace {
+
+// The format string is split at compile time, escaped braces end a literal run
+constexpr const char* SegmentFormat = "a{{b{:04x}c}}";
+constexpr auto Segments = mcu::format::parseSegments<mcu::format::countSegments(SegmentFormat)>(SegmentFormat);
+static_assert(Segments.size() == 4);
+static_assert(Segments[0].argument == -1 && Segments[0].offset == 0 && Segments[0].length == 2);
+static_assert(Segments[1].argument == -1 && Segments[1].offset == 3 && Segments[1].length == 1);
+static_assert(Segments[2].argument == 0 && Segments[2].spec.type == 'x' && Segments[2].spec.fill == '0'
+	&& Segments[2].spec.width == 4);
+static_assert(Segments[3].argument == -1 && Segments[3].offset == 10 && Segments[3].length == 2);
+
+template <typename... Args>
+std::string print(const char* format, Args... args)
+{
+	char text[64];
+	std::snprintf(text, sizeof(text), format, args...);
+	return text;
+}
+
+std::string text(const mcu::BufferSink& sink) { return std::string(sink.text().data(), sink.text().size()); }
+
+#define CHECK_FORMAT(expected, format, ...) \
+	do { \
+		char buffer[64]; \
+		mcu::BufferSink sink(buffer); \
+		MCU_FORMAT(sink, format, ##__VA_ARGS__); \
+		CHECK_EQUAL(std::string(expected), text(sink)); \
+	} while (0)
+
+enum class Mode : uint8_t { Idle = 3 };
+
+void testIntegers()
+{
+	CHECK_FORMAT(print("%d", 0), "{}", 0);
+	CHECK_FORMAT(print("%d %d", 42, -42), "{} {}", 42, -42);
+	CHECK_FORMAT(print("%d", INT32_MIN), "{}", INT32_MIN);
+	CHECK_FORMAT(print("%u", UINT32_MAX), "{}", UINT32_MAX);
+	CHECK_FORMAT(print("%d %u %u", -5, 200u, 65535u), "{} {} {}", static_cast<int8_t>(-5), static_cast<uint8_t>(200),
+		static_cast<uint16_t>(65535));
+	CHECK_FORMAT(print("[%5d] [%05d] [%5d] [%05d]", 42, 42, -42, -42), "[{:5}] [{:05}] [{:5}] [{:05}]", 42, 42, -42, -42);
+	CHECK_FORMAT(print("%2d", 12345), "{:2}", 12345);
+	CHECK_FORMAT(print("%d", 3), "{}", Mode::Idle);
+}
+
+void testHex()
+{
+	CHECK_FORMAT(print("%x %X", 0xbeefu, 0xbeefu), "{:x} {:X}", 0xbeefu, 0xbeefu);
+	// Negative values are printed as their two's complement like printf does
+	CHECK_FORMAT(print("%x", -1), "{:x}", -1);
+	CHECK_FORMAT(print("%08X %4x %04x", 0xbeefu, 0xabcdefu, 0u), "{:08X} {:4x} {:04x}", 0xbeefu, 0xabcdefu, 0u);
+	CHECK_FORMAT(print("%d", 15), "{:d}", 15);
+}
+
+void testFixed()
+{
+	CHECK_FORMAT(print("%.2f", 12.34), "{}", mcu::fixed(1234, 2));
+	CHECK_FORMAT(print("%.2f", -0.05), "{}", mcu::fixed(-5, 2));
+	CHECK_FORMAT(print("%.3f", 0.005), "{}", mcu::fixed(5, 3));
+	CHECK_FORMAT(print("%.0f", 7.0), "{}", mcu::fixed(7, 0));
+	CHECK_FORMAT(print("%.3f", -2147483.648), "{}", mcu::fixed(INT32_MIN, 3));
+	CHECK_FORMAT(print("[%8.2f] [%08.2f] [%08.2f]", -12.34, -0.05, 1.5), "[{:8}] [{:08}] [{:08}]", mcu::fixed(-1234, 2),
+		mcu::fixed(-5, 2), mcu::fixed(150, 2));
+}
+
+void testText()
+{
+	const char* name = "sensor";
+	CHECK_FORMAT(print("%s: %s %c", name, "ok", 'x'), "{}: {} {}", name, "ok", 'x');
+	CHECK_FORMAT("true false", "{} {}", true, false);
+	CHECK_FORMAT("{} {1}", "{{}} {{{}}}", 1);
+	CHECK_FORMAT("no placeholders", "no placeholders");
+}
+
+void testDivideBy10()
+{
+	uint32_t remainder;
+	for (uint32_t n = 0; n < 1000000; n++) {
+		if (mcu::format::divideBy10(n, remainder) != n / 10 || remainder != n % 10) {
+			CHECK_EQUAL(n / 10, mcu::format::divideBy10(n, remainder));
+			break;
+		}
+	}
+	for (uint64_t n = 0; n <= UINT32_MAX; n += 65521) {
+		const uint32_t value = static_cast<uint32_t>(n);
+		if (mcu::format::divideBy10(value, remainder) != value / 10 || remainder != value % 10) {
+			CHECK_EQUAL(value / 10, mcu::format::divideBy10(value, remainder));
+			break;
+		}
+	}
+	CHECK_EQUAL(UINT32_MAX / 10, mcu::format::divideBy10(UINT32_MAX, remainder));
+	CHECK_EQUAL(UINT32_MAX % 10, remainder);
+}
+
+void testSinks()
+{
+	struct Uart {
+		void transmit(std::byte data) { sent.push_back(static_cast<char>(data)); }
+		std::string sent;
+	} uart;
+	MCU_FORMAT(uart, "u{}", 1);
+	CHECK_EQUAL(std::string("u1"), uart.sent);
+
+	struct Spi {
+		uint8_t transfer(uint8_t data)
+		{
+			sent.push_back(static_cast<char>(data));
+			return 0;
+		}
+		std::string sent;
+	} spi;
+	MCU_FORMAT(spi, "s{:x}", 10);
+	CHECK_EQUAL(std::string("sa"), spi.sent);
+
+	// Output beyond the buffer is dropped
+	char small[4];
+	mcu::BufferSink sink(small);
+	MCU_FORMAT(sink, "{}", 123456);
+	CHECK_EQUAL(std::string("1234"), text(sink));
+}
+
+/**
+ * Host timings only show the relative cost, the M0+ has neither a divider nor a cache.
+ * Built with -O2, the best of several rounds is taken
+ */
+void benchmark()
+{
+	constexpr int Iterations = 200000;
+	constexpr int Rounds = 5;
+	char buffer[64];
+	size_t formatLength = 0;
+	size_t printfLength = 0;
+
+	using Nanoseconds = std::chrono::duration<double, std::nano>;
+	double formatTime = 1e30;
+	double printfTime = 1e30;
+	for (int round = 0; round < Rounds; round++) {
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < Iterations; i++) {
+			mcu::BufferSink sink(buffer);
+			MCU_FORMAT(sink, "t={} raw={:04x} n={}\n", mcu::fixed(i - 5000, 2), i & 0xffff, i);
+			formatLength += sink.size();
+		}
+		const auto middle = std::chrono::steady_clock::now();
+		for (int i = 0; i < Iterations; i++) {
+			const int value = i - 5000;
+			printfLength += std::snprintf(buffer, sizeof(buffer), "t=%s%d.%02d raw=%04x n=%d\n", value < 0 ? "-" : "",
+				std::abs(value) / 100, std::abs(value) % 100, i & 0xffff, i);
+		}
+		const auto end = std::chrono::steady_clock::now();
+		formatTime = std::min(formatTime, Nanoseconds(middle - start).count() / Iterations);
+		printfTime = std::min(printfTime, Nanoseconds(end - middle).count() / Iterations);
+	}
+
+	std::printf("MCU_FORMAT %.1f ns/call, snprintf %.1f ns/call\n", formatTime, printfTime);
+	// Same text from both
+	CHECK_EQUAL(printfLength, formatLength);
+	CHECK(formatTime < printfTime);
+}
+
+} // namespace
+
+int main()
+{
+	testIntegers();
+	testHex();
+	testFixed();
+	testText();
+	testDivideBy10();
+	testSinks();
+	benchmark();
+	return check::result();
+}
@@ -0,0 +1,196 @@
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include "check.h"
+#include "framing.h"
+
+namespace {
+
+std::vector<std::byte> bytes(std::initializer_list<unsigned> values)
+{
+	std::vector<std::byte> result;
+	for (unsigned value : values)
+		result.push_back(static_cast<std::byte>(value));
+	return result;
+}
+
+/// Collects the encoder output and checks that payload is passed from the source buffer, not from a copy
+struct Collector {
+	explicit Collector(gsl::span<const std::byte> source) : source{source} {}
+
+	void operator()(gsl::span<const std::byte> data)
+	{
+		if (data.size() > 2)
+			CHECK(data.data() >= source.data() && data.data() + data.size() <= source.data() + source.size());
+		output.insert(output.end(), data.begin(), data.end());
+	}
+
+	gsl::span<const std::byte> source;
+	std::vector<std::byte> output;
+};
+
+std::vector<std::byte> cobs(const std::vector<std::byte>& data)
+{
+	Collector collector(data);
+	mcu::cobsEncode(data, [&](gsl::span<const std::byte> run) { collector(run); });
+	return collector.output;
+}
+
+std::vector<std::byte> slip(const std::vector<std::byte>& data)
+{
+	Collector collector(data);
+	mcu::slipEncode(data, [&](gsl::span<const std::byte> run) { collector(run); });
+	return collector.output;
+}
+
+template <typename Decoder>
+void feed(Decoder& decoder, const std::vector<std::byte>& encoded)
+{
+	for (std::byte data : encoded)
+		decoder.push(data);
+}
+
+/// @return The pending frame of \p decoder, which is released
+template <typename Decoder>
+std::vector<std::byte> take(Decoder& decoder)
+{
+	const auto frame = decoder.frame();
+	if (!frame)
+		return {};
+	std::vector<std::byte> result(frame->begin(), frame->end());
+	decoder.release();
+	return result;
+}
+
+std::vector<std::byte> sequence(size_t size, unsigned first)
+{
+	std::vector<std::byte> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<std::byte>(first + i);
+	return data;
+}
+
+void testCobsVectors()
+{
+	CHECK((cobs(bytes({0x00})) == bytes({0x01, 0x01, 0x00})));
+	CHECK((cobs(bytes({0x00, 0x00})) == bytes({0x01, 0x01, 0x01, 0x00})));
+	CHECK((cobs(bytes({0x11, 0x22, 0x00, 0x33})) == bytes({0x03, 0x11, 0x22, 0x02, 0x33, 0x00})));
+	CHECK((cobs(bytes({0x11, 0x22, 0x33, 0x44})) == bytes({0x05, 0x11, 0x22, 0x33, 0x44, 0x00})));
+	CHECK((cobs(bytes({0x11, 0x00, 0x00, 0x00})) == bytes({0x02, 0x11, 0x01, 0x01, 0x01, 0x00})));
+
+	// 254 bytes fill a block, no zero is implied after it
+	std::vector<std::byte> expected = bytes({0xff});
+	const std::vector<std::byte> run = sequence(254, 1);
+	expected.insert(expected.end(), run.begin(), run.end());
+	expected.push_back(std::byte{0});
+	CHECK((cobs(run) == expected));
+
+	// 255 non-zero bytes need a second block
+	std::vector<std::byte> longRun = sequence(255, 1);
+	expected.pop_back();
+	expected.push_back(std::byte{0x02});
+	expected.push_back(std::byte{0xff});
+	expected.push_back(std::byte{0x00});
+	CHECK((cobs(longRun) == expected));
+
+	// A zero right after a full block gets its own block
+	std::vector<std::byte> runAndZero = run;
+	runAndZero.push_back(std::byte{0});
+	const std::vector<std::byte> encoded = cobs(runAndZero);
+	CHECK((std::vector<std::byte>(encoded.end() - 3, encoded.end()) == bytes({0x01, 0x01, 0x00})));
+}
+
+void testCobsRoundTrip()
+{
+	mcu::CobsDecoder<1024> decoder;
+	for (size_t size = 1; size <= 600; size += 7) {
+		// Zeros at varying distances, including runs longer than a block
+		std::vector<std::byte> data = sequence(size, 1);
+		for (size_t i = 0; i < size; i++) {
+			if (i % (size % 300 + 2) == 0)
+				data[i] = std::byte{0};
+		}
+		const std::vector<std::byte> encoded = cobs(data);
+		// The delimiter is the only zero
+		for (size_t i = 0; i + 1 < encoded.size(); i++)
+			CHECK(encoded[i] != std::byte{0});
+		CHECK(encoded.size() <= size + size / 254 + 2);
+
+		feed(decoder, encoded);
+		CHECK((take(decoder) == data));
+	}
+	CHECK_EQUAL(0u, decoder.invalidFrames());
+	CHECK_EQUAL(0u, decoder.droppedFrames());
+}
+
+void testCobsErrors()
+{
+	mcu::CobsDecoder<300> decoder;
+
+	// The code announces more bytes than arrive before the delimiter
+	std::vector<std::byte> truncated = cobs(bytes({0x11, 0x22, 0x33}));
+	truncated.erase(truncated.end() - 2);
+	feed(decoder, truncated);
+	CHECK(!decoder.frame());
+	CHECK_EQUAL(1u, decoder.invalidFrames());
+
+	// A frame longer than MaxFrameSize
+	feed(decoder, cobs(sequence(301, 1)));
+	CHECK(!decoder.frame());
+	CHECK_EQUAL(2u, decoder.invalidFrames());
+
+	// Decoding resynchronizes at the next delimiter
+	const std::vector<std::byte> data = bytes({0x00, 0x42, 0x00});
+	feed(decoder, cobs(data));
+	CHECK((take(decoder) == data));
+
+	// A second frame while the application holds the first one is dropped
+	feed(decoder, cobs(data));
+	feed(decoder, cobs(bytes({0x01})));
+	CHECK((take(decoder) == data));
+	CHECK_EQUAL(1u, decoder.droppedFrames());
+	CHECK(!decoder.frame());
+}
+
+void testSlip()
+{
+	CHECK((slip(bytes({0x01, 0xc0, 0x02, 0xdb, 0x03})) == bytes({0x01, 0xdb, 0xdc, 0x02, 0xdb, 0xdd, 0x03, 0xc0})));
+	CHECK((slip(bytes({0xc0, 0xc0})) == bytes({0xdb, 0xdc, 0xdb, 0xdc, 0xc0})));
+
+	mcu::SlipDecoder<600> decoder;
+	for (size_t size = 1; size <= 520; size += 13) {
+		const std::vector<std::byte> data = sequence(size, 0xbe);
+		feed(decoder, slip(data));
+		CHECK((take(decoder) == data));
+	}
+	CHECK_EQUAL(0u, decoder.invalidFrames());
+
+	// An escape followed by anything but ESC_END or ESC_ESC
+	feed(decoder, bytes({0x01, 0xdb, 0x05, 0x02, 0xc0}));
+	CHECK(!decoder.frame());
+	CHECK_EQUAL(1u, decoder.invalidFrames());
+	// A frame ending in the middle of an escape
+	feed(decoder, bytes({0x01, 0xdb, 0xc0}));
+	CHECK(!decoder.frame());
+	CHECK_EQUAL(2u, decoder.invalidFrames());
+	// Too long
+	feed(decoder, slip(sequence(601, 1)));
+	CHECK_EQUAL(3u, decoder.invalidFrames());
+
+	// Back to back END bytes do not produce empty frames
+	feed(decoder, bytes({0xc0, 0xc0, 0x07, 0xc0}));
+	CHECK((take(decoder) == bytes({0x07})));
+	CHECK(!decoder.frame());
+}
+
+} // namespace
+
+int main()
+{
+	testCobsVectors();
+	testCobsRoundTrip();
+	testCobsErrors();
+	testSlip();
+	return check::result();
+}
@@ -0,0 +1,164 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/i2c_model.h"
+#include "i2c_async.h"
+
+namespace {
+
+constexpr uint8_t SensorAddress = 0x48;
+constexpr uint8_t MissingAddress = 0x50;
+
+/// Interrupt handler calls before a still pending interrupt counts as a storm
+constexpr unsigned StormLimit = 100;
+
+struct Bench {
+	Bench()
+	{
+		bus.connect(sensor);
+		for (unsigned i = 0; i < sensor.registers.size(); i++)
+			sensor.registers[i] = static_cast<uint8_t>(i ^ 0x5a);
+	}
+
+	/// Takes the SERCOM interrupt while it is pending and enabled, like the NVIC. @return Number of handler calls
+	unsigned serviceInterrupts()
+	{
+		unsigned calls = 0;
+		while (bus.interruptPending() && calls < StormLimit) {
+			i2c.interrupt();
+			calls++;
+		}
+		CHECK(calls < StormLimit);
+		return calls;
+	}
+
+	/// Runs the bus until the queue is empty
+	void runUntilIdle()
+	{
+		for (unsigned bytes = 0; !i2c.idle() && bytes < 1000; bytes++) {
+			bus.advance(bus.remaining());
+			serviceInterrupts();
+		}
+		CHECK(i2c.idle());
+	}
+
+	fake::I2cMaster bus;
+	fake::SercomAttachment attachment{SERCOM0, bus};
+	fake::RegisterTarget sensor{SensorAddress};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator slowGenerator{1, clock};
+	mcu::I2cAsyncMaster<4> i2c{SERCOM0, generator, slowGenerator, 400000};
+};
+
+struct Completion {
+	std::vector<const mcu::I2cTransaction*> order;
+	std::vector<mcu::I2cStatus> statuses;
+
+	static void record(mcu::I2cTransaction& transaction, mcu::I2cStatus status, void* context)
+	{
+		Completion& self = *static_cast<Completion*>(context);
+		self.order.push_back(&transaction);
+		self.statuses.push_back(status);
+	}
+};
+
+void testTransactions()
+{
+	Bench bench;
+	Completion completion;
+
+	const std::array<std::byte, 3> update = {std::byte{0x10}, std::byte{0xa1}, std::byte{0xa2}};
+	mcu::I2cTransaction write{SensorAddress, update, {}, &Completion::record, &completion};
+	const std::byte reg{0x20};
+	std::array<std::byte, 4> data = {};
+	mcu::I2cTransaction read{SensorAddress, gsl::span<const std::byte>(&reg, 1), data, &Completion::record, &completion};
+	mcu::I2cTransaction missing{MissingAddress, update, {}, &Completion::record, &completion};
+
+	CHECK(bench.i2c.enqueue(write));
+	CHECK(bench.i2c.enqueue(missing));
+	CHECK(bench.i2c.enqueue(read));
+	CHECK_EQUAL(3u, bench.i2c.pending());
+	bench.runUntilIdle();
+
+	CHECK((completion.order == std::vector<const mcu::I2cTransaction*>{&write, &missing, &read}));
+	CHECK((completion.statuses == std::vector<mcu::I2cStatus>{
+		mcu::I2cStatus::Ok, mcu::I2cStatus::AddressNack, mcu::I2cStatus::Ok}));
+	CHECK_EQUAL(0xa1, bench.sensor.registers[0x10]);
+	CHECK_EQUAL(0xa2, bench.sensor.registers[0x11]);
+	for (size_t i = 0; i < data.size(); i++)
+		CHECK_EQUAL((0x20 + i) ^ 0x5a, std::to_integer<unsigned>(data[i]));
+	// Smart mode NACKs the last byte, nothing is read beyond it
+	CHECK_EQUAL(4u, bench.sensor.reads);
+	CHECK_EQUAL(3u, bench.bus.stops);
+}
+
+void testChainedFromCallback()
+{
+	Bench bench;
+	struct Chain {
+		mcu::I2cAsyncMaster<4>* i2c;
+		mcu::I2cTransaction* next;
+		unsigned calls;
+	} chain{&bench.i2c, nullptr, 0};
+	const auto enqueueNext = [](mcu::I2cTransaction&, mcu::I2cStatus, void* context) {
+		Chain& self = *static_cast<Chain*>(context);
+		self.calls++;
+		if (self.next != nullptr)
+			CHECK(self.i2c->enqueue(*std::exchange(self.next, nullptr)));
+	};
+
+	const std::byte reg{0x30};
+	std::array<std::byte, 2> first = {};
+	std::array<std::byte, 2> second = {};
+	mcu::I2cTransaction a{SensorAddress, gsl::span<const std::byte>(&reg, 1), first, enqueueNext, &chain};
+	mcu::I2cTransaction b{SensorAddress, gsl::span<const std::byte>(&reg, 1), second, enqueueNext, &chain};
+	chain.next = &b;
+	CHECK(bench.i2c.enqueue(a));
+	bench.runUntilIdle();
+	CHECK_EQUAL(2u, chain.calls);
+	CHECK_EQUAL(0x30u ^ 0x5a, std::to_integer<unsigned>(second[0]));
+}
+
+void testIdleInterrupts()
+{
+	Bench bench;
+	// Nothing is enabled before the first transaction
+	CHECK_EQUAL(0, bench.bus.enabledInterrupts());
+
+	const std::byte reg{0x00};
+	std::array<std::byte, 2> data = {};
+	mcu::I2cTransaction read{SensorAddress, gsl::span<const std::byte>(&reg, 1), data};
+	CHECK(bench.i2c.enqueue(read));
+	CHECK_EQUAL(SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB, bench.bus.enabledInterrupts());
+	bench.runUntilIdle();
+	CHECK_EQUAL(0, bench.bus.enabledInterrupts());
+
+	// A flag set while idle, e.g. by blocking use of the bus, does not interrupt
+	bench.bus.raise(SERCOM_I2CM_INTFLAG_MB);
+	CHECK(!bench.bus.interruptPending());
+	// A spurious call of the handler clears the flag instead of leaving it for the next transaction
+	bench.i2c.interrupt();
+	CHECK_EQUAL(0, bench.bus.pendingFlags());
+	CHECK(bench.i2c.idle());
+
+	// The next transaction works normally
+	CHECK(bench.i2c.enqueue(read));
+	bench.runUntilIdle();
+	CHECK(read.status == mcu::I2cStatus::Ok);
+	CHECK_EQUAL(0, bench.bus.enabledInterrupts());
+}
+
+} // namespace
+
+int main()
+{
+	testTransactions();
+	testChainedFromCallback();
+	testIdleInterrupts();
+	return check::result();
+}
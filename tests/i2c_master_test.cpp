@@ -0,0 +1,269 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/i2c_model.h"
+#include "i2c_master.h"
+
+namespace {
+
+constexpr uint8_t SensorAddress = 0x48;
+constexpr uint8_t MissingAddress = 0x50;
+constexpr uint8_t SdaPin = 8;
+constexpr uint8_t SclPin = 9;
+constexpr unsigned PinFunction = 2;
+const mcu::I2cRecoveryPins RecoveryPins = {mcu::GPIO(SdaPin), mcu::GPIO(SclPin), PinFunction};
+
+/// Register file that stretches SCL forever after \p reads bytes were read
+class StretchingTarget final : public fake::I2cTarget {
+public:
+	StretchingTarget(uint8_t address, fake::I2cMaster& bus, unsigned reads) : I2cTarget{address}, bus{bus}, limit{reads} {}
+
+	bool write(uint8_t) override { return true; }
+
+	uint8_t read() override
+	{
+		if (++reads == limit)
+			bus.holdScl();
+		return static_cast<uint8_t>(reads);
+	}
+
+	fake::I2cMaster& bus;
+	const unsigned limit;
+	unsigned reads = 0;
+};
+
+/// Level of SDA as read back through PORT during the recovery
+void setSda(bool high)
+{
+	if (high)
+		PORT->Group[0].IN.reg |= 1u << SdaPin;
+	else
+		PORT->Group[0].IN.reg &= ~(1u << SdaPin);
+}
+
+bool pinsRoutedToSercom()
+{
+	return PORT->Group[0].PINCFG[SdaPin].bit.PMUXEN && PORT->Group[0].PINCFG[SclPin].bit.PMUXEN
+		&& PORT->Group[0].PMUX[SdaPin >> 1].bit.PMUXE == PinFunction
+		&& PORT->Group[0].PMUX[SclPin >> 1].bit.PMUXO == PinFunction;
+}
+
+struct Bench {
+	Bench()
+	{
+		bus.connect(sensor);
+		for (unsigned i = 0; i < sensor.registers.size(); i++)
+			sensor.registers[i] = static_cast<uint8_t>(i ^ 0x5a);
+	}
+
+	fake::I2cMaster bus;
+	fake::SercomAttachment attachment{SERCOM0, bus};
+	fake::RegisterTarget sensor{SensorAddress};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator slowGenerator{1, clock};
+	mcu::I2cMaster i2c{SERCOM0, generator, slowGenerator, 400000};
+};
+
+void testBursts()
+{
+	Bench bench;
+	std::array<std::byte, 6> data = {};
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x3b, data));
+	for (size_t i = 0; i < data.size(); i++)
+		CHECK_EQUAL((0x3bu + i) ^ 0x5a, std::to_integer<unsigned>(data[i]));
+	// The last byte is NACKed, nothing is read beyond it
+	CHECK_EQUAL(6u, bench.sensor.reads);
+	CHECK_EQUAL(1u, bench.bus.stops);
+	// Address, register, repeated start and the data
+	CHECK_EQUAL(3u + 6, bench.bus.bytes);
+
+	const std::array<std::byte, 3> update = {std::byte{0x01}, std::byte{0x02}, std::byte{0x03}};
+	CHECK(bench.i2c.writeRegs(SensorAddress, 0x10, update));
+	CHECK_EQUAL(0x01, bench.sensor.registers[0x10]);
+	CHECK_EQUAL(0x02, bench.sensor.registers[0x11]);
+	CHECK_EQUAL(0x03, bench.sensor.registers[0x12]);
+	CHECK_EQUAL(2u, bench.bus.stops);
+
+	// Single registers are one byte bursts
+	CHECK(bench.i2c.writeReg(SensorAddress, 0x20, std::byte{0xa5}));
+	const std::optional<std::byte> value = bench.i2c.readReg(SensorAddress, 0x20);
+	CHECK(value && *value == std::byte{0xa5});
+	CHECK_EQUAL(7u, bench.sensor.reads);
+
+	// A missing device fails and releases the bus
+	CHECK(!bench.i2c.readRegs(MissingAddress, 0x00, data));
+	CHECK(!bench.i2c.writeRegs(MissingAddress, 0x00, update));
+	CHECK_EQUAL(6u, bench.bus.stops);
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x3b, data));
+}
+
+void testBusTime()
+{
+	// Bus time of n single register reads against one burst of n registers
+	for (size_t count : {2u, 6u, 16u}) {
+		Bench bench;
+		const uint64_t period = bench.bus.sclPeriod();
+		uint64_t start = bench.bus.time();
+		for (size_t i = 0; i < count; i++)
+			CHECK(bench.i2c.readReg(SensorAddress, static_cast<uint8_t>(i)));
+		const uint64_t singles = bench.bus.time() - start;
+
+		std::array<std::byte, 16> data = {};
+		start = bench.bus.time();
+		CHECK(bench.i2c.readRegs(SensorAddress, 0, gsl::span<std::byte>(data.data(), count)));
+		const uint64_t burst = bench.bus.time() - start;
+
+		// Address, register, repeated start and data byte per read, plus the bus free time after the STOP
+		CHECK(singles >= count * (10 + 9 + 10 + 9) * period);
+		CHECK(burst >= (10 + 9 + 10 + 9 * count) * period);
+		CHECK(burst < (10 + 9 + 10 + 9 * count + 2) * period);
+		const double ratio = static_cast<double>(singles) / burst;
+		std::printf("%zu registers: %llu cycles as single reads, %llu as burst, %.2fx\n", count,
+			static_cast<unsigned long long>(singles), static_cast<unsigned long long>(burst), ratio);
+		// The ratio approaches 38 / 9 periods per register for long bursts
+		CHECK(ratio > (count == 2 ? 1.5 : count == 6 ? 2.6 : 3.4));
+	}
+}
+
+void testPollLimit()
+{
+	constexpr uint32_t PollLimit = 5000;
+	Bench bench;
+	bench.i2c.enableTimeouts(RecoveryPins, PollLimit);
+	CHECK_EQUAL(SERCOM_I2CM_CTRLA_INACTOUT(2) | SERCOM_I2CM_CTRLA_LOWTOUT,
+		SERCOM0->I2CM.CTRLA.reg & (SERCOM_I2CM_CTRLA_INACTOUT_Msk | SERCOM_I2CM_CTRLA_LOWTOUT));
+	// A byte at 400kHz fits easily
+	std::array<std::byte, 6> data = {};
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x00, data));
+	CHECK_EQUAL(0u, bench.i2c.recoveries());
+
+	// A slave stretching SCL during the address, SDA is free
+	setSda(true);
+	bench.bus.holdScl();
+	uint64_t start = bench.bus.time();
+	CHECK(!bench.i2c.readRegs(SensorAddress, 0x00, data));
+	uint64_t elapsed = bench.bus.time() - start;
+	CHECK_EQUAL(1u, bench.i2c.recoveries());
+	// One poll is one INTFLAG access in the model
+	CHECK(elapsed >= PollLimit && elapsed < PollLimit + 50);
+	CHECK(pinsRoutedToSercom());
+	CHECK(SERCOM0->I2CM.CTRLA.reg & SERCOM_I2CM_CTRLA_ENABLE);
+	CHECK(SERCOM0->I2CM.CTRLA.reg & SERCOM_I2CM_CTRLA_LOWTOUT);
+
+	// The bus works again once the slave lets go
+	bench.bus.releaseScl();
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x00, data));
+	CHECK_EQUAL(0x5au, std::to_integer<unsigned>(data[0]));
+	CHECK_EQUAL(1u, bench.i2c.recoveries());
+}
+
+void testStuckInBurst()
+{
+	constexpr uint32_t PollLimit = 20000;
+	Bench bench;
+	StretchingTarget stuck{0x30, bench.bus, 3};
+	bench.bus.connect(stuck);
+	bench.i2c.enableTimeouts(RecoveryPins, PollLimit);
+
+	// The slave hangs in the middle of a burst holding SDA low, the recovery gives up after 9 pulses
+	setSda(false);
+	std::array<std::byte, 8> data = {};
+	const uint64_t start = bench.bus.time();
+	CHECK(!bench.i2c.readRegs(0x30, 0x00, data));
+	const uint64_t elapsed = bench.bus.time() - start;
+	CHECK_EQUAL(1u, bench.i2c.recoveries());
+	CHECK_EQUAL(3u, stuck.reads);
+	// Within the documented (n + 3) * pollLimit polls
+	CHECK(elapsed < (data.size() + 3) * PollLimit);
+	CHECK(pinsRoutedToSercom());
+
+	setSda(true);
+	bench.bus.releaseScl();
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x00, data));
+	CHECK_EQUAL(0x5au, std::to_integer<unsigned>(data[0]));
+}
+
+void testLowTimeout()
+{
+	// The poll limit is longer than LOWTOUT, the hardware detects the stuck SCL first
+	constexpr uint64_t LowTimeout = 1200000;
+	Bench bench;
+	bench.i2c.enableTimeouts(RecoveryPins, 10 * LowTimeout);
+	setSda(true);
+	bench.bus.holdScl();
+	const uint64_t start = bench.bus.time();
+	CHECK(!bench.i2c.readReg(SensorAddress, 0x00));
+	const uint64_t elapsed = bench.bus.time() - start;
+	CHECK(elapsed >= LowTimeout && elapsed < LowTimeout + 50);
+	CHECK_EQUAL(1u, bench.i2c.recoveries());
+	CHECK(!(SERCOM0->I2CM.STATUS.reg & SERCOM_I2CM_STATUS_LOWTOUT));
+
+	bench.bus.releaseScl();
+	CHECK(bench.i2c.readReg(SensorAddress, 0x00));
+}
+
+void testScan()
+{
+	Bench bench;
+	fake::RegisterTarget display{0x3c};
+	bench.bus.connect(display);
+
+	const uint64_t start = bench.bus.time();
+	const mcu::I2cBusMap changed = bench.i2c.scan();
+	const uint64_t elapsed = bench.bus.time() - start;
+	for (unsigned address = 0; address < 128; address++) {
+		const bool expected = address == SensorAddress || address == 0x3c;
+		CHECK_EQUAL(expected, bench.i2c.isPresent(address));
+		CHECK_EQUAL(expected, changed.contains(address));
+	}
+	// The address byte alone, no register is touched
+	CHECK_EQUAL(0x78u - 0x08u, bench.bus.bytes);
+	CHECK_EQUAL(0x78u - 0x08u, bench.bus.stops);
+	CHECK_EQUAL(0u, bench.sensor.reads);
+	CHECK(elapsed < (0x78 - 0x08) * 12 * bench.bus.sclPeriod());
+	std::printf("Scan of 112 addresses: %llu SCL periods\n",
+		static_cast<unsigned long long>(elapsed / bench.bus.sclPeriod()));
+
+	// The cached map does not touch the bus
+	const uint64_t time = bench.bus.time();
+	CHECK(bench.i2c.isPresent(SensorAddress));
+	CHECK(!bench.i2c.isPresent(MissingAddress));
+	CHECK_EQUAL(time, bench.bus.time());
+
+	// A rescan reports only what changed
+	display.present = false;
+	mcu::I2cBusMap rescan = bench.i2c.scan();
+	for (unsigned address = 0; address < 128; address++)
+		CHECK_EQUAL(address == 0x3c, rescan.contains(address));
+	CHECK(!bench.i2c.isPresent(0x3c));
+	CHECK(bench.i2c.isPresent(SensorAddress));
+	CHECK(bench.i2c.scan().empty());
+
+	display.present = true;
+	CHECK(bench.i2c.probe(0x3c));
+	CHECK(bench.i2c.busMap().contains(0x3c));
+
+	// Quick commands are off again, register reads work
+	CHECK(!(SERCOM0->I2CM.CTRLB.reg & SERCOM_I2CM_CTRLB_QCEN));
+	std::array<std::byte, 2> data = {};
+	CHECK(bench.i2c.readRegs(SensorAddress, 0x02, data));
+	CHECK_EQUAL(0x02u ^ 0x5a, std::to_integer<unsigned>(data[0]));
+}
+
+} // namespace
+
+int main()
+{
+	testBursts();
+	testBusTime();
+	testPollLimit();
+	testStuckInBurst();
+	testLowTimeout();
+	testScan();
+	return check::result();
+}
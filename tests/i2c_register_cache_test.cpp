@@ -0,0 +1,153 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/i2c_model.h"
+#include "i2c_register_cache.h"
+
+namespace {
+
+constexpr uint8_t SensorAddress = 0x68;
+
+using Kind = mcu::I2cRegisterKind;
+/// Identification, three data registers, configuration and a write-only command register
+constexpr std::array<Kind, 16> SensorRegisters = {
+	Kind::Cacheable, Kind::Volatile, Kind::Volatile, Kind::Volatile,
+	Kind::Cacheable, Kind::Cacheable, Kind::Cacheable, Kind::Cacheable,
+	Kind::WriteOnly, Kind::Cacheable, Kind::Cacheable, Kind::Cacheable,
+	Kind::Cacheable, Kind::Cacheable, Kind::Cacheable, Kind::Cacheable,
+};
+
+struct Bench {
+	Bench()
+	{
+		bus.connect(sensor);
+		for (unsigned i = 0; i < 16; i++)
+			sensor.registers[i] = static_cast<uint8_t>(0xa0 + i);
+	}
+
+	/// @return Transactions on the bus since the last call
+	unsigned transactions()
+	{
+		const unsigned count = bus.stops - lastStops;
+		lastStops = bus.stops;
+		return count;
+	}
+
+	fake::I2cMaster bus;
+	fake::SercomAttachment attachment{SERCOM0, bus};
+	fake::RegisterTarget sensor{SensorAddress};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator slowGenerator{1, clock};
+	mcu::I2cMaster i2c{SERCOM0, generator, slowGenerator, 400000};
+	mcu::I2cRegisterCache<SensorRegisters> cache{i2c, SensorAddress};
+	unsigned lastStops = 0;
+};
+
+void testReads()
+{
+	Bench bench;
+	// A cacheable register is read from the bus once
+	CHECK(bench.cache.read(0x04) == std::byte{0xa4});
+	CHECK_EQUAL(1u, bench.transactions());
+	bench.sensor.registers[0x04] = 0x00;
+	for (unsigned i = 0; i < 3; i++)
+		CHECK(bench.cache.read(0x04) == std::byte{0xa4});
+	CHECK_EQUAL(0u, bench.transactions());
+	CHECK_EQUAL(1u, bench.cache.statistics().misses);
+	CHECK_EQUAL(3u, bench.cache.statistics().hits);
+
+	// Volatile registers always go to the bus
+	CHECK(bench.cache.read(0x01) == std::byte{0xa1});
+	bench.sensor.registers[0x01] = 0x11;
+	CHECK(bench.cache.read(0x01) == std::byte{0x11});
+	CHECK_EQUAL(2u, bench.transactions());
+	CHECK_EQUAL(3u, bench.cache.statistics().misses);
+	CHECK(bench.cache.write(0x02, std::byte{0x22}));
+	CHECK_EQUAL(1u, bench.transactions());
+	CHECK_EQUAL(0x22, bench.sensor.registers[0x02]);
+	CHECK(!bench.cache.needsFlush());
+
+	// A write-only register is never read from the bus
+	CHECK(!bench.cache.read(0x08));
+	CHECK(bench.cache.write(0x08, std::byte{0x5a}));
+	CHECK(bench.cache.read(0x08) == std::byte{0x5a});
+	CHECK_EQUAL(0u, bench.transactions());
+}
+
+void testWrites()
+{
+	Bench bench;
+	// Writing the value the register already holds generates no traffic
+	CHECK(bench.cache.read(0x05) == std::byte{0xa5});
+	bench.transactions();
+	CHECK(bench.cache.write(0x05, std::byte{0xa5}));
+	CHECK(!bench.cache.needsFlush());
+	CHECK(bench.cache.flush());
+	CHECK_EQUAL(0u, bench.transactions());
+
+	// A read-modify-write of a cached register needs no read
+	CHECK(bench.cache.modify(0x05, std::byte{0x0f}, std::byte{0x03}));
+	CHECK_EQUAL(0u, bench.transactions());
+	CHECK_EQUAL(0xa5, bench.sensor.registers[0x05]);
+
+	// Adjacent dirty registers go out in one burst
+	CHECK(bench.cache.write(0x04, std::byte{0x14}));
+	CHECK(bench.cache.write(0x06, std::byte{0x16}));
+	CHECK(bench.cache.write(0x0c, std::byte{0x1c}));
+	CHECK(bench.cache.needsFlush());
+	const unsigned bytes = bench.bus.bytes;
+	CHECK(bench.cache.flush());
+	CHECK(!bench.cache.needsFlush());
+	CHECK_EQUAL(2u, bench.transactions());
+	// Address and register byte per burst
+	CHECK_EQUAL(2 + 3 + 2 + 1u, bench.bus.bytes - bytes);
+	CHECK_EQUAL(2u, bench.cache.statistics().burstWrites);
+	CHECK_EQUAL(4u, bench.cache.statistics().registersWritten);
+	CHECK_EQUAL(0x14, bench.sensor.registers[0x04]);
+	CHECK_EQUAL(0xa3, bench.sensor.registers[0x05]);
+	CHECK_EQUAL(0x16, bench.sensor.registers[0x06]);
+	CHECK_EQUAL(0x1c, bench.sensor.registers[0x0c]);
+	CHECK(bench.cache.flush());
+	CHECK_EQUAL(0u, bench.transactions());
+}
+
+void testFailedFlush()
+{
+	Bench bench;
+	CHECK(bench.cache.write(0x09, std::byte{0x19}));
+	CHECK(bench.cache.write(0x0a, std::byte{0x1a}));
+	bench.sensor.present = false;
+	CHECK(!bench.cache.flush());
+	// The registers stay dirty and are not counted
+	CHECK(bench.cache.needsFlush());
+	CHECK_EQUAL(0u, bench.cache.statistics().burstWrites);
+	CHECK_EQUAL(0u, bench.cache.statistics().registersWritten);
+	CHECK_EQUAL(0xa9, bench.sensor.registers[0x09]);
+
+	bench.sensor.present = true;
+	CHECK(bench.cache.flush());
+	CHECK(!bench.cache.needsFlush());
+	CHECK_EQUAL(1u, bench.cache.statistics().burstWrites);
+	CHECK_EQUAL(0x19, bench.sensor.registers[0x09]);
+	CHECK_EQUAL(0x1a, bench.sensor.registers[0x0a]);
+
+	// After invalidate() the next read goes to the bus again
+	bench.transactions();
+	bench.cache.invalidate();
+	CHECK(bench.cache.read(0x09) == std::byte{0x19});
+	CHECK_EQUAL(1u, bench.transactions());
+}
+
+} // namespace
+
+int main()
+{
+	testReads();
+	testWrites();
+	testFailedFlush();
+	return check::result();
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/i2c_model.h"
+#include "i2c_scheduler.h"
+
+namespace {
+
+static_assert(!std::is_copy_constructible_v<mcu::I2cPollTask> && !std::is_move_constructible_v<mcu::I2cPollTask>);
+static_assert(!std::is_copy_assignable_v<mcu::I2cPollTask> && !std::is_move_assignable_v<mcu::I2cPollTask>);
+static_assert(!std::is_move_constructible_v<mcu::I2cPollDevice<4, 4>>);
+
+/// 1ms ticks at 48MHz
+constexpr uint32_t Reload = 47999;
+constexpr uint32_t TickCycles = Reload + 1;
+
+/// Bus time of a burst read in SCL periods: address, register, repeated start and the data
+constexpr uint32_t burstPeriods(uint32_t length) { return 10 + 9 + 10 + 9 * length; }
+
+/**
+ * Runs the scheduler with SysTick and the SERCOM interrupt against the simulated bus.
+ * SysTick is taken first when both are pending.
+ */
+struct Bench {
+	explicit Bench(unsigned frequency) : i2c{SERCOM0, generator, slowGenerator, frequency}
+	{
+		for (fake::RegisterTarget* target : {&a, &b, &c}) {
+			bus.connect(*target);
+			for (unsigned i = 0; i < target->registers.size(); i++)
+				target->registers[i] = static_cast<uint8_t>(i + target->address);
+		}
+		SysTick->LOAD = Reload;
+		SCB->ICSR = 0;
+		updateSysTick();
+	}
+
+	~Bench() { SCB->ICSR = 0; }
+
+	void updateSysTick() { SysTick->VAL = Reload - bus.time() % TickCycles; }
+
+	void serviceInterrupts()
+	{
+		for (unsigned calls = 0; bus.interruptPending(); calls++) {
+			if (calls == 100) {
+				CHECK(false);
+				return;
+			}
+			i2c.interrupt();
+			updateSysTick();
+		}
+	}
+
+	void run(uint32_t ticks)
+	{
+		const uint64_t end = bus.time() + uint64_t{ticks} * TickCycles;
+		while (bus.time() < end) {
+			const uint64_t nextTick = (uint64_t{scheduler.ticks()} + 1) * TickCycles;
+			uint64_t next = std::min(end, nextTick);
+			if (bus.remaining() != 0)
+				next = std::min(next, bus.time() + bus.remaining());
+			if (next > bus.time())
+				bus.advance(next - bus.time());
+			updateSysTick();
+			if (bus.time() >= nextTick) {
+				scheduler.tick();
+				updateSysTick();
+			}
+			serviceInterrupts();
+		}
+	}
+
+	/// Checks that the samples of \p device were taken every period and hold the registers from \p reg on
+	template <size_t BurstLength, size_t Depth>
+	void checkSamples(mcu::I2cPollDevice<BurstLength, Depth>& device, const fake::RegisterTarget& target, uint8_t reg)
+	{
+		mcu::I2cSample<BurstLength> sample;
+		uint32_t previous = 0;
+		bool first = true;
+		while (device.pop(sample)) {
+			if (!first)
+				CHECK_EQUAL(device.period(), sample.timestamp - previous);
+			first = false;
+			previous = sample.timestamp;
+			for (size_t i = 0; i < BurstLength; i++)
+				CHECK_EQUAL(target.registers[reg + i], std::to_integer<unsigned>(sample.data[i]));
+		}
+	}
+
+	fake::I2cMaster bus;
+	fake::SercomAttachment attachment{SERCOM0, bus};
+	fake::RegisterTarget a{0x10};
+	fake::RegisterTarget b{0x11};
+	fake::RegisterTarget c{0x12};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator slowGenerator{1, clock};
+	mcu::I2cAsyncMaster<4> i2c;
+	mcu::I2cPollScheduler<4> scheduler{i2c};
+};
+
+void testDeadlines()
+{
+	// A third of the bus time at 400kHz, even the ticks where all three are due fit
+	Bench bench(400000);
+	mcu::I2cPollDevice<4, 128> a(0x10, 0x00, 1);
+	mcu::I2cPollDevice<8, 64> b(0x11, 0x20, 2);
+	mcu::I2cPollDevice<16, 32> c(0x12, 0x40, 5);
+	bench.scheduler.add(c);
+	bench.scheduler.add(a);
+	bench.scheduler.add(b);
+	bench.run(100);
+
+	// The reads due in the last tick are still on the bus
+	CHECK_EQUAL(99u, a.statistics().samples);
+	CHECK_EQUAL(49u, b.statistics().samples);
+	CHECK_EQUAL(19u, c.statistics().samples);
+	for (const mcu::I2cPollTask* task : {static_cast<mcu::I2cPollTask*>(&a), static_cast<mcu::I2cPollTask*>(&b),
+		static_cast<mcu::I2cPollTask*>(&c)}) {
+		CHECK_EQUAL(0u, task->statistics().overruns);
+		CHECK_EQUAL(0u, task->statistics().errors);
+		CHECK_EQUAL(0u, task->statistics().dropped);
+		// Every read completes before it is due again
+		CHECK(task->statistics().maxLatency < task->period() * TickCycles);
+	}
+
+	// The shortest period is queued first in every tick, so it never waits for the others
+	const uint64_t period = bench.bus.sclPeriod();
+	CHECK(TickCycles > (burstPeriods(4) + burstPeriods(8) + burstPeriods(16)) * period);
+	CHECK(a.statistics().minLatency >= burstPeriods(4) * period);
+	CHECK(a.statistics().maxLatency < (burstPeriods(4) + 2) * period);
+	CHECK(a.jitter() < 2 * period);
+	// c waits for a and b in the ticks where all three are due
+	CHECK(c.statistics().maxLatency >= (burstPeriods(4) + burstPeriods(8) + burstPeriods(16)) * period);
+
+	bench.checkSamples(a, bench.a, 0x00);
+	bench.checkSamples(b, bench.b, 0x20);
+	bench.checkSamples(c, bench.c, 0x40);
+}
+
+void testLatencyAcrossTicks()
+{
+	// A 32 byte burst at 100kHz takes more than 3 ticks
+	Bench bench(100000);
+	mcu::I2cPollDevice<32, 16> c(0x12, 0x40, 5);
+	bench.scheduler.add(c);
+	bench.run(50);
+
+	const uint64_t busTime = burstPeriods(32) * bench.bus.sclPeriod();
+	CHECK(busTime > 3 * TickCycles);
+	CHECK_EQUAL(9u, c.statistics().samples);
+	CHECK_EQUAL(0u, c.statistics().overruns);
+	// Not folded into one SysTick period
+	CHECK(c.statistics().minLatency >= busTime);
+	CHECK(c.statistics().maxLatency < busTime + TickCycles / 10);
+}
+
+void testOverload()
+{
+	// b needs 1.7 ticks of bus time every 2 ticks, together with a the bus is overloaded
+	Bench bench(400000);
+	mcu::I2cPollDevice<6, 128> a(0x10, 0x00, 1);
+	mcu::I2cPollDevice<80, 64> b(0x11, 0x00, 2);
+	bench.scheduler.add(a);
+	bench.scheduler.add(b);
+	bench.run(100);
+
+	CHECK(burstPeriods(80) * bench.bus.sclPeriod() > 5 * TickCycles / 3);
+	// Every due read is either sampled or counted as overrun, a read still on the bus at the end excepted
+	const mcu::I2cPollStatistics& statsA = a.statistics();
+	const mcu::I2cPollStatistics& statsB = b.statistics();
+	CHECK(statsA.overruns + statsB.overruns > 0);
+	CHECK(statsA.samples + statsA.overruns >= 99u && statsA.samples + statsA.overruns <= 100u);
+	CHECK(statsB.samples + statsB.overruns >= 49u && statsB.samples + statsB.overruns <= 50u);
+	// a queued behind a long read of b misses its tick, which shows as latency beyond one tick
+	CHECK(statsA.maxLatency > TickCycles);
+	CHECK_EQUAL(0u, statsA.errors + statsB.errors);
+}
+
+void testPendingSysTick()
+{
+	Bench bench(400000);
+	for (unsigned i = 0; i < 7; i++)
+		bench.scheduler.tick();
+	SysTick->VAL = Reload - 100;
+	CHECK_EQUAL(7 * TickCycles + 100, bench.scheduler.time());
+
+	// Wrapped, but tick() was not called yet, e.g. from a higher priority interrupt
+	SysTick->VAL = Reload - 5;
+	SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+	CHECK_EQUAL(8 * TickCycles + 5, bench.scheduler.time());
+}
+
+} // namespace
+
+int main()
+{
+	testDeadlines();
+	testLatencyAcrossTicks();
+	testOverload();
+	testPendingSysTick();
+	return check::result();
+}
@@ -0,0 +1,101 @@
+#include <cstdint>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/i2c_model.h"
+#include "i2c_master.h"
+
+namespace {
+
+/// SCL high time of a BAUD value in ns, measured from the end of the rise
+constexpr uint32_t sclHighTime(uint32_t clockFrequency, uint16_t baud)
+{
+	return uint64_t{(baud & 0xffu) + 5} * 1000000000 / clockFrequency;
+}
+
+/// SCL low time of a BAUD value in ns. BAUDLOW = 0 uses BAUD
+constexpr uint32_t sclLowTime(uint32_t clockFrequency, uint16_t baud)
+{
+	const uint32_t low = (baud >> 8) != 0 ? baud >> 8 : baud & 0xffu;
+	return uint64_t{low + 5} * 1000000000 / clockFrequency;
+}
+
+/// @return true if the plan is valid and meets tHIGH, tLOW and the frequency limit of the I2C specification
+constexpr bool meetsSpecification(uint32_t clockFrequency, uint32_t frequency, uint32_t riseTime)
+{
+	const mcu::I2cMaster::BaudPlan plan = mcu::I2cMaster::planBaud(clockFrequency, frequency, riseTime);
+	const uint32_t lowMin = frequency <= 100000 ? 4700 : frequency <= 400000 ? 1300 : 500;
+	const uint32_t highMin = frequency <= 100000 ? 4000 : frequency <= 400000 ? 600 : 260;
+	return plan.valid && plan.frequency <= frequency
+		&& sclHighTime(clockFrequency, plan.baud) >= highMin && sclLowTime(clockFrequency, plan.baud) >= lowMin;
+}
+
+// Baud plans for common clocks
+static_assert(meetsSpecification(8000000, 100000, 215));
+static_assert(meetsSpecification(8000000, 400000, 215));
+static_assert(mcu::I2cMaster::planBaud(8000000, 100000, 215).frequency >= 95000);
+static_assert(mcu::I2cMaster::planBaud(8000000, 400000, 215).frequency >= 360000);
+static_assert(mcu::I2cMaster::planBaud(8000000, 1000000, 100).valid == false);
+static_assert(mcu::I2cMaster::planBaud(8000000, 100000, 215).baud == 0x251f);
+static_assert(mcu::I2cMaster::planBaud(8000000, 400000, 215).baud == 0x0701);
+static_assert(meetsSpecification(16000000, 100000, 215));
+static_assert(meetsSpecification(16000000, 400000, 215));
+static_assert(meetsSpecification(16000000, 1000000, 100));
+static_assert(mcu::I2cMaster::planBaud(16000000, 100000, 215).baud == 0x4f43);
+static_assert(mcu::I2cMaster::planBaud(16000000, 400000, 215).baud == 0x1307);
+static_assert(mcu::I2cMaster::planBaud(16000000, 1000000, 100).baud == 0x0301);
+static_assert(meetsSpecification(32000000, 100000, 215));
+static_assert(meetsSpecification(32000000, 400000, 215));
+static_assert(meetsSpecification(32000000, 1000000, 100));
+static_assert(mcu::I2cMaster::planBaud(32000000, 100000, 215).baud == 0xa38c);
+static_assert(mcu::I2cMaster::planBaud(32000000, 400000, 215).baud == 0x2b14);
+static_assert(mcu::I2cMaster::planBaud(32000000, 1000000, 100).baud == 0x0d05);
+static_assert(meetsSpecification(48000000, 100000, 215));
+static_assert(meetsSpecification(48000000, 400000, 215));
+static_assert(meetsSpecification(48000000, 1000000, 100));
+static_assert(mcu::I2cMaster::planBaud(48000000, 100000, 215).baud == 0xf7d4);
+static_assert(mcu::I2cMaster::planBaud(48000000, 400000, 215).baud == 0x4320);
+static_assert(mcu::I2cMaster::planBaud(48000000, 1000000, 100).baud == 0x160b);
+static_assert(mcu::I2cMaster::planBaud(48000000, 400000, 215).frequency >= 390000);
+static_assert(mcu::I2cMaster::planBaud(48000000, 1000000, 100).frequency >= 960000);
+static_assert(mcu::I2cMaster::planBaud(48000000, 1000000, 1000).valid == false);
+static_assert(mcu::I2cMaster::planBaud(1000000, 400000, 215).valid == false);
+static_assert(mcu::I2cMaster::planBaud(48000000, 1000, 215).valid == false);
+
+// A long rise time must not shorten tHIGH
+static_assert(meetsSpecification(16000000, 400000, 500));
+static_assert(meetsSpecification(8000000, 100000, 1000));
+static_assert(meetsSpecification(48000000, 1000000, 120));
+static_assert(sclHighTime(16000000, mcu::I2cMaster::planBaud(16000000, 400000, 500).baud) >= 600);
+static_assert(sclHighTime(8000000, mcu::I2cMaster::planBaud(8000000, 100000, 1000).baud) >= 4000);
+static_assert(sclHighTime(48000000, mcu::I2cMaster::planBaud(48000000, 1000000, 120).baud) >= 260);
+
+void testConfiguredBaud()
+{
+	// 215ns rise time at 48MHz
+	fake::I2cMaster bus{11};
+	fake::SercomAttachment attachment{SERCOM0, bus};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator slowGenerator{1, clock};
+
+	mcu::I2cMaster i2c{SERCOM0, generator, slowGenerator, mcu::I2cConfig<48000000, 400000>{}};
+	CHECK_EQUAL(0x4320u, SERCOM0->I2CM.BAUD.reg);
+	// The simulated SCL period runs at the planned frequency
+	CHECK_EQUAL((mcu::I2cConfig<48000000, 400000>::frequency), 48000000 / bus.sclPeriod());
+	CHECK(SERCOM0->I2CM.CTRLA.reg & SERCOM_I2CM_CTRLA_ENABLE);
+
+	// Switching speed between transactions
+	i2c.setBaud(mcu::I2cConfig<48000000, 1000000, 100>{});
+	CHECK_EQUAL(0x160bu, SERCOM0->I2CM.BAUD.reg);
+	i2c.setBaud(mcu::I2cMaster::planBaud(48000000, 100000, 215).baud);
+	CHECK_EQUAL(0xf7d4u, SERCOM0->I2CM.BAUD.reg);
+	CHECK(SERCOM0->I2CM.CTRLA.reg & SERCOM_I2CM_CTRLA_ENABLE);
+}
+
+} // namespace
+
+int main()
+{
+	testConfiguredBaud();
+	return check::result();
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Decodes the records written by binary_log_test with tools/log_decoder.py and compares them with printf.
+
+Usage: log_decoder_test.py binary_log_test objcopy
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools"))
+import log_decoder  # noqa: E402
+
+
+def main():
+	if len(sys.argv) != 3:
+		sys.exit(__doc__)
+	test_binary, objcopy = sys.argv[1:]
+
+	with tempfile.TemporaryDirectory() as tmp:
+		records_path = os.path.join(tmp, "records.bin")
+		expected_path = os.path.join(tmp, "expected.txt")
+		logstr_path = os.path.join(tmp, "logstr.bin")
+		subprocess.run([test_binary, records_path, expected_path], check=True)
+		# The host binary is ELF64, so the section is extracted with objcopy instead of read_logstr()
+		subprocess.run([objcopy, "-O", "binary", "--only-section=.logstr", test_binary, logstr_path], check=True)
+		with open(records_path, "rb") as f:
+			records = f.read()
+		with open(expected_path) as f:
+			expected = f.read().splitlines()
+		with open(logstr_path, "rb") as f:
+			logstr = f.read()
+
+	decoded = []
+	pos = 0
+	while pos < len(records):
+		length = records[pos]
+		decoded.append(log_decoder.decode_record(logstr, records[pos + 1:pos + 1 + length]))
+		pos += 1 + length
+
+	failed = len(decoded) != len(expected)
+	for got, want in zip(decoded, expected):
+		if got != want:
+			print("decoded %r, expected %r" % (got, want))
+			failed = True
+	if len(decoded) != len(expected):
+		print("decoded %d records, expected %d" % (len(decoded), len(expected)))
+	sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,220 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/usart_model.h"
+#include "modbus_rtu.h"
+
+namespace {
+
+constexpr unsigned DriverEnable = 5;
+constexpr uint8_t SlaveAddress = 0x11;
+
+std::vector<uint8_t> withCrc(std::initializer_list<uint8_t> data)
+{
+	std::vector<uint8_t> frame(data);
+	uint16_t crc = 0xffff;
+	for (uint8_t byte : frame)
+		crc = mcu::modbus::crc16Update(crc, byte);
+	frame.push_back(crc & 0xff);
+	frame.push_back(crc >> 8);
+	return frame;
+}
+
+/// The UART and the TC interrupt. The TC is plain memory, the test raises its flags
+struct Bench {
+	explicit Bench(unsigned baudRate, unsigned timerFrequency = 1000000)
+		: timerClock{timerFrequency},
+		  slave{SERCOM0, generator, baudRate, 0, TC0, timerGenerator, mcu::GPIO{DriverEnable}, SlaveAddress, table}
+	{
+		for (size_t i = 0; i < holding.size(); i++)
+			holding[i] = static_cast<uint16_t>(0x1000 + i);
+	}
+
+	/// Sends the whole response, the driver enable pin is released on TXC
+	void transmit()
+	{
+		serviceUart();
+		usart.transmissionComplete();
+		serviceUart();
+	}
+
+	void serviceUart()
+	{
+		for (unsigned calls = 0; usart.interruptPending(); calls++) {
+			if (calls == 1000) {
+				CHECK(false);
+				return;
+			}
+			slave.uartInterrupt();
+		}
+	}
+
+	void receive(const std::vector<uint8_t>& frame)
+	{
+		for (uint8_t data : frame) {
+			usart.receive(data);
+			serviceUart();
+			CHECK_EQUAL(TC_CTRLBSET_CMD_RETRIGGER, TC0->COUNT16.CTRLBSET.reg);
+		}
+	}
+
+	void timerEvent(uint8_t flag)
+	{
+		TC0->COUNT16.INTFLAG.reg = flag;
+		slave.timerInterrupt();
+		TC0->COUNT16.INTFLAG.reg = 0;
+	}
+
+	/// 1.5 and 3.5 characters of silence
+	void endOfFrame()
+	{
+		timerEvent(TC_INTFLAG_MC1);
+		timerEvent(TC_INTFLAG_OVF);
+	}
+
+	fake::Usart usart;
+	fake::SercomAttachment attachment{SERCOM0, usart};
+	fake::Clock clock{48000000};
+	fake::Clock timerClock;
+	mcu::ClockGenerator generator{0, clock};
+	mcu::ClockGenerator timerGenerator{1, timerClock};
+	std::array<uint16_t, 16> holding = {};
+	mcu::modbus::RegisterTable table{holding, {}, {}, {}};
+	mcu::ModbusRtuSlave slave;
+};
+
+void testCrc()
+{
+	// Reference frame of the Modbus specification: read 10 holding registers from address 0 of slave 1
+	const std::vector<uint8_t> frame = withCrc({0x01, 0x03, 0x00, 0x00, 0x00, 0x0a});
+	CHECK_EQUAL(0xc5, frame[6]);
+	CHECK_EQUAL(0xcd, frame[7]);
+	uint16_t crc = 0xffff;
+	for (uint8_t data : frame)
+		crc = mcu::modbus::crc16Update(crc, data);
+	CHECK_EQUAL(0, crc);
+}
+
+void testFrameTiming()
+{
+	{
+		// 11 bit characters at 9600 baud: 1718us and 4010us
+		Bench bench(9600);
+		CHECK_EQUAL(4010, TC0->COUNT16.CC[0].reg);
+		CHECK_EQUAL(1718, TC0->COUNT16.CC[1].reg);
+		CHECK_EQUAL(TC_INTENSET_OVF | TC_INTENSET_MC1, TC0->COUNT16.INTENSET.reg);
+	}
+	{
+		// Above 19200 baud the delays are fixed to 750us and 1750us
+		Bench bench(115200);
+		CHECK_EQUAL(1750, TC0->COUNT16.CC[0].reg);
+		CHECK_EQUAL(750, TC0->COUNT16.CC[1].reg);
+	}
+	{
+		// 192480 ticks at 48MHz need DIV4, both channels use the same prescaler
+		Bench bench(9600, 48000000);
+		CHECK_EQUAL(TC_CTRLA_PRESCALER_DIV4, TC0->COUNT16.CTRLA.reg & TC_CTRLA_PRESCALER_Msk);
+		CHECK_EQUAL(48120, TC0->COUNT16.CC[0].reg);
+		CHECK_EQUAL(20616, TC0->COUNT16.CC[1].reg);
+	}
+}
+
+void testRequest()
+{
+	Bench bench(19200);
+	bench.receive(withCrc({SlaveAddress, 0x03, 0x00, 0x02, 0x00, 0x02}));
+	// Nothing is answered before 3.5 characters of silence
+	bench.timerEvent(TC_INTFLAG_MC1);
+	CHECK(bench.usart.transmitted.empty());
+	bench.timerEvent(TC_INTFLAG_OVF);
+	CHECK(fake::pins.level(DriverEnable));
+	bench.transmit();
+
+	CHECK((bench.usart.transmitted == withCrc({SlaveAddress, 0x03, 0x04, 0x10, 0x02, 0x10, 0x03})));
+	CHECK(!fake::pins.level(DriverEnable));
+	CHECK_EQUAL(1u, bench.slave.statistics().frames);
+
+	// Other slaves are ignored
+	bench.usart.transmitted.clear();
+	bench.receive(withCrc({SlaveAddress + 1, 0x03, 0x00, 0x02, 0x00, 0x02}));
+	bench.endOfFrame();
+	bench.serviceUart();
+	CHECK(bench.usart.transmitted.empty());
+}
+
+void testCrcError()
+{
+	Bench bench(19200);
+	std::vector<uint8_t> frame = withCrc({SlaveAddress, 0x06, 0x00, 0x01, 0x12, 0x34});
+	frame[4] ^= 0x01;
+	bench.receive(frame);
+	bench.endOfFrame();
+	bench.serviceUart();
+	CHECK_EQUAL(1u, bench.slave.statistics().crcErrors);
+	CHECK_EQUAL(0x1001, bench.holding[1]);
+	CHECK(bench.usart.transmitted.empty());
+}
+
+void testCharacterGap()
+{
+	Bench bench(19200);
+	const std::vector<uint8_t> frame = withCrc({SlaveAddress, 0x06, 0x00, 0x01, 0x12, 0x34});
+	// More than 1.5 characters of silence within the frame
+	bench.receive(std::vector<uint8_t>(frame.begin(), frame.begin() + 3));
+	bench.timerEvent(TC_INTFLAG_MC1);
+	bench.receive(std::vector<uint8_t>(frame.begin() + 3, frame.end()));
+	bench.endOfFrame();
+	bench.serviceUart();
+	CHECK_EQUAL(1u, bench.slave.statistics().invalidFrames);
+	CHECK_EQUAL(0x1001, bench.holding[1]);
+	CHECK(bench.usart.transmitted.empty());
+
+	// The next frame is not affected
+	bench.receive(frame);
+	bench.endOfFrame();
+	bench.transmit();
+	CHECK_EQUAL(0x1234, bench.holding[1]);
+	CHECK((bench.usart.transmitted == frame));
+}
+
+void testEchoErrors()
+{
+	Bench bench(19200);
+	const std::vector<uint8_t> request = withCrc({SlaveAddress, 0x06, 0x00, 0x01, 0x12, 0x34});
+	bench.receive(request);
+	bench.endOfFrame();
+
+	// The echo of the first response byte arrives broken while the response is sent
+	bench.slave.uartInterrupt();
+	CHECK_EQUAL(1u, bench.usart.transmitted.size());
+	bench.usart.receive(request[0], SERCOM_USART_STATUS_FERR);
+	bench.slave.uartInterrupt();
+	CHECK_EQUAL(0u, bench.usart.read(fake::sercom::STATUS));
+	// The transmission went on in the same interrupt
+	CHECK_EQUAL(2u, bench.usart.transmitted.size());
+	bench.transmit();
+	CHECK((bench.usart.transmitted == request));
+
+	// The next request is not affected by the error of the echo
+	bench.receive(withCrc({SlaveAddress, 0x06, 0x00, 0x02, 0x56, 0x78}));
+	bench.endOfFrame();
+	CHECK_EQUAL(0u, bench.slave.statistics().invalidFrames);
+	CHECK_EQUAL(0x5678, bench.holding[2]);
+}
+
+} // namespace
+
+int main()
+{
+	testCrc();
+	testFrameTiming();
+	testRequest();
+	testCrcError();
+	testCharacterGap();
+	testEchoErrors();
+	return check::result();
+}
@@ -0,0 +1,105 @@
+#include <array>
+#include <cstdint>
+#include "check.h"
+#include "ring_buffer.h"
+
+using mcu::RingBuffer;
+
+namespace {
+
+void testPushPop()
+{
+	RingBuffer<int, 4> buffer;
+	CHECK(buffer.empty());
+	CHECK_EQUAL(4u, buffer.capacity());
+
+	for (int i = 0; i < 4; i++)
+		CHECK(buffer.push(i));
+	CHECK(buffer.full());
+	CHECK(!buffer.push(4));
+
+	int value = -1;
+	for (int i = 0; i < 4; i++) {
+		CHECK(buffer.pop(value));
+		CHECK_EQUAL(i, value);
+	}
+	CHECK(!buffer.pop(value));
+	CHECK(buffer.empty());
+}
+
+void testWrapAround()
+{
+	RingBuffer<uint8_t, 8> buffer;
+	uint8_t next = 0;
+	uint8_t expected = 0;
+	// The indices run far beyond the capacity
+	for (int round = 0; round < 1000; round++) {
+		while (buffer.size() < 5)
+			CHECK(buffer.push(next++));
+		uint8_t value;
+		for (int i = 0; i < 3; i++) {
+			CHECK(buffer.pop(value));
+			CHECK_EQUAL(expected++, value);
+		}
+	}
+}
+
+void testSpans()
+{
+	RingBuffer<uint8_t, 8> buffer;
+	const std::array<uint8_t, 6> first = {1, 2, 3, 4, 5, 6};
+	CHECK_EQUAL(6u, buffer.write(first));
+
+	std::array<uint8_t, 4> out = {};
+	CHECK_EQUAL(4u, buffer.read(out));
+	CHECK((out == std::array<uint8_t, 4>{1, 2, 3, 4}));
+
+	// Wraps: 2 bytes stored at the end, 6 free in two regions
+	const std::array<uint8_t, 8> second = {7, 8, 9, 10, 11, 12, 13, 14};
+	CHECK_EQUAL(6u, buffer.write(second));
+	CHECK(buffer.full());
+
+	// readable() is the contiguous part up to the end of the storage
+	gsl::span<const uint8_t> readable = buffer.readable();
+	CHECK_EQUAL(4, static_cast<int>(readable.size()));
+	CHECK_EQUAL(5, readable[0]);
+	buffer.consume(readable.size());
+	readable = buffer.readable();
+	CHECK_EQUAL(4, static_cast<int>(readable.size()));
+	CHECK_EQUAL(9, readable[0]);
+
+	std::array<uint8_t, 8> rest = {};
+	CHECK_EQUAL(4u, buffer.read(rest));
+	CHECK_EQUAL(12, rest[3]);
+	CHECK(buffer.empty());
+}
+
+void testWritableCommit()
+{
+	RingBuffer<uint8_t, 8> buffer;
+	gsl::span<uint8_t> space = buffer.writable();
+	CHECK_EQUAL(8, static_cast<int>(space.size()));
+	space[0] = 42;
+	space[1] = 43;
+	buffer.commit(2);
+	CHECK_EQUAL(2u, buffer.size());
+
+	uint8_t value;
+	CHECK(buffer.pop(value));
+	CHECK_EQUAL(42, value);
+	buffer.clear();
+	CHECK(buffer.empty());
+	// Only the part up to the end of the storage is contiguous
+	CHECK_EQUAL(6, static_cast<int>(buffer.writable().size()));
+}
+
+} // namespace
+
+int main()
+{
+	testPushPop();
+	testWrapAround();
+	testSpans();
+	testWritableCommit();
+	return check::result();
+}
@@ -0,0 +1,448 @@
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "GPIO.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "sd_card.h"
+
+namespace {
+
+constexpr unsigned ChipSelect = 10;
+constexpr size_t BlockSize = mcu::SdCard::BlockSize;
+
+/**
+ * SD card in SPI mode: a version 2 SDHC card with 1024 blocks or a version 1 SDSC card with 2048 blocks.
+ * Protocol errors of the host, like commands or tokens sent while the card is busy, are counted as violations.
+ */
+class Card final : public fake::SpiTarget {
+public:
+	enum class Type { Sdhc, Sdsc };
+
+	static constexpr unsigned InitPolls = 3;
+	static constexpr unsigned WriteBusy = 40;
+	static constexpr unsigned StopBusy = 20;
+
+	explicit Card(Type type) : SpiTarget{ChipSelect}, memory(blocksOf(type) * BlockSize), type{type}
+	{
+		for (size_t i = 0; i < memory.size(); i++)
+			memory[i] = static_cast<uint8_t>(i / BlockSize * 3 + i);
+	}
+
+	static uint32_t blocksOf(Type type) { return type == Type::Sdhc ? 1024 : 2048; }
+	uint32_t blockCount() const { return blocksOf(type); }
+	gsl::span<uint8_t> block(uint32_t index) { return gsl::span<uint8_t>(memory.data() + index * BlockSize, BlockSize); }
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		// Full duplex: the output was determined by the previous bytes
+		const bool responding = !out.empty();
+		const uint8_t miso = output();
+		receive(mosi, responding);
+		return miso;
+	}
+
+	void idleClock(uint8_t) override { idleClocks++; }
+
+	std::vector<std::string> commands;
+	std::vector<uint8_t> memory;
+	unsigned violations = 0;
+	unsigned crcErrors = 0;
+	unsigned blocksWritten = 0;
+	uint32_t preErase = 0;
+	uint32_t blockLength = 0;
+	bool crcEnabled = false;
+	bool hcs = false;
+	/// Sends a wrong CRC with the next data block
+	bool corruptNextBlock = false;
+
+private:
+	enum class Phase { Command, WriteToken, DataIn };
+
+	void onDeselect() override
+	{
+		frame.clear();
+		out.clear();
+		streaming = false;
+		if (phase != Phase::Command)
+			violations++;
+		phase = Phase::Command;
+	}
+
+	uint8_t output()
+	{
+		if (out.empty() && streaming)
+			queueBlock(nextBlock++);
+		if (!out.empty()) {
+			const uint8_t data = out.front();
+			out.pop_front();
+			return data;
+		}
+		if (pendingBusy != 0) {
+			busy = pendingBusy;
+			pendingBusy = 0;
+		}
+		if (busy != 0) {
+			busy--;
+			return 0x00;
+		}
+		return 0xff;
+	}
+
+	bool isBusy() const { return busy != 0 || pendingBusy != 0; }
+
+	/// @param responding The card was still sending a response during this byte
+	void receive(uint8_t mosi, bool responding)
+	{
+		switch (phase) {
+			case Phase::Command:
+				if (frame.empty() && (mosi & 0xc0) != 0x40)
+					return;
+				if (frame.empty() && isBusy())
+					violations++;
+				frame.push_back(mosi);
+				if (frame.size() == 6) {
+					execute();
+					frame.clear();
+				}
+				return;
+			case Phase::WriteToken:
+				if (mosi == 0xff) {
+					if (!responding)
+						gap++;
+					return;
+				}
+				// Nwr: at least one byte between the response and the first token
+				if (responding || isBusy() || (firstToken && gap == 0))
+					violations++;
+				firstToken = false;
+				if (mosi == (multiWrite ? 0xfc : 0xfe)) {
+					phase = Phase::DataIn;
+					data.clear();
+				} else if (multiWrite && mosi == 0xfd) {
+					out.push_back(0xff);
+					pendingBusy = StopBusy;
+					phase = Phase::Command;
+				} else {
+					violations++;
+				}
+				return;
+			case Phase::DataIn:
+				data.push_back(mosi);
+				if (data.size() < BlockSize + 2)
+					return;
+				if (crcEnabled && mcu::SdCard::crc16(gsl::span<const uint8_t>(data.data(), BlockSize))
+						!= ((data[BlockSize] << 8) | data[BlockSize + 1])) {
+					crcErrors++;
+					out.push_back(0xeb);
+				} else {
+					std::copy(data.begin(), data.begin() + BlockSize, block(writeBlock++).begin());
+					blocksWritten++;
+					out.push_back(0xe5);
+				}
+				pendingBusy = WriteBusy;
+				phase = multiWrite ? Phase::WriteToken : Phase::Command;
+				return;
+		}
+	}
+
+	void execute()
+	{
+		const uint8_t index = frame[0] & 0x3f;
+		const uint32_t argument = (frame[1] << 24) | (frame[2] << 16) | (frame[3] << 8) | frame[4];
+		const bool app = appCommand;
+		appCommand = false;
+		commands.push_back((app ? "ACMD" : "CMD") + std::to_string(index));
+
+		if ((crcEnabled || index == 0 || index == 8) && frame[5] != mcu::SdCard::crc7(gsl::span<const uint8_t>(frame.data(), 5))) {
+			crcErrors++;
+			respond(0x08);
+			return;
+		}
+		if (index == 12) {
+			// The byte following CMD12 is a stuff byte, the response follows after Ncr
+			out.clear();
+			streaming = false;
+			out.insert(out.end(), {0x3f, 0xff, 0x00});
+			pendingBusy = StopBusy;
+			return;
+		}
+		if (idle && index != 0 && index != 8 && index != 55 && index != 41 && index != 58 && index != 59) {
+			respond(0x04);
+			return;
+		}
+
+		switch (app ? 100 + index : index) {
+			case 0:
+				// 74 clocks with chip select high are required to enter SPI mode
+				if (idleClocks < 10)
+					violations++;
+				idle = true;
+				crcEnabled = false;
+				initCountdown = InitPolls;
+				respond(0);
+				break;
+			case 8:
+				if (type == Type::Sdsc) {
+					respond(0x04);
+				} else {
+					respond(0);
+					out.insert(out.end(), {0x00, 0x00, static_cast<uint8_t>((argument >> 8) & 0x0f), static_cast<uint8_t>(argument)});
+				}
+				break;
+			case 9: {
+				respond(0);
+				std::array<uint8_t, 16> csd = {};
+				if (type == Type::Sdhc) {
+					csd[0] = 0x40;
+				} else {
+					csd[5] = 0x09;
+					csd[8] = 0xc0;
+					csd[9] = 0x03;
+					csd[10] = 0x80;
+				}
+				queueData(csd);
+				break;
+			}
+			case 16:
+				blockLength = argument;
+				respond(argument == BlockSize ? 0 : 0x40);
+				break;
+			case 17:
+			case 18: {
+				uint32_t first;
+				if (!address(argument, first)) {
+					respond(0x20);
+					break;
+				}
+				respond(0);
+				if (index == 17)
+					queueBlock(first);
+				streaming = index == 18;
+				nextBlock = first;
+				break;
+			}
+			case 24:
+			case 25:
+				if (!address(argument, writeBlock)) {
+					respond(0x20);
+					break;
+				}
+				respond(0);
+				phase = Phase::WriteToken;
+				multiWrite = index == 25;
+				firstToken = true;
+				gap = 0;
+				break;
+			case 55:
+				appCommand = true;
+				respond(0);
+				break;
+			case 58:
+				respond(0);
+				out.insert(out.end(), {static_cast<uint8_t>(type == Type::Sdhc ? 0xc0 : 0x80), 0xff, 0x80, 0x00});
+				break;
+			case 59:
+				crcEnabled = argument & 1;
+				respond(0);
+				break;
+			case 123:
+				preErase = argument;
+				respond(0);
+				break;
+			case 141:
+				hcs = argument & (1 << 30);
+				// An SDHC card stays in idle state if the host does not support high capacity
+				if (idle && (type == Type::Sdsc || hcs) && --initCountdown == 0)
+					idle = false;
+				respond(0);
+				break;
+			default:
+				respond(0x04);
+		}
+	}
+
+	/// Queues Ncr and R1 with the idle flag
+	void respond(uint8_t flags)
+	{
+		out.push_back(0xff);
+		out.push_back(flags | (idle ? 0x01 : 0));
+	}
+
+	bool address(uint32_t argument, uint32_t& index)
+	{
+		if (type == Type::Sdsc && argument % BlockSize != 0)
+			return false;
+		index = type == Type::Sdhc ? argument : argument / BlockSize;
+		return index < blockCount();
+	}
+
+	/// Queues Nac, the start token, \p payload and its CRC
+	void queueData(gsl::span<const uint8_t> payload)
+	{
+		out.insert(out.end(), {0xff, 0xff, 0xfe});
+		out.insert(out.end(), payload.begin(), payload.end());
+		uint16_t crc = mcu::SdCard::crc16(payload);
+		if (corruptNextBlock) {
+			crc ^= 1;
+			corruptNextBlock = false;
+		}
+		out.push_back(crc >> 8);
+		out.push_back(crc & 0xff);
+	}
+
+	void queueBlock(uint32_t index) { queueData(block(index % blockCount())); }
+
+	const Type type;
+	std::vector<uint8_t> frame;
+	std::vector<uint8_t> data;
+	std::deque<uint8_t> out;
+	Phase phase = Phase::Command;
+	unsigned idleClocks = 0;
+	unsigned busy = 0;
+	unsigned pendingBusy = 0;
+	bool idle = true;
+	bool appCommand = false;
+	unsigned initCountdown = InitPolls;
+	bool streaming = false;
+	uint32_t nextBlock = 0;
+	uint32_t writeBlock = 0;
+	bool multiWrite = false;
+	bool firstToken = false;
+	unsigned gap = 0;
+};
+
+struct Bench {
+	Bench(Card::Type type, bool useCrc) : card{type}, sd{spi, chipSelect, useCrc}
+	{
+		master.connect(card);
+		chipSelect.setHigh();
+	}
+
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment{SERCOM0, master};
+	Card card;
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::SPI spi{SERCOM0, 12000000, generator};
+	mcu::GPIO chipSelect{ChipSelect};
+	mcu::SdCard sd;
+};
+
+std::vector<uint8_t> pattern(size_t size, uint8_t seed)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<uint8_t>(seed ^ (i * 13));
+	return data;
+}
+
+void testInitSdhc()
+{
+	Bench bench(Card::Type::Sdhc, false);
+	CHECK(bench.sd.init(bench.generator, 12000000));
+	CHECK(bench.sd.isHighCapacity());
+	CHECK_EQUAL(1024u, bench.sd.blockCount());
+	CHECK(bench.card.hcs);
+	const std::vector<std::string> expected = {
+		"CMD0", "CMD8", "CMD55", "ACMD41", "CMD55", "ACMD41", "CMD55", "ACMD41", "CMD58", "CMD9"
+	};
+	CHECK((bench.card.commands == expected));
+	CHECK_EQUAL(0u, bench.card.violations);
+	CHECK_EQUAL(0u, bench.card.crcErrors);
+	// Back at full speed: 48MHz / (2 * 12MHz) - 1
+	CHECK_EQUAL(1u, SERCOM0->SPI.BAUD.reg);
+}
+
+void testInitSdscWithCrc()
+{
+	Bench bench(Card::Type::Sdsc, true);
+	CHECK(bench.sd.init(bench.generator, 12000000));
+	CHECK(!bench.sd.isHighCapacity());
+	CHECK_EQUAL(2048u, bench.sd.blockCount());
+	CHECK(bench.card.crcEnabled);
+	CHECK_EQUAL(BlockSize, bench.card.blockLength);
+	// Version 1 cards reject CMD8 and do not get CMD58
+	const std::vector<std::string> expected = {
+		"CMD0", "CMD59", "CMD8", "CMD55", "ACMD41", "CMD55", "ACMD41", "CMD55", "ACMD41", "CMD16", "CMD9"
+	};
+	CHECK((bench.card.commands == expected));
+	CHECK_EQUAL(0u, bench.card.violations);
+	CHECK_EQUAL(0u, bench.card.crcErrors);
+}
+
+void checkReadWrite(Card::Type type, bool useCrc)
+{
+	Bench bench(type, useCrc);
+	CHECK(bench.sd.init(bench.generator, 12000000));
+	bench.card.commands.clear();
+
+	std::vector<uint8_t> buffer(BlockSize);
+	CHECK(bench.sd.read(5, buffer));
+	CHECK((buffer == std::vector<uint8_t>(bench.card.block(5).begin(), bench.card.block(5).end())));
+
+	// CMD18 streams the blocks, CMD12 ends the transfer
+	buffer.resize(4 * BlockSize);
+	CHECK(bench.sd.read(10, buffer));
+	CHECK((buffer == std::vector<uint8_t>(bench.card.block(10).begin(), bench.card.block(10).begin() + 4 * BlockSize)));
+
+	const std::vector<uint8_t> single = pattern(BlockSize, 0x5a);
+	CHECK(bench.sd.write(7, single));
+	CHECK((std::vector<uint8_t>(bench.card.block(7).begin(), bench.card.block(7).end()) == single));
+
+	const std::vector<uint8_t> multiple = pattern(3 * BlockSize, 0xc3);
+	CHECK(bench.sd.write(20, multiple));
+	CHECK_EQUAL(3u, bench.card.preErase);
+	CHECK((std::vector<uint8_t>(bench.card.block(20).begin(), bench.card.block(20).begin() + 3 * BlockSize) == multiple));
+	CHECK_EQUAL(4u, bench.card.blocksWritten);
+
+	// Reading right after the multi-block write has to wait for the card
+	buffer.resize(BlockSize);
+	CHECK(bench.sd.read(22, buffer));
+	CHECK((buffer == std::vector<uint8_t>(multiple.begin() + 2 * BlockSize, multiple.end())));
+
+	const std::vector<std::string> expected = {
+		"CMD17", "CMD18", "CMD12", "CMD24", "CMD55", "ACMD23", "CMD25", "CMD17"
+	};
+	CHECK((bench.card.commands == expected));
+	CHECK_EQUAL(0u, bench.card.violations);
+	CHECK_EQUAL(0u, bench.card.crcErrors);
+}
+
+void testReadWrite()
+{
+	checkReadWrite(Card::Type::Sdhc, false);
+	checkReadWrite(Card::Type::Sdsc, true);
+}
+
+void testDataCrcError()
+{
+	Bench bench(Card::Type::Sdhc, true);
+	CHECK(bench.sd.init(bench.generator, 12000000));
+	std::vector<uint8_t> buffer(2 * BlockSize);
+	bench.card.corruptNextBlock = true;
+	CHECK(!bench.sd.read(0, buffer));
+	// The failed transfer is terminated properly, the next one works
+	CHECK(bench.sd.read(0, buffer));
+	CHECK_EQUAL(0u, bench.card.violations);
+
+	// Without CRC checking the corruption goes unnoticed
+	Bench unchecked(Card::Type::Sdhc, false);
+	CHECK(unchecked.sd.init(unchecked.generator, 12000000));
+	unchecked.card.corruptNextBlock = true;
+	CHECK(unchecked.sd.read(0, buffer));
+}
+
+} // namespace
+
+int main()
+{
+	testInitSdhc();
+	testInitSdscWithCrc();
+	testReadWrite();
+	testDataCrcError();
+	return check::result();
+}
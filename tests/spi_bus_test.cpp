@@ -0,0 +1,131 @@
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "GPIO.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "spi_bus.h"
+
+namespace {
+
+constexpr unsigned FlashSelect = 10;
+constexpr unsigned SensorSelect = 12;
+
+template <typename T, typename = void>
+struct HasTransfer : std::false_type {};
+template <typename T>
+struct HasTransfer<T, std::void_t<decltype(std::declval<const T&>().transfer(uint8_t{}))>> : std::true_type {};
+template <typename T, typename = void>
+struct HasSetBaud : std::false_type {};
+template <typename T>
+struct HasSetBaud<T, std::void_t<decltype(std::declval<const T&>().setBaud(0u, std::declval<const mcu::ClockGenerator&>()))>>
+	: std::true_type {};
+
+// Only the devices reach the bus
+static_assert(!std::is_base_of_v<mcu::SPI, mcu::SpiBus>);
+static_assert(!HasTransfer<mcu::SpiBus>::value);
+static_assert(!HasSetBaud<mcu::SpiBus>::value);
+static_assert(HasTransfer<mcu::SpiDevice::Transaction>::value);
+
+/// Records MOSI and answers with a running counter
+class Device final : public fake::SpiTarget {
+public:
+	Device(unsigned chipSelect, uint8_t first) : SpiTarget{chipSelect}, next{first} {}
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		received.push_back(mosi);
+		return next++;
+	}
+
+	std::vector<uint8_t> received;
+	uint8_t next;
+};
+
+struct Bench {
+	Bench()
+	{
+		master.connect(flash);
+		master.connect(sensor);
+		flashSelect.setHigh();
+		sensorSelect.setHigh();
+	}
+
+	uint32_t ctrla() const { return SERCOM0->SPI.CTRLA.reg; }
+	unsigned mode() const { return (ctrla() & (SERCOM_SPI_CTRLA_CPHA | SERCOM_SPI_CTRLA_CPOL)) >> SERCOM_SPI_CTRLA_CPHA_Pos; }
+	bool lsbFirst() const { return (ctrla() & SERCOM_SPI_CTRLA_DORD) != 0; }
+	unsigned baud() const { return SERCOM0->SPI.BAUD.reg; }
+
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment{SERCOM0, master};
+	Device flash{FlashSelect, 0x10};
+	Device sensor{SensorSelect, 0x80};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::SpiBus bus{SERCOM0, generator};
+	mcu::GPIO flashSelect{FlashSelect};
+	mcu::GPIO sensorSelect{SensorSelect};
+	mcu::SpiDevice flashDevice{bus, flashSelect, 12000000};
+	mcu::SpiDevice sensorDevice{bus, sensorSelect, 1000000, 3, true};
+};
+
+void testSwitchDevices()
+{
+	Bench bench;
+	const std::array<uint8_t, 4> command = {0x03, 0x00, 0x10, 0x00};
+	std::array<uint8_t, 2> response = {};
+
+	{
+		auto transaction = bench.flashDevice.select();
+		CHECK_EQUAL(0u, bench.mode());
+		CHECK(!bench.lsbFirst());
+		CHECK_EQUAL(1u, bench.baud());
+		CHECK(bench.ctrla() & SERCOM_SPI_CTRLA_ENABLE);
+		transaction.write(command);
+	}
+	CHECK_EQUAL(1u, bench.bus.reconfigurations());
+	CHECK((bench.flash.received == std::vector<uint8_t>(command.begin(), command.end())));
+
+	{
+		auto transaction = bench.sensorDevice.select();
+		CHECK_EQUAL(3u, bench.mode());
+		CHECK(bench.lsbFirst());
+		CHECK_EQUAL(23u, bench.baud());
+		CHECK(bench.ctrla() & SERCOM_SPI_CTRLA_ENABLE);
+		transaction.read(response, 0x00);
+	}
+	CHECK_EQUAL(2u, bench.bus.reconfigurations());
+	CHECK((response == std::array<uint8_t, 2>{0x80, 0x81}));
+	CHECK((bench.sensor.received == std::vector<uint8_t>{0x00, 0x00}));
+	// The flash saw nothing of the sensor transaction
+	CHECK_EQUAL(command.size(), bench.flash.received.size());
+
+	// Selecting the same device again keeps the configuration
+	for (unsigned i = 0; i < 3; i++) {
+		auto transaction = bench.sensorDevice.select();
+		CHECK_EQUAL(0x82u + i, transaction.transfer(0x55));
+	}
+	CHECK_EQUAL(2u, bench.bus.reconfigurations());
+
+	{
+		auto transaction = bench.flashDevice.select();
+		CHECK_EQUAL(0u, bench.mode());
+		CHECK_EQUAL(1u, bench.baud());
+		// The counter went on with the write of the first transaction
+		CHECK_EQUAL(0x14u, transaction.transfer(0x05));
+	}
+	CHECK_EQUAL(3u, bench.bus.reconfigurations());
+	CHECK(!bench.flash.selected());
+	CHECK_EQUAL(0u, bench.master.lostWrites);
+}
+
+} // namespace
+
+int main()
+{
+	testSwitchDevices();
+	return check::result();
+}
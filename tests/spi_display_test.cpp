@@ -0,0 +1,266 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "GPIO.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "spi_display.h"
+
+namespace {
+
+constexpr unsigned ChipSelect = 10;
+constexpr unsigned DataCommand = 11;
+
+struct Window {
+	uint16_t x0, y0, x1, y1;
+	bool operator==(const Window& other) const
+	{
+		return x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1;
+	}
+};
+
+/// MIPI DBI type C controller with CASET, RASET and RAMWR into a frame buffer
+template <uint16_t Width, uint16_t Height>
+class Controller final : public fake::SpiTarget {
+public:
+	Controller() : SpiTarget{ChipSelect}, frame(Width * Height, 0) {}
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		bytes++;
+		if (!fake::pins.level(DataCommand)) {
+			command = mosi;
+			parameters.clear();
+			if (command == mcu::SpiDisplay::MemoryWrite) {
+				windows.push_back(window);
+				x = window.x0;
+				y = window.y0;
+			}
+			return 0xff;
+		}
+
+		parameters.push_back(mosi);
+		if (command == mcu::SpiDisplay::ColumnAddressSet && parameters.size() == 4) {
+			window.x0 = (parameters[0] << 8) | parameters[1];
+			window.x1 = (parameters[2] << 8) | parameters[3];
+		} else if (command == mcu::SpiDisplay::RowAddressSet && parameters.size() == 4) {
+			window.y0 = (parameters[0] << 8) | parameters[1];
+			window.y1 = (parameters[2] << 8) | parameters[3];
+		} else if (command == mcu::SpiDisplay::MemoryWrite && parameters.size() == 2) {
+			if (y > window.y1 || x >= Width || y >= Height)
+				outsideWindow++;
+			else
+				frame[y * Width + x] = (parameters[0] << 8) | parameters[1];
+			parameters.clear();
+			if (++x > window.x1) {
+				x = window.x0;
+				y++;
+			}
+		}
+		return 0xff;
+	}
+
+	uint16_t pixel(unsigned px, unsigned py) const { return frame[py * Width + px]; }
+
+	std::vector<uint16_t> frame;
+	std::vector<Window> windows;
+	size_t bytes = 0;
+	unsigned outsideWindow = 0;
+
+private:
+	uint8_t command = 0;
+	std::vector<uint8_t> parameters;
+	Window window = {};
+	unsigned x = 0;
+	unsigned y = 0;
+};
+
+/// Color of a pixel, so misplaced pixels are detected
+constexpr uint16_t color(unsigned x, unsigned y) { return static_cast<uint16_t>((x << 8) | y | 0x8000); }
+
+struct Rectangle {
+	uint16_t x, y, width, height;
+};
+
+/// Draws color() and records the requested rectangles
+struct Renderer {
+	void operator()(uint16_t x, uint16_t y, uint16_t width, uint16_t height, gsl::span<uint16_t> pixels)
+	{
+		calls->push_back({x, y, width, height});
+		CHECK_EQUAL(static_cast<size_t>(width) * height, static_cast<size_t>(pixels.size()));
+		for (unsigned row = 0; row < height; row++) {
+			for (unsigned column = 0; column < width; column++)
+				pixels[row * width + column] = color(x + column, y + row);
+		}
+	}
+
+	std::vector<Rectangle>* calls;
+};
+
+template <uint16_t Width, uint16_t Height, uint16_t TileSize, size_t StripPixels>
+struct Bench {
+	Bench()
+	{
+		master.connect(controller);
+		chipSelect.setHigh();
+		dataCommand.setHigh();
+	}
+
+	size_t flush() { return tiles.flush(Renderer{&calls}); }
+
+	/// @return true if exactly the pixels in [x0, x1] x [y0, y1] were drawn
+	bool drawnExactly(unsigned x0, unsigned y0, unsigned x1, unsigned y1) const
+	{
+		for (unsigned y = 0; y < Height; y++) {
+			for (unsigned x = 0; x < Width; x++) {
+				const bool inside = x >= x0 && x <= x1 && y >= y0 && y <= y1;
+				if (controller.pixel(x, y) != (inside ? color(x, y) : 0))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment{SERCOM0, master};
+	Controller<Width, Height> controller;
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::SPI spi{SERCOM0, 12000000, generator};
+	mcu::GPIO chipSelect{ChipSelect};
+	mcu::GPIO dataCommand{DataCommand};
+	mcu::SpiDisplay display{spi, chipSelect, dataCommand};
+	mcu::TiledDisplay<Width, Height, TileSize, StripPixels> tiles{display};
+	std::vector<Rectangle> calls;
+};
+
+void testDirtyTilesOnly()
+{
+	Bench<64, 48, 16, 1024> bench;
+	CHECK(!bench.tiles.isDirty());
+	CHECK_EQUAL(0u, bench.flush());
+
+	// Inside the second tile of the first row
+	bench.tiles.markDirty(20, 5, 10, 3);
+	CHECK(bench.tiles.isDirty());
+	const size_t sent = bench.flush();
+	CHECK(!bench.tiles.isDirty());
+
+	CHECK((bench.controller.windows == std::vector<Window>{{16, 0, 31, 15}}));
+	CHECK(bench.drawnExactly(16, 0, 31, 15));
+	// CASET, RASET and RAMWR plus the pixels
+	CHECK_EQUAL(11u + 16 * 16 * 2, sent);
+	CHECK_EQUAL(bench.controller.bytes, sent);
+	CHECK_EQUAL(0u, bench.controller.outsideWindow);
+	// Nothing is sent again without new changes
+	CHECK_EQUAL(0u, bench.flush());
+}
+
+void testMergedWindows()
+{
+	Bench<64, 48, 16, 1024> bench;
+	// Tiles 0 and 1 of the second row are merged, tile 3 is a separate window
+	bench.tiles.markDirty(0, 16, 20, 1);
+	bench.tiles.markDirty(50, 20, 2, 2);
+	const size_t sent = bench.flush();
+
+	const std::vector<Window> expected = {{0, 16, 31, 31}, {48, 16, 63, 31}};
+	CHECK((bench.controller.windows == expected));
+	CHECK_EQUAL(2 * 11u + (32 + 16) * 16 * 2, sent);
+	CHECK_EQUAL(bench.controller.bytes, sent);
+	for (unsigned y = 16; y < 32; y++) {
+		CHECK_EQUAL(color(31, y), bench.controller.pixel(31, y));
+		CHECK_EQUAL(0, bench.controller.pixel(40, y));
+		CHECK_EQUAL(color(48, y), bench.controller.pixel(48, y));
+	}
+
+	bench.tiles.markAllDirty();
+	bench.flush();
+	CHECK(bench.drawnExactly(0, 0, 63, 47));
+	// One full width window per tile row
+	CHECK_EQUAL(2u + 3u, bench.controller.windows.size());
+	CHECK_EQUAL(0u, bench.controller.outsideWindow);
+}
+
+void testStrips()
+{
+	// 128 pixels hold 2 lines of a 48 pixel wide run
+	Bench<64, 32, 16, 128> bench;
+	bench.tiles.markDirty(0, 0, 48, 16);
+	bench.flush();
+	CHECK(bench.drawnExactly(0, 0, 47, 15));
+	CHECK_EQUAL(8u, bench.calls.size());
+	for (const Rectangle& call : bench.calls) {
+		CHECK_EQUAL(48, call.width);
+		CHECK_EQUAL(2, call.height);
+	}
+}
+
+void testWideLineSplit()
+{
+	// A 48 pixel line does not fit into 32 pixels and is drawn in two parts
+	Bench<64, 32, 16, 32> bench;
+	bench.tiles.markDirty(16, 16, 48, 16);
+	const size_t sent = bench.flush();
+	CHECK((bench.controller.windows == std::vector<Window>{{16, 16, 63, 31}}));
+	CHECK(bench.drawnExactly(16, 16, 63, 31));
+	CHECK_EQUAL(32u, bench.calls.size());
+	CHECK_EQUAL(16, bench.calls[0].x);
+	CHECK_EQUAL(32, bench.calls[0].width);
+	CHECK_EQUAL(48, bench.calls[1].x);
+	CHECK_EQUAL(16, bench.calls[1].width);
+	CHECK_EQUAL(bench.controller.bytes, sent);
+	CHECK_EQUAL(0u, bench.controller.outsideWindow);
+}
+
+void testPartialTiles()
+{
+	// The last tile column and row are clipped to the screen
+	Bench<70, 40, 16, 1024> bench;
+	bench.tiles.markDirty(65, 35, 10, 10);
+	bench.tiles.markDirty(70, 0, 1, 1);
+	bench.flush();
+	CHECK((bench.controller.windows == std::vector<Window>{{64, 32, 69, 39}}));
+	CHECK(bench.drawnExactly(64, 32, 69, 39));
+}
+
+void testUiUpdates()
+{
+	// A 160x128 panel with a text line and a blinking cursor
+	Bench<160, 128, 16, 1024> bench;
+	bench.tiles.markAllDirty();
+	const size_t fullFrame = bench.flush();
+	// One window per tile row
+	CHECK_EQUAL(8 * 11u + 160 * 128 * 2, fullFrame);
+
+	// The cursor lies in one tile
+	bench.tiles.markDirty(37, 50, 2, 12);
+	const size_t cursor = bench.flush();
+	CHECK_EQUAL(11u + 16 * 16 * 2, cursor);
+	// 10 pixel high text starting at y=40 touches two tile rows
+	bench.tiles.markDirty(0, 40, 160, 10);
+	const size_t textLine = bench.flush();
+	CHECK_EQUAL(2 * (11u + 160 * 16 * 2), textLine);
+	CHECK_EQUAL(fullFrame + cursor + textLine, bench.controller.bytes);
+	CHECK_EQUAL(0u, bench.controller.outsideWindow);
+
+	std::printf("Full frame: %zu bytes, cursor blink: %zu bytes (%.1f%%), text line: %zu bytes (%.1f%%)\n",
+		fullFrame, cursor, 100.0 * cursor / fullFrame, textLine, 100.0 * textLine / fullFrame);
+	CHECK(cursor * 50 < fullFrame);
+	CHECK(textLine * 3 < fullFrame);
+}
+
+} // namespace
+
+int main()
+{
+	testDirtyTilesOnly();
+	testMergedWindows();
+	testStrips();
+	testWideLineSplit();
+	testPartialTiles();
+	testUiUpdates();
+	return check::result();
+}
@@ -0,0 +1,264 @@
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "GPIO.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "spi_nor_flash.h"
+
+namespace {
+
+constexpr unsigned ChipSelect = 10;
+
+/**
+ * W25Q80 with 1MiB. Programming and erasing keep the chip busy for a number of status reads.
+ * Everything but ReadStatus while busy and program/erase without write enable count as violations.
+ */
+class NorChip final : public fake::SpiTarget {
+public:
+	static constexpr uint32_t Size = 1 << 20;
+	static constexpr unsigned ProgramPolls = 3;
+	static constexpr unsigned ErasePolls = 20;
+
+	NorChip() : SpiTarget{ChipSelect}, memory(Size, 0xff) {}
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		const unsigned index = position++;
+		if (index == 0) {
+			command = mosi;
+			if (busyPolls != 0 && command != ReadStatus)
+				violations++;
+			else if (command == WriteEnable)
+				writeEnabled = true;
+			if (command == FastRead)
+				fastReads++;
+			return 0xff;
+		}
+		if (command == ReadJedecId)
+			return index <= 3 ? jedecId[index - 1] : 0xff;
+		if (command == ReadStatus) {
+			const uint8_t status = (busyPolls != 0 ? 0x01 : 0) | (writeEnabled ? 0x02 : 0);
+			statusReads++;
+			if (busyPolls != 0)
+				busyPolls--;
+			return status;
+		}
+		if (index <= 3) {
+			address = (address << 8) | mosi;
+			return 0xff;
+		}
+		if (command == PageProgram)
+			pageData.push_back(mosi);
+		// The fifth byte of a fast read is the dummy byte
+		if (command == FastRead && index >= 5)
+			return memory[address++ % Size];
+		return 0xff;
+	}
+
+	std::vector<uint8_t> memory;
+	unsigned violations = 0;
+	unsigned fastReads = 0;
+	unsigned statusReads = 0;
+	unsigned programs = 0;
+	/// Page programs that wrapped around to the start of their page
+	unsigned wraps = 0;
+	std::vector<std::pair<uint8_t, uint32_t>> erases;
+
+private:
+	enum Command : uint8_t {
+		WriteEnable = 0x06,
+		ReadStatus = 0x05,
+		PageProgram = 0x02,
+		FastRead = 0x0b,
+		Erase4K = 0x20,
+		Erase32K = 0x52,
+		Erase64K = 0xd8,
+		ChipErase = 0xc7,
+		ReadJedecId = 0x9f
+	};
+
+	void onSelect() override
+	{
+		position = 0;
+		address = 0;
+		pageData.clear();
+	}
+
+	/// Program and erase start when the chip is deselected
+	void onDeselect() override
+	{
+		if (position == 0 || busyPolls != 0)
+			return;
+		uint32_t eraseSize = 0;
+		switch (command) {
+			case PageProgram:
+				break;
+			case Erase4K: eraseSize = 0x1000; break;
+			case Erase32K: eraseSize = 0x8000; break;
+			case Erase64K: eraseSize = 0x10000; break;
+			case ChipErase: eraseSize = Size; break;
+			default:
+				return;
+		}
+		if (!writeEnabled) {
+			violations++;
+			return;
+		}
+		writeEnabled = false;
+
+		if (command == PageProgram) {
+			const uint32_t page = address & ~uint32_t{0xff};
+			const uint32_t offset = address & 0xff;
+			if (offset + pageData.size() > 256)
+				wraps++;
+			for (size_t i = 0; i < pageData.size(); i++)
+				memory[(page + (offset + i) % 256) % Size] &= pageData[i];
+			programs++;
+			busyPolls = ProgramPolls;
+		} else {
+			const uint32_t start = command == ChipErase ? 0 : address & ~(eraseSize - 1);
+			erases.emplace_back(command, start);
+			for (uint32_t i = 0; i < eraseSize; i++)
+				memory[(start + i) % Size] = 0xff;
+			busyPolls = ErasePolls;
+		}
+	}
+
+	static constexpr uint8_t jedecId[3] = {0xef, 0x40, 0x14};
+
+	unsigned position = 0;
+	uint8_t command = 0;
+	uint32_t address = 0;
+	std::vector<uint8_t> pageData;
+	bool writeEnabled = false;
+	unsigned busyPolls = 0;
+};
+
+struct Bench {
+	Bench()
+	{
+		master.connect(chip);
+		chipSelect.setHigh();
+		CHECK(flash.identify());
+	}
+
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment{SERCOM0, master};
+	NorChip chip;
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::SPI spi{SERCOM0, 12000000, generator};
+	mcu::GPIO chipSelect{ChipSelect};
+	mcu::SpiNorFlash flash{spi, chipSelect};
+};
+
+std::vector<uint8_t> pattern(size_t size, uint8_t seed)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<uint8_t>(seed + i * 7);
+	return data;
+}
+
+void testIdentify()
+{
+	Bench bench;
+	CHECK_EQUAL(NorChip::Size, bench.flash.size());
+	const mcu::SpiNorFlash::JedecId id = bench.flash.jedecId();
+	CHECK_EQUAL(0xef, id.manufacturer);
+	CHECK_EQUAL(0x14, id.capacity);
+}
+
+void testPageSplit()
+{
+	Bench bench;
+	const std::vector<uint8_t> data = pattern(300, 1);
+	bench.flash.write(0x1f0, data);
+
+	// 16 bytes up to the page end, a full page and the remaining 28
+	CHECK_EQUAL(3u, bench.chip.programs);
+	CHECK_EQUAL(0u, bench.chip.wraps);
+	CHECK_EQUAL(0u, bench.chip.violations);
+	CHECK((std::vector<uint8_t>(bench.chip.memory.begin() + 0x1f0, bench.chip.memory.begin() + 0x1f0 + 300) == data));
+	CHECK_EQUAL(0xff, bench.chip.memory[0x1ef]);
+	CHECK_EQUAL(0xff, bench.chip.memory[0x1f0 + 300]);
+
+	std::vector<uint8_t> readBack(300);
+	bench.flash.read(0x1f0, readBack);
+	CHECK((readBack == data));
+}
+
+void testBusyPolling()
+{
+	Bench bench;
+	// Every page program is followed by polling until the chip is ready, the next command would otherwise be lost
+	bench.flash.write(0x100, pattern(512, 3));
+	CHECK_EQUAL(2u, bench.chip.programs);
+	CHECK_EQUAL(0u, bench.chip.violations);
+	CHECK(bench.chip.statusReads >= 2 * (NorChip::ProgramPolls + 1));
+	CHECK(!bench.flash.busy());
+
+	bench.chip.statusReads = 0;
+	bench.flash.erase(0x1000, 0x1000);
+	CHECK_EQUAL(0u, bench.chip.violations);
+	CHECK_EQUAL(NorChip::ErasePolls + 1, bench.chip.statusReads);
+}
+
+void testErasePlan()
+{
+	Bench bench;
+	bench.flash.write(0x6ff0, pattern(0x20, 5));
+	bench.flash.write(0x21000, pattern(0x10, 5));
+	bench.flash.erase(0x7000, 0x1a000);
+
+	// 4K up to the 32K boundary, 32K up to the 64K boundary, one 64K block and the 4K tail
+	const std::vector<std::pair<uint8_t, uint32_t>> expected = {
+		{0x20, 0x7000}, {0x52, 0x8000}, {0xd8, 0x10000}, {0x20, 0x20000}
+	};
+	CHECK((bench.chip.erases == expected));
+	CHECK_EQUAL(0u, bench.chip.violations);
+	// Data outside the range survives
+	CHECK((std::vector<uint8_t>(bench.chip.memory.begin() + 0x6ff0, bench.chip.memory.begin() + 0x7000) == pattern(0x10, 5)));
+	CHECK_EQUAL(0xff, bench.chip.memory[0x7000]);
+	CHECK((std::vector<uint8_t>(bench.chip.memory.begin() + 0x21000, bench.chip.memory.begin() + 0x21010) == pattern(0x10, 5)));
+}
+
+void testReadCache()
+{
+	Bench bench;
+	bench.flash.write(0x100, pattern(64, 9));
+	bench.chip.fastReads = 0;
+
+	// Sequential small reads are served from one fast read
+	std::array<uint8_t, 4> chunk;
+	for (uint32_t offset = 0; offset < 32; offset += chunk.size()) {
+		bench.flash.read(0x100 + offset, chunk);
+		CHECK_EQUAL(bench.chip.memory[0x100 + offset], chunk[0]);
+	}
+	CHECK_EQUAL(1u, bench.chip.fastReads);
+
+	// Programming into the cached range invalidates it
+	bench.flash.erase(0, 0x1000);
+	const std::array<uint8_t, 2> update = {0x12, 0x34};
+	bench.flash.write(0x104, update);
+	bench.flash.read(0x104, chunk);
+	CHECK_EQUAL(0x12, chunk[0]);
+	CHECK_EQUAL(0x34, chunk[1]);
+	CHECK_EQUAL(0xff, chunk[2]);
+	CHECK_EQUAL(2u, bench.chip.fastReads);
+}
+
+} // namespace
+
+int main()
+{
+	testIdentify();
+	testPageSplit();
+	testBusyPolling();
+	testErasePlan();
+	testReadCache();
+	return check::result();
+}
@@ -0,0 +1,221 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GPIO.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "spi_queue.h"
+
+namespace {
+
+constexpr unsigned FlashSelect = 10;
+constexpr unsigned SensorSelect = 12;
+
+/// SysTick period in model steps, shorter than most transactions
+constexpr uint32_t Reload = 99;
+
+/// Records MOSI per selection and answers with a running counter
+class Device final : public fake::SpiTarget {
+public:
+	Device(unsigned chipSelect, uint8_t first) : SpiTarget{chipSelect}, next{first} {}
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		received.push_back(mosi);
+		return next++;
+	}
+
+	void idleClock(uint8_t) override { idleBytes++; }
+	void onSelect() override { selects++; }
+	void onDeselect() override { deselects++; }
+
+	std::vector<uint8_t> received;
+	uint8_t next;
+	unsigned selects = 0;
+	unsigned deselects = 0;
+	unsigned idleBytes = 0;
+};
+
+struct Completion {
+	std::vector<const mcu::SpiTransaction*> order;
+	/// Chip select level when the callback ran
+	std::vector<bool> chipSelectHigh;
+	mcu::SpiQueue<4>* queue = nullptr;
+	mcu::SpiTransaction* chained = nullptr;
+
+	static void record(mcu::SpiTransaction& transaction, void* context)
+	{
+		Completion& self = *static_cast<Completion*>(context);
+		self.order.push_back(&transaction);
+		self.chipSelectHigh.push_back(transaction.chipSelect.read());
+		if (self.chained != nullptr) {
+			CHECK(self.queue->enqueue(*self.chained));
+			self.chained = nullptr;
+		}
+	}
+};
+
+struct Bench {
+	explicit Bench(unsigned rxcDelay = 0) : master{16, rxcDelay}
+	{
+		master.connect(flash);
+		master.connect(sensor);
+		flashSelect.setMode(mcu::GPIO::Output);
+		flashSelect.setHigh();
+		sensorSelect.setMode(mcu::GPIO::Output);
+		sensorSelect.setHigh();
+		flash.deselects = 0;
+		sensor.deselects = 0;
+		SysTick->LOAD = Reload;
+		SCB->ICSR = 0;
+		updateSysTick();
+		completion.queue = &queue;
+	}
+
+	~Bench() { mcu::util::sysTickPeriods = 0; }
+
+	/// SysTick follows the steps of the model, SysTick_Handler counts the periods
+	void updateSysTick()
+	{
+		SysTick->VAL = Reload - master.steps % (Reload + 1);
+		mcu::util::sysTickPeriods = master.steps / (Reload + 1);
+	}
+
+	/// Takes the SERCOM interrupt while it is pending and lets the bus run otherwise
+	void runUntilIdle()
+	{
+		for (unsigned i = 0; i < 100000 && !queue.idle(); i++) {
+			updateSysTick();
+			if (master.interruptPending()) {
+				queue.interrupt();
+				interrupts++;
+			} else {
+				master.wait(1);
+			}
+		}
+		updateSysTick();
+		CHECK(queue.idle());
+	}
+
+	mcu::SpiTransaction transaction(mcu::GPIO chipSelect, uint32_t baud, uint8_t mode,
+		gsl::span<const uint8_t> tx, gsl::span<uint8_t> rx)
+	{
+		mcu::SpiTransaction result{chipSelect, baud, mode};
+		result.tx = tx;
+		result.rx = rx;
+		result.callback = &Completion::record;
+		result.context = &completion;
+		return result;
+	}
+
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment{SERCOM0, master};
+	Device flash{FlashSelect, 0x10};
+	Device sensor{SensorSelect, 0x80};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::GPIO flashSelect{FlashSelect};
+	mcu::GPIO sensorSelect{SensorSelect};
+	mcu::SpiQueue<4> queue{SERCOM0, generator};
+	Completion completion;
+	unsigned interrupts = 0;
+};
+
+void testOrderAndChipSelect()
+{
+	Bench bench;
+	const std::array<uint8_t, 4> command = {0x03, 0x00, 0x10, 0x00};
+	std::array<uint8_t, 4> status = {};
+	const std::array<uint8_t, 2> read = {0x0b, 0x20};
+	std::array<uint8_t, 6> data = {};
+	const std::array<uint8_t, 3> sample = {0xa1, 0xa2, 0xa3};
+
+	mcu::SpiTransaction first = bench.transaction(bench.flashSelect, 4000000, 0, command, status);
+	// rx longer than tx: the rest is clocked with 0xff
+	mcu::SpiTransaction second = bench.transaction(bench.flashSelect, 4000000, 0, read, data);
+	// Another device with another mode and clock, nothing received
+	mcu::SpiTransaction third = bench.transaction(bench.sensorSelect, 1000000, 3, sample, {});
+
+	CHECK(bench.queue.enqueue(first));
+	CHECK(bench.queue.enqueue(second));
+	CHECK(bench.queue.enqueue(third));
+	CHECK_EQUAL(3u, bench.queue.pending());
+	bench.runUntilIdle();
+
+	// Each callback exactly once, in queue order, after chip select was released
+	CHECK((bench.completion.order == std::vector<const mcu::SpiTransaction*>{&first, &second, &third}));
+	CHECK((bench.completion.chipSelectHigh == std::vector<bool>{true, true, true}));
+	CHECK_EQUAL(3u, bench.queue.statistics().completed);
+	CHECK_EQUAL(3u, bench.queue.statistics().maxDepth);
+
+	// Chip select toggles once per transaction
+	CHECK_EQUAL(2u, bench.flash.selects);
+	CHECK_EQUAL(2u, bench.flash.deselects);
+	CHECK_EQUAL(1u, bench.sensor.selects);
+	CHECK_EQUAL(1u, bench.sensor.deselects);
+	CHECK((bench.flash.received == std::vector<uint8_t>{0x03, 0x00, 0x10, 0x00, 0x0b, 0x20, 0xff, 0xff, 0xff, 0xff}));
+	CHECK((bench.sensor.received == std::vector<uint8_t>{0xa1, 0xa2, 0xa3}));
+	CHECK((status == std::array<uint8_t, 4>{0x10, 0x11, 0x12, 0x13}));
+	CHECK((data == std::array<uint8_t, 6>{0x14, 0x15, 0x16, 0x17, 0x18, 0x19}));
+	CHECK_EQUAL(0u, bench.master.overflows);
+
+	// Reconfigured for the first and for the third transaction only
+	CHECK_EQUAL(2u, bench.queue.statistics().reconfigurations);
+	CHECK_EQUAL(23u, SERCOM0->SPI.BAUD.reg);
+	CHECK_EQUAL(SERCOM_SPI_CTRLA_CPOL | SERCOM_SPI_CTRLA_CPHA,
+		SERCOM0->SPI.CTRLA.reg & (SERCOM_SPI_CTRLA_CPOL | SERCOM_SPI_CTRLA_CPHA));
+	CHECK_EQUAL(0, bench.master.enabledInterrupts());
+}
+
+void testNoInterruptStorm()
+{
+	// RXC follows DRE by half a byte, the window is full while DRE is set
+	Bench bench(8);
+	std::array<uint8_t, 64> tx = {};
+	std::array<uint8_t, 64> rx = {};
+	mcu::SpiTransaction transaction = bench.transaction(bench.flashSelect, 4000000, 0, tx, rx);
+	CHECK(bench.queue.enqueue(transaction));
+	bench.runUntilIdle();
+
+	// DRE is disabled while two bytes are in flight, so the handler runs about once per received byte
+	CHECK(bench.interrupts <= tx.size() + 2);
+	CHECK_EQUAL(0u, bench.master.gaps);
+	CHECK_EQUAL(0u, bench.master.overflows);
+	CHECK_EQUAL(64u, bench.flash.received.size());
+}
+
+void testChainedAndLatency()
+{
+	Bench bench;
+	std::array<uint8_t, 8> tx = {};
+	mcu::SpiTransaction first = bench.transaction(bench.sensorSelect, 4000000, 1, tx, {});
+	mcu::SpiTransaction second = bench.transaction(bench.sensorSelect, 5000000, 1, tx, {});
+	bench.completion.chained = &second;
+	const unsigned start = bench.master.steps;
+	CHECK(bench.queue.enqueue(first));
+	bench.runUntilIdle();
+
+	CHECK((bench.completion.order == std::vector<const mcu::SpiTransaction*>{&first, &second}));
+	CHECK_EQUAL(2u, bench.sensor.selects);
+	// 48MHz / 10MHz rounded up, SCK is 4.8MHz and not faster than requested
+	CHECK_EQUAL(4u, SERCOM0->SPI.BAUD.reg);
+
+	// Eight bytes take more than a SysTick period, the latency is not folded into one period
+	CHECK(first.latency > Reload + 1);
+	CHECK(first.latency >= 8 * 16u);
+	CHECK(first.latency <= bench.master.steps - start);
+	CHECK_EQUAL(second.latency, bench.queue.statistics().lastLatency);
+	CHECK_EQUAL(std::max(first.latency, second.latency), bench.queue.statistics().maxLatency);
+}
+
+} // namespace
+
+int main()
+{
+	testOrderAndChipSelect();
+	testNoInterruptStorm();
+	testChainedAndLatency();
+	return check::result();
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "spi_slave.h"
+
+namespace {
+
+constexpr size_t ImageSize = 16;
+
+std::vector<uint8_t> sequence(size_t size, unsigned first)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<uint8_t>(first + i);
+	return data;
+}
+
+/// Host clocking frames into the SpiSlave, the interrupt is taken \p latency steps after it became pending
+struct Bench {
+	explicit Bench(unsigned byteTime) : port{byteTime}
+	{
+		const std::vector<uint8_t> image = sequence(ImageSize, 0xa0);
+		std::copy(image.begin(), image.end(), slave.backImage().begin());
+		publish();
+	}
+
+	/// Publishes the back image between frames
+	void publish()
+	{
+		slave.publish();
+		port.startFrame({});
+		port.endFrame();
+		run(0);
+		port.miso.clear();
+		frames.clear();
+	}
+
+	/// Takes the interrupts until the frame is clocked and nothing is pending, or \p bytes were clocked
+	void run(unsigned latency, size_t bytes = SIZE_MAX)
+	{
+		unsigned pendingFor = 0;
+		while ((port.frameRunning() || port.interruptPending()) && port.miso.size() < bytes) {
+			if (port.interruptPending() && pendingFor >= latency) {
+				slave.interrupt([this](gsl::span<const uint8_t> received) {
+					frames.emplace_back(received.begin(), received.end());
+				});
+				pendingFor = 0;
+			} else {
+				if (port.interruptPending())
+					pendingFor++;
+				port.wait(1);
+			}
+		}
+	}
+
+	/// Clocks one frame of \p mosi with the interrupt taken after \p latency steps. @return MISO of the frame
+	std::vector<uint8_t> frame(const std::vector<uint8_t>& mosi, unsigned latency = 0)
+	{
+		port.miso.clear();
+		port.startFrame(mosi);
+		run(latency);
+		port.endFrame();
+		run(0);
+		return port.miso;
+	}
+
+	fake::SpiSlavePort port;
+	fake::SercomAttachment attachment{SERCOM0, port};
+	fake::Clock clock{48000000};
+	mcu::ClockGenerator generator{0, clock};
+	mcu::SpiSlave<ImageSize> slave{SERCOM0, generator};
+	std::vector<std::vector<uint8_t>> frames;
+};
+
+void testBackToBack()
+{
+	Bench bench(16);
+	const std::vector<uint8_t> mosi = sequence(ImageSize, 0x10);
+	// The preloaded first byte and the refills keep up with bytes clocked without pauses
+	for (unsigned i = 0; i < 3; i++) {
+		CHECK((bench.frame(mosi) == sequence(ImageSize, 0xa0)));
+		CHECK_EQUAL(0u, bench.port.underruns);
+	}
+	CHECK_EQUAL(3u, bench.frames.size());
+	CHECK((bench.frames.back() == mosi));
+	CHECK_EQUAL(0u, bench.port.overflows);
+	CHECK_EQUAL(0u, bench.slave.statistics().overflows);
+
+	// Behind the end of the image the first byte is 0xff
+	const std::vector<uint8_t> longer = bench.frame(sequence(ImageSize + 1, 0));
+	CHECK_EQUAL(0xffu, longer.back());
+	CHECK_EQUAL(0u, bench.port.underruns);
+}
+
+void testPublishBetweenFrames()
+{
+	Bench bench(16);
+	const std::vector<uint8_t> next = sequence(ImageSize, 0x40);
+	std::copy(next.begin(), next.end(), bench.slave.backImage().begin());
+
+	// Published in the middle of a frame, the running frame is not torn
+	bench.port.startFrame(sequence(ImageSize, 0));
+	bench.run(0, 5);
+	bench.slave.publish();
+	bench.run(0);
+	bench.port.endFrame();
+	bench.run(0);
+	CHECK((bench.port.miso == sequence(ImageSize, 0xa0)));
+	CHECK(!bench.slave.isPublishing());
+	CHECK((bench.frame(sequence(ImageSize, 0)) == next));
+}
+
+void testLatencyBudget()
+{
+	// Every refill may be late by almost one byte time, then bytes start to underrun
+	constexpr unsigned ByteTime = 32;
+	unsigned budget = 0;
+	for (unsigned latency = 0; latency < 2 * ByteTime; latency++) {
+		Bench bench(ByteTime);
+		bench.frame(sequence(ImageSize, 0), latency);
+		if (bench.port.underruns != 0)
+			break;
+		budget = latency;
+	}
+	std::printf("SPI slave: refill latency up to %u of %u steps per byte without underrun\n", budget, ByteTime);
+	CHECK(budget > ByteTime / 2);
+	CHECK(budget < ByteTime);
+
+	Bench late(ByteTime);
+	late.frame(sequence(ImageSize, 0), ByteTime);
+	CHECK(late.port.underruns > 0);
+}
+
+} // namespace
+
+int main()
+{
+	testBackToBack();
+	testPublishBetweenFrames();
+	testLatencyBudget();
+	return check::result();
+}
@@ -0,0 +1,184 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "GPIO.h"
+#include "SPI.h"
+#include "check.h"
+#include "fake/clock.h"
+#include "fake/spi_model.h"
+#include "usart_spi.h"
+
+namespace {
+
+constexpr unsigned ChipSelect = 10;
+
+// BAUD is rounded up, so SCK never exceeds the requested rate
+static_assert(mcu::StaticSPI<0, 48000000, 4000000>::baudRegister == 5);
+static_assert(mcu::StaticSPI<0, 48000000, 4000000>::frequency == 4000000);
+static_assert(mcu::StaticSPI<0, 48000000, 5000000>::baudRegister == 4);
+static_assert(mcu::StaticSPI<0, 48000000, 5000000>::frequency == 4800000);
+static_assert(mcu::StaticSPI<0, 48000000, 24000000>::baudRegister == 0);
+static_assert(mcu::StaticSPI<0, 48000000, 24000000>::frequency == 24000000);
+static_assert(mcu::StaticSPI<0, 8000000, 100000>::baudRegister == 39);
+static_assert(mcu::StaticSPI<0, 8000000, 100000>::frequency == 100000);
+static_assert(mcu::StaticSPI<0, 8000000, 3000000>::baudRegister == 1);
+static_assert(mcu::StaticSPI<0, 8000000, 3000000>::frequency == 2000000);
+// The lowest rate at 48MHz
+static_assert(mcu::StaticSPI<0, 48000000, 93750>::baudRegister == 255);
+static_assert(mcu::StaticSPI<0, 48000000, 93750>::frequency == 93750);
+static_assert(mcu::StaticSPI<0, 48000000, 93751>::baudRegister == 255);
+
+/// Records MOSI and answers with a running counter
+class Recorder final : public fake::SpiTarget {
+public:
+	Recorder() : SpiTarget{ChipSelect} {}
+
+	uint8_t exchange(uint8_t mosi) override
+	{
+		received.push_back(mosi);
+		return next++;
+	}
+
+	std::vector<uint8_t> received;
+	uint8_t next = 0x80;
+};
+
+std::vector<uint8_t> sequence(size_t size, uint8_t first)
+{
+	std::vector<uint8_t> data(size);
+	for (size_t i = 0; i < size; i++)
+		data[i] = static_cast<uint8_t>(first + i);
+	return data;
+}
+
+/// Runs transfer, write and read of \p spi against the model and prints the bytes per SCK cycle of each
+template <typename Spi>
+void checkBulkLoops(fake::SpiMaster& master, const Spi& spi, const char* name, unsigned clocksPerByte = 8)
+{
+	Recorder target;
+	master.connect(target);
+	mcu::GPIO chipSelect(ChipSelect);
+	chipSelect.setHigh();
+	chipSelect.setLow();
+
+	const std::vector<uint8_t> tx = sequence(64, 1);
+	std::vector<uint8_t> rx(tx.size());
+	master.resetStatistics();
+	spi.transfer(tx, rx);
+	CHECK((target.received == tx));
+	CHECK((rx == sequence(64, 0x80)));
+	// The next byte is always waiting in DATA when the previous one completes
+	CHECK_EQUAL(0u, master.gaps);
+	CHECK_EQUAL(0u, master.overflows);
+	const double transferRate = master.bytesPerSckCycle(clocksPerByte);
+
+	// Without rx the received bytes are discarded
+	target.received.clear();
+	master.resetStatistics();
+	spi.transfer(tx, {});
+	CHECK((target.received == tx));
+	CHECK_EQUAL(0u, master.gaps);
+	CHECK_EQUAL(0u, master.receivePending());
+
+	target.received.clear();
+	master.resetStatistics();
+	spi.write(tx);
+	CHECK((target.received == tx));
+	CHECK_EQUAL(0u, master.gaps);
+	// Returns after the last byte left the shift register, with nothing left over in the receive buffer
+	CHECK(!master.busy());
+	CHECK_EQUAL(0u, master.receivePending());
+	CHECK_EQUAL(0u, SERCOM0->SPI.STATUS.reg & SERCOM_SPI_STATUS_BUFOVF);
+	const double writeRate = master.bytesPerSckCycle(clocksPerByte);
+
+	target.received.clear();
+	target.next = 0x40;
+	master.resetStatistics();
+	spi.read(rx, 0xa5);
+	CHECK((target.received == std::vector<uint8_t>(64, 0xa5)));
+	CHECK((rx == sequence(64, 0x40)));
+	CHECK_EQUAL(0u, master.gaps);
+	CHECK_EQUAL(0u, master.overflows);
+	const double readRate = master.bytesPerSckCycle(clocksPerByte);
+
+	// The byte-wise transfer waits for RXC, SCK pauses between all bytes
+	master.resetStatistics();
+	for (uint8_t data : tx)
+		spi.transfer(data);
+	CHECK_EQUAL(63u, master.gaps);
+	const double byteRate = master.bytesPerSckCycle(clocksPerByte);
+
+	// 1 / clocksPerByte is the limit, the bulk loops lose only the start and end of the burst
+	std::printf("%s bytes per SCK cycle: transfer %.4f, write %.4f, read %.4f, byte-wise transfer %.4f\n",
+		name, transferRate, writeRate, readRate, byteRate);
+	for (double rate : {transferRate, writeRate, readRate}) {
+		CHECK(rate <= 1.0 / clocksPerByte);
+		CHECK(rate > 0.95 / clocksPerByte);
+	}
+	CHECK(byteRate < 0.95 / clocksPerByte);
+
+	CHECK_EQUAL(0u, master.lostWrites);
+	chipSelect.setHigh();
+}
+
+void testSpi()
+{
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment(SERCOM0, master);
+	fake::Clock clock(48000000);
+	mcu::ClockGenerator generator(0, clock);
+	mcu::SPI spi(SERCOM0, 4000000, generator);
+	CHECK_EQUAL(5u, SERCOM0->SPI.BAUD.reg);
+	CHECK(SERCOM0->SPI.CTRLB.bit.RXEN);
+	checkBulkLoops(master, spi, "SPI");
+	// write() enables the receiver again
+	CHECK(SERCOM0->SPI.CTRLB.bit.RXEN);
+}
+
+void testStaticSpi()
+{
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment(SERCOM0, master);
+	fake::Clock clock(48000000);
+	mcu::ClockGenerator generator(0, clock);
+	mcu::StaticSPI<0, 48000000, 4000000> spi(generator);
+	checkBulkLoops(master, spi, "StaticSPI");
+
+	// Same registers as SPI for a rate the clock divides exactly
+	mcu::SPI reference(SERCOM0, 4000000, generator, 3, true);
+	const uint32_t ctrla = SERCOM0->SPI.CTRLA.reg;
+	const uint32_t ctrlb = SERCOM0->SPI.CTRLB.reg;
+	const uint8_t baud = SERCOM0->SPI.BAUD.reg;
+	SERCOM0->SPI.CTRLA.reg = 0;
+	mcu::StaticSPI<0, 48000000, 4000000, 3, true> configured(generator);
+	CHECK_EQUAL(ctrla, SERCOM0->SPI.CTRLA.reg);
+	CHECK_EQUAL(ctrlb, SERCOM0->SPI.CTRLB.reg);
+	CHECK_EQUAL(baud, SERCOM0->SPI.BAUD.reg);
+	CHECK(SERCOM0->SPI.CTRLA.reg & SERCOM_SPI_CTRLA_DORD);
+	CHECK_EQUAL(3u, (SERCOM0->SPI.CTRLA.reg & (SERCOM_SPI_CTRLA_CPHA | SERCOM_SPI_CTRLA_CPOL)) >> SERCOM_SPI_CTRLA_CPHA_Pos);
+}
+
+void testUsartSpi()
+{
+	fake::SpiMaster master;
+	fake::SercomAttachment attachment(SERCOM0, master);
+	fake::Clock clock(48000000);
+	mcu::ClockGenerator generator(0, clock);
+	mcu::UsartSPI spi(SERCOM0, 4000000, generator);
+	CHECK_EQUAL(5u, SERCOM0->USART.BAUD.reg);
+	// 4MHz XCK with start and stop bit: 400kB/s instead of the 500kB/s of SPI at the same clock
+	const unsigned xck = 48000000 / (2 * (SERCOM0->USART.BAUD.reg + 1));
+	CHECK_EQUAL(400000u, xck / mcu::UsartSPI::ClocksPerByte);
+	checkBulkLoops(master, spi, "UsartSPI", mcu::UsartSPI::ClocksPerByte);
+}
+
+} // namespace
+
+int main()
+{
+	testSpi();
+	testStaticSpi();
+	testUsartSpi();
+	return check::result();
+}
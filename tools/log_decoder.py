@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Decodes the binary records of mcu::BinaryLogger using the .logstr section of the firmware ELF file.
+
+Usage: log_decoder.py firmware.elf [capture.bin]
+Reads the record stream from the capture file or stdin (e.g. a serial port: < /dev/ttyUSB0).
+"""
+
+import re
+import struct
+import sys
+
+CONVERSION = re.compile(r"%([-+ #0]*[0-9]*(?:\.[0-9]*)?)(hh|h|ll|l|j|z|t|L)?([diouxXcpfFeEgGaAs%])")
+
+
+def read_logstr(path):
+	"""Returns the contents of the .logstr section of an ELF32 little endian file."""
+	with open(path, "rb") as f:
+		elf = f.read()
+	if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+		raise ValueError("not an ELF32 little endian file")
+
+	shoff, = struct.unpack_from("<I", elf, 0x20)
+	shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2e)
+
+	def section(index):
+		name, _, _, _, offset, size = struct.unpack_from("<IIIIII", elf, shoff + index * shentsize)
+		return name, offset, size
+
+	_, names_offset, _ = section(shstrndx)
+	for i in range(shnum):
+		name, offset, size = section(i)
+		end = elf.index(b"\0", names_offset + name)
+		if elf[names_offset + name:end] == b".logstr":
+			return elf[offset:offset + size]
+	raise ValueError("no .logstr section found")
+
+
+def decode_record(logstr, payload):
+	"""Formats one record without its length byte."""
+	fmt_id, = struct.unpack_from("<H", payload, 0)
+	end = logstr.index(b"\0", fmt_id)
+	fmt = logstr[fmt_id:end].decode(errors="replace")
+	pos = 2
+
+	def convert(match):
+		nonlocal pos
+		flags, length, conversion = match.groups()
+		if conversion == "%":
+			return "%"
+		if conversion == "s":
+			size = payload[pos]
+			value = payload[pos + 1:pos + 1 + size].decode(errors="replace")
+			pos += 1 + size
+		elif conversion in "fFeEgGaA":
+			value, = struct.unpack_from("<d", payload, pos)
+			pos += 8
+			if conversion in "aA":
+				return value.hex()
+		else:
+			wide = length in ("ll", "j")
+			signed = conversion in "di"
+			code = ("<q" if signed else "<Q") if wide else ("<i" if signed else "<I")
+			value, = struct.unpack_from(code, payload, pos)
+			pos += 8 if wide else 4
+			if conversion == "c":
+				return chr(value & 0xff)
+			if conversion == "p":
+				return "0x%08x" % value
+			if conversion in "iu":
+				conversion = "d"
+		return ("%" + flags + conversion) % value
+
+	return CONVERSION.sub(convert, fmt)
+
+
+def main():
+	if len(sys.argv) not in (2, 3):
+		sys.exit(__doc__)
+	logstr = read_logstr(sys.argv[1])
+	stream = open(sys.argv[2], "rb") if len(sys.argv) == 3 else sys.stdin.buffer
+
+	while True:
+		header = stream.read(1)
+		if not header:
+			break
+		payload = stream.read(header[0])
+		if len(payload) != header[0]:
+			break
+		try:
+			print(decode_record(logstr, payload), flush=True)
+		except (ValueError, IndexError, struct.error) as e:
+			print("<undecodable record: %s>" % e, file=sys.stderr)
+
+
+if __name__ == "__main__":
+	main()